@@ -0,0 +1,486 @@
+/*
+ * Copyright 2018, Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * CAN reception benchmark on a virtual CAN interface.
+ *
+ * Frames are sent with ldx_can_tx_frame() from the main thread and received
+ * through one of the reception models of the library. The sequence number of
+ * each frame travels in its (extended) CAN ID, so the latency and the losses
+ * are measured for any payload size.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <errno.h>
+#include <getopt.h>
+#include <net/if.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "can.h"
+
+#define DEFAULT_IFACE		"vcan0"
+#define DEFAULT_NFRAMES		100000
+#define DEFAULT_SIZE		8
+#define DRAIN_TIMEOUT_MS	1000
+#define RETRY_SLEEP_US		50
+#define SEQ_MASK		CAN_EFF_MASK
+
+enum bench_mode {
+	MODE_THREAD,
+	MODE_POLL,
+	MODE_POLL_ONE,
+};
+
+static const char * const mode_names[] = {
+	[MODE_THREAD]	= "thread",
+	[MODE_POLL]	= "poll",
+	[MODE_POLL_ONE]	= "poll_one",
+};
+
+struct bench {
+	const char *iface;
+	enum bench_mode mode;
+	unsigned int nframes;
+	unsigned int rate;
+	unsigned int size;
+	bool fd;
+	bool perf;
+	bool keep_iface;
+
+	can_if_t *cif;
+	bool created_iface;
+	uint64_t *tx_ns;
+	uint64_t *lat_ns;
+	unsigned int received;
+	unsigned int unexpected;
+	unsigned int tx_retries;
+	bool run_rx;
+};
+
+/* The rx callbacks of the library do not take a context argument */
+static struct bench bench;
+
+static void usage_and_exit(const char *name, int exitval)
+{
+	fprintf(stdout,
+		"Benchmark the CAN reception paths of libdigiapix on a virtual CAN\n"
+		"interface.\n"
+		"\n"
+		"Usage: %s [options]\n\n"
+		"  -i <iface>    Interface to use (default: %s)\n"
+		"  -m <mode>     Reception mode: thread, poll or poll_one\n"
+		"                (default: thread)\n"
+		"  -n <frames>   Number of frames to send (default: %d)\n"
+		"  -r <rate>     Frames per second, 0 for as fast as possible\n"
+		"                (default: 0)\n"
+		"  -s <size>     Payload size in bytes (default: %d)\n"
+		"  -f            Send CAN FD frames\n"
+		"  -p            Collect and print the library statistics\n"
+		"  -k            Use an existing interface, do not create it\n"
+		"  -h            Help\n"
+		"\n"
+		"The interface is created with 'ip link', which needs root\n"
+		"privileges and the vcan kernel module.\n"
+		"\n", name, DEFAULT_IFACE, DEFAULT_NFRAMES, DEFAULT_SIZE);
+
+	exit(exitval);
+}
+
+static uint64_t now_ns(clockid_t clk)
+{
+	struct timespec ts;
+
+	clock_gettime(clk, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t cpu_ns(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ((uint64_t)ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000000ULL +
+	       ((uint64_t)ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1000ULL;
+}
+
+static int run_cmd(const char *fmt, const char *iface)
+{
+	char cmd[128];
+
+	snprintf(cmd, sizeof(cmd), fmt, iface);
+	return system(cmd);
+}
+
+static int setup_iface(struct bench *b)
+{
+	if (b->keep_iface)
+		return if_nametoindex(b->iface) ? 0 : -1;
+
+	if (!if_nametoindex(b->iface)) {
+		if (run_cmd("ip link add dev %s type vcan", b->iface)) {
+			fprintf(stderr, "Unable to create %s (is vcan loaded?)\n",
+				b->iface);
+			return -1;
+		}
+		b->created_iface = true;
+	}
+
+	if (run_cmd(b->fd ? "ip link set %s mtu 72" : "ip link set %s mtu 16",
+		    b->iface)) {
+		fprintf(stderr, "Unable to set the MTU of %s\n", b->iface);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void cleanup_iface(struct bench *b)
+{
+	if (b->created_iface)
+		run_cmd("ip link del dev %s", b->iface);
+}
+
+static void record_frame(const struct canfd_frame *frame)
+{
+	uint64_t now = now_ns(CLOCK_MONOTONIC);
+	uint32_t seq = frame->can_id & SEQ_MASK;
+	unsigned int idx;
+
+	if (!(frame->can_id & CAN_EFF_FLAG) || seq >= bench.nframes) {
+		bench.unexpected++;
+		return;
+	}
+
+	idx = __atomic_load_n(&bench.received, __ATOMIC_RELAXED);
+	if (idx < bench.nframes)
+		bench.lat_ns[idx] = now -
+			__atomic_load_n(&bench.tx_ns[seq], __ATOMIC_ACQUIRE);
+	__atomic_store_n(&bench.received, idx + 1, __ATOMIC_RELEASE);
+}
+
+static void rx_handler(struct canfd_frame *frame, struct timeval *tv)
+{
+	(void)tv;
+	record_frame(frame);
+}
+
+static void *rx_thread(void *arg)
+{
+	struct bench *b = arg;
+
+	while (__atomic_load_n(&b->run_rx, __ATOMIC_ACQUIRE)) {
+		if (b->mode == MODE_POLL) {
+			ldx_can_poll_msec(b->cif, 100);
+		} else {
+			struct timeval tout = { .tv_sec = 0, .tv_usec = 100000 };
+			ldx_can_event_t evt;
+
+			memset(&evt, 0, sizeof(evt));
+			if (ldx_can_poll_one(b->cif, &tout, &evt) > 0 &&
+			    evt.is_rx && !evt.is_error)
+				record_frame(&evt.frame);
+		}
+	}
+
+	return NULL;
+}
+
+static void send_frames(struct bench *b)
+{
+	uint64_t period = b->rate ? 1000000000ULL / b->rate : 0;
+	struct timespec next;
+	struct canfd_frame frame;
+	unsigned int seq;
+
+	memset(&frame, 0, sizeof(frame));
+	frame.len = b->size;
+	memset(frame.data, 0x55, sizeof(frame.data));
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+	for (seq = 0; seq < b->nframes; seq++) {
+		int ret;
+
+		if (period) {
+			next.tv_nsec += period;
+			while (next.tv_nsec >= 1000000000L) {
+				next.tv_nsec -= 1000000000L;
+				next.tv_sec++;
+			}
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+		}
+
+		frame.can_id = CAN_EFF_FLAG | (seq & SEQ_MASK);
+		frame.len = b->size;
+		__atomic_store_n(&b->tx_ns[seq], now_ns(CLOCK_MONOTONIC),
+				 __ATOMIC_RELEASE);
+		while ((ret = ldx_can_tx_frame(b->cif, &frame)) ==
+		       -CAN_ERROR_TX_RETRY_LATER) {
+			b->tx_retries++;
+			usleep(RETRY_SLEEP_US);
+			__atomic_store_n(&b->tx_ns[seq], now_ns(CLOCK_MONOTONIC),
+					 __ATOMIC_RELEASE);
+		}
+		if (ret) {
+			fprintf(stderr, "Frame %u not sent: %s\n", seq,
+				ldx_can_strerror(-ret));
+			break;
+		}
+	}
+}
+
+/* Wait until every frame has arrived or no progress is made for a while */
+static void drain(struct bench *b)
+{
+	unsigned int last = 0;
+	uint64_t idle_since = now_ns(CLOCK_MONOTONIC);
+
+	for (;;) {
+		unsigned int rcv = __atomic_load_n(&b->received, __ATOMIC_ACQUIRE);
+		uint64_t now = now_ns(CLOCK_MONOTONIC);
+
+		if (rcv >= b->nframes)
+			break;
+		if (rcv != last) {
+			last = rcv;
+			idle_since = now;
+		} else if (now - idle_since > DRAIN_TIMEOUT_MS * 1000000ULL) {
+			break;
+		}
+		usleep(1000);
+	}
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static uint64_t percentile(const uint64_t *sorted, unsigned int n, double pct)
+{
+	unsigned int idx;
+
+	if (!n)
+		return 0;
+	idx = (unsigned int)(pct / 100.0 * (n - 1) + 0.5);
+	return sorted[idx];
+}
+
+static void print_hist(const char *name, const ldx_can_perf_hist_t *hist)
+{
+	printf("  %-16s count %llu  p50 %llu  p99 %llu  max %llu\n", name,
+	       (unsigned long long)hist->count,
+	       (unsigned long long)ldx_can_perf_hist_percentile(hist, 50),
+	       (unsigned long long)ldx_can_perf_hist_percentile(hist, 99),
+	       (unsigned long long)hist->max);
+}
+
+static void print_report(struct bench *b, uint64_t wall_ns, uint64_t cpu)
+{
+	unsigned int n = b->received < b->nframes ? b->received : b->nframes;
+
+	qsort(b->lat_ns, n, sizeof(uint64_t), cmp_u64);
+
+	printf("mode %s, %s frames of %u bytes, rate %s\n",
+	       mode_names[b->mode], b->fd ? "FD" : "classic", b->size,
+	       b->rate ? "limited" : "unlimited");
+	printf("  sent %u, received %u, lost %u, unexpected %u, "
+	       "kernel drops %u, tx retries %u\n",
+	       b->nframes, b->received,
+	       b->nframes > b->received ? b->nframes - b->received : 0,
+	       b->unexpected, b->cif->dropped_frames, b->tx_retries);
+	printf("  throughput %.0f frames/s, cpu (tx + rx) %.0f ns/frame\n",
+	       wall_ns ? n * 1e9 / wall_ns : 0.0, n ? (double)cpu / n : 0.0);
+	printf("  latency us: p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+	       percentile(b->lat_ns, n, 50) / 1e3,
+	       percentile(b->lat_ns, n, 99) / 1e3,
+	       percentile(b->lat_ns, n, 99.9) / 1e3,
+	       n ? b->lat_ns[n - 1] / 1e3 : 0.0);
+
+	if (b->perf) {
+		ldx_can_perf_stats_t stats;
+
+		if (ldx_can_get_perf_stats(b->cif, &stats))
+			return;
+		printf("library statistics:\n");
+		printf("  rx frames %llu  rx syscalls %llu  tx syscalls %llu  "
+		       "tx retry later %llu\n",
+		       (unsigned long long)stats.rx_frames,
+		       (unsigned long long)stats.rx_syscalls,
+		       (unsigned long long)stats.tx_syscalls,
+		       (unsigned long long)stats.tx_retry_later);
+		print_hist("rx batch", &stats.rx_batch);
+		print_hist("rx latency ns", &stats.rx_latency_ns);
+		print_hist("lock wait ns", &stats.lock_wait_ns);
+		print_hist("lock hold ns", &stats.lock_hold_ns);
+	}
+}
+
+static void parse_args(int argc, char **argv, struct bench *b)
+{
+	int opt;
+
+	b->iface = DEFAULT_IFACE;
+	b->mode = MODE_THREAD;
+	b->nframes = DEFAULT_NFRAMES;
+	b->size = DEFAULT_SIZE;
+
+	while ((opt = getopt(argc, argv, "i:m:n:r:s:fpkh")) > 0) {
+		switch (opt) {
+		case 'i':
+			b->iface = optarg;
+			break;
+		case 'm':
+			if (!strcmp(optarg, "thread"))
+				b->mode = MODE_THREAD;
+			else if (!strcmp(optarg, "poll"))
+				b->mode = MODE_POLL;
+			else if (!strcmp(optarg, "poll_one"))
+				b->mode = MODE_POLL_ONE;
+			else
+				usage_and_exit(argv[0], EXIT_FAILURE);
+			break;
+		case 'n':
+			b->nframes = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			b->rate = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			b->size = strtoul(optarg, NULL, 10);
+			break;
+		case 'f':
+			b->fd = true;
+			break;
+		case 'p':
+			b->perf = true;
+			break;
+		case 'k':
+			b->keep_iface = true;
+			break;
+		case 'h':
+			usage_and_exit(argv[0], EXIT_SUCCESS);
+			break;
+		default:
+			usage_and_exit(argv[0], EXIT_FAILURE);
+		}
+	}
+
+	if (!b->nframes || b->nframes > SEQ_MASK ||
+	    b->size > (b->fd ? CANFD_MAX_DLEN : CAN_MAX_DLEN)) {
+		fprintf(stderr, "Invalid number of frames or frame size\n");
+		usage_and_exit(argv[0], EXIT_FAILURE);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct can_filter filter = {
+		.can_id = CAN_EFF_FLAG,
+		.can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG,
+	};
+	pthread_t rx_thr;
+	bool rx_thr_started = false;
+	can_if_cfg_t cfg;
+	uint64_t t0, c0, wall, cpu;
+	int ret = EXIT_FAILURE;
+
+	parse_args(argc, argv, &bench);
+
+	bench.tx_ns = calloc(bench.nframes, sizeof(uint64_t));
+	bench.lat_ns = calloc(bench.nframes, sizeof(uint64_t));
+	if (!bench.tx_ns || !bench.lat_ns) {
+		fprintf(stderr, "Unable to allocate memory\n");
+		goto free_mem;
+	}
+
+	if (setup_iface(&bench))
+		goto free_mem;
+
+	bench.cif = ldx_can_request_by_name(bench.iface);
+	if (!bench.cif) {
+		fprintf(stderr, "Unable to request %s\n", bench.iface);
+		goto cleanup_iface;
+	}
+
+	ldx_can_set_defconfig(&cfg);
+	/* A vcan interface has no CAN state nor bit timing */
+	cfg.nl_cmd_verify = false;
+	cfg.canfd_enabled = bench.fd;
+	cfg.perf_stats = bench.perf;
+	cfg.polled_mode = bench.mode != MODE_THREAD;
+	cfg.error_mask = 0;
+
+	ret = ldx_can_init(bench.cif, &cfg);
+	if (ret) {
+		fprintf(stderr, "Unable to initialize %s: %s\n", bench.iface,
+			ldx_can_strerror(-ret));
+		ret = EXIT_FAILURE;
+		goto free_can;
+	}
+
+	ret = ldx_can_register_rx_handler(bench.cif, rx_handler, &filter, 1);
+	if (ret < 0) {
+		fprintf(stderr, "Unable to register rx handler: %s\n",
+			ldx_can_strerror(-ret));
+		ret = EXIT_FAILURE;
+		goto free_can;
+	}
+
+	bench.run_rx = true;
+	if (bench.mode != MODE_THREAD) {
+		if (pthread_create(&rx_thr, NULL, rx_thread, &bench)) {
+			fprintf(stderr, "Unable to create rx thread\n");
+			ret = EXIT_FAILURE;
+			goto free_can;
+		}
+		rx_thr_started = true;
+	}
+
+	t0 = now_ns(CLOCK_MONOTONIC);
+	c0 = cpu_ns();
+	send_frames(&bench);
+	drain(&bench);
+	wall = now_ns(CLOCK_MONOTONIC) - t0;
+	cpu = cpu_ns() - c0;
+
+	__atomic_store_n(&bench.run_rx, false, __ATOMIC_RELEASE);
+	if (rx_thr_started)
+		pthread_join(rx_thr, NULL);
+
+	print_report(&bench, wall, cpu);
+	ret = bench.received == bench.nframes ? EXIT_SUCCESS : EXIT_FAILURE;
+
+free_can:
+	ldx_can_free(bench.cif);
+cleanup_iface:
+	cleanup_iface(&bench);
+free_mem:
+	free(bench.tx_ns);
+	free(bench.lat_ns);
+
+	return ret;
+}
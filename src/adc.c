@@ -314,8 +314,14 @@ int ldx_adc_start_sampling(adc_t *adc, const ldx_adc_read_cb_t read_cb,
 
 	_adc = (adc_internal_t *) adc->_data;
 
-	pthread_attr_init(&pthread_attr);
-	pthread_attr_setschedpolicy(&pthread_attr, SCHED_FIFO);
+	if (thread_attr_init(&pthread_attr, _adc->sched_priority,
+			     _adc->cpu_mask)) {
+		log_error("%s: Unable to start sampling ADC chip: %d channel: %d,"
+				" invalid thread attributes", __func__,
+				adc->chip, adc->channel);
+		free(poll_thread);
+		return EXIT_FAILURE;
+	}
 
 	log_debug("%s: Creating new callback", __func__);
 
@@ -324,6 +330,7 @@ int ldx_adc_start_sampling(adc_t *adc, const ldx_adc_read_cb_t read_cb,
 		log_error("%s: Unable to start sampling ADC chip: %d channel: %d,"
 				" cannot allocate memory", __func__, adc->chip,
 				adc->channel);
+		pthread_attr_destroy(&pthread_attr);
 		free(poll_thread);
 		return EXIT_FAILURE;
 	}
@@ -337,8 +344,9 @@ int ldx_adc_start_sampling(adc_t *adc, const ldx_adc_read_cb_t read_cb,
 
 	pthread_mutex_init(&new_adc_callback->ready, NULL);
 
-	int ret = pthread_create(poll_thread, NULL,
+	int ret = pthread_create(poll_thread, &pthread_attr,
 			ldx_sampling_callback_thread, adc);
+	pthread_attr_destroy(&pthread_attr);
 
 	if (ret == 0) {
 		/* Wait for thread to be initialized and ready */
@@ -348,10 +356,35 @@ int ldx_adc_start_sampling(adc_t *adc, const ldx_adc_read_cb_t read_cb,
 		pthread_mutex_destroy(&_adc->callback->ready);
 		free(_adc->callback->thread);
 		free(_adc->callback);
+		_adc->callback = NULL;
+
+		log_error("%s: Unable to create sampling thread for ADC chip: %d"
+				" channel: %d (%d)", __func__, adc->chip,
+				adc->channel, ret);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
 
+int ldx_adc_set_sampling_sched(adc_t *adc, int priority, uint64_t cpu_mask)
+{
+	adc_internal_t *_adc = NULL;
+
+	if (adc == NULL) {
+		log_error("%s: ADC cannot be NULL", __func__);
 		return EXIT_FAILURE;
 	}
 
+	if (priority < 0) {
+		log_error("%s: Invalid priority %d", __func__, priority);
+		return EXIT_FAILURE;
+	}
+
+	_adc = (adc_internal_t *) adc->_data;
+	_adc->sched_priority = priority;
+	_adc->cpu_mask = cpu_mask;
+
 	return EXIT_SUCCESS;
 }
 
@@ -22,15 +22,20 @@
 #include <fcntl.h>
 #include <linux/can/error.h>
 #include <linux/net_tstamp.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "can.h"
 #include "_can.h"
+#include "_common.h"
 #include "_log.h"
 
 /* map the sanitized data length to an appropriate data length code */
@@ -100,9 +105,42 @@ const char *const __can_error_str[CAN_ERROR_MAX + 1] = {
 	[CAN_ERROR_GETSKTOPT_RCVBUF]	= "getsocketopt SO_RCVBUF error",
 
 	[CAN_ERROR_DROPPED_FRAMES]		= "Dropped frames",
+
+	[CAN_ERROR_EPOLL_CREATE]		= "epoll_create error",
+	[CAN_ERROR_EPOLL_CTL]		= "epoll_ctl error",
+	[CAN_ERROR_EVENTFD]		= "eventfd error",
+	[CAN_ERROR_REACTOR_BUSY]	= "Interface already serviced by a thread",
+	[CAN_ERROR_CAPTURE]		= "Packet capture error",
+	[CAN_ERROR_PERF_DISABLED]	= "Performance statistics not enabled",
+	[CAN_ERROR_ISOTP_SKT]		= "ISO-TP socket error",
+	[CAN_ERROR_ISOTP_TIMEOUT]	= "ISO-TP timeout",
+	[CAN_ERROR_ISOTP_OVERFLOW]	= "ISO-TP buffer overflow",
+	[CAN_ERROR_ISOTP_PROTOCOL]	= "ISO-TP protocol error",
+
+	[CAN_ERROR_BCM_SKT]		= "BCM socket error",
+	[CAN_ERROR_BCM_WR]		= "BCM request rejected",
+	[CAN_ERROR_BCM_RX_TIMEOUT]	= "BCM cyclic frame reception timeout",
+
+	[CAN_ERROR_LOG_FILE]		= "Frame log file error",
+	[CAN_ERROR_LOG_FORMAT]		= "Invalid frame log",
+
+	[CAN_ERROR_SIGDB_FORMAT]	= "Invalid signal database",
+	[CAN_ERROR_SIGDB_MSG_NOT_FOUND]	= "Message not in signal database",
+	[CAN_ERROR_SIGDB_SIG_NOT_FOUND]	= "Signal not in signal database",
+
+	[CAN_ERROR_NL_SKT]		= "Netlink socket error",
+	[CAN_ERROR_NL_SET_LINK]		= "Netlink link configuration rejected",
+	[CAN_ERROR_NL_TIMEOUT]		= "Netlink request timeout",
+	[CAN_ERROR_LINK_EVENT]		= "Link status changed",
+	[CAN_ERROR_GW_ROUTE]		= "CAN gateway route error",
+	[CAN_ERROR_NOT_SUPPORTED]	= "Operation not supported",
+	[CAN_ERROR_TXQ_DISABLED]	= "Transmission queue not enabled",
+	[CAN_ERROR_TXQ_FULL]		= "Transmission queue full",
 };
 
-static void ldx_can_close_rx_socket_impl(const can_if_t* cif, int rx_skt);
+static can_cb_t* find_rxcb_by_fd(const can_if_t* cif, int fd);
+static bool ldx_can_cb_is_valid(can_priv_t *pdata, can_cb_t *cb,
+				unsigned int gen);
 static int ldx_can_open_rx_socket_impl(can_if_t* cif,
 	struct can_filter* filters, int nfilters);
 
@@ -110,12 +148,18 @@ int ldx_can_lock_mutex(const can_if_t *cif, char const* fn)
 {
 	can_priv_t *pdata = cif->_data;
 	if (pdata->has_mutex) {
+		uint64_t t0 = pdata->perf ? ldx_can_perf_now_ns() : 0;
 		int ret = pthread_mutex_lock(&pdata->mutex);
 		if (ret) {
 			log_error("%s: error mutex lock %s",
 				fn, cif->name);
 			return -CAN_ERROR_THREAD_MUTEX_LOCK;
 		}
+		if (pdata->perf) {
+			pdata->perf_lock_ns = ldx_can_perf_now_ns();
+			ldx_can_perf_hist_record(&pdata->perf->lock_wait_ns,
+						 pdata->perf_lock_ns - t0);
+		}
 	}
 	return 0;
 }
@@ -124,6 +168,10 @@ void ldx_can_unlock_mutex(const can_if_t *cif)
 {
 	can_priv_t *pdata = cif->_data;
 	if (pdata->has_mutex) {
+		if (pdata->perf)
+			ldx_can_perf_hist_record(&pdata->perf->lock_hold_ns,
+						 ldx_can_perf_now_ns() -
+						 pdata->perf_lock_ns);
 		pthread_mutex_unlock(&pdata->mutex);
 	}
 }
@@ -162,46 +210,125 @@ void ldx_can_set_defconfig(can_if_cfg_t *cfg)
 				  CAN_ERR_RESTARTED;
 
 	cfg->polled_mode = false; // Historically was like this by default.
+	cfg->rx_batch_size	= LDX_CAN_DEF_RX_BATCH;
+	cfg->tx_wait_ms		= 0;
+	cfg->rx_spin_us		= 0;
+	cfg->thread_priority	= 0;
+	cfg->thread_cpu_mask	= 0;
+	cfg->busy_poll_us	= 0;
+	cfg->skt_priority	= -1;
+	cfg->perf_stats		= false;
+	cfg->tx_queue_len	= 0;
 }
 
-static void process_can_process_msgheader(struct msghdr *msg, struct timeval *tv, uint32_t *df)
+static void process_can_parse_cmsg(struct cmsghdr *cmsg, ldx_can_event_t *evt)
 {
-	struct cmsghdr *cmsg;
 	struct timespec *stamp;
+	struct timeval tv;
+
+	switch (cmsg->cmsg_type) {
+	case SO_RXQ_OVFL:
+		memcpy(&evt->dropped_frames, CMSG_DATA(cmsg), sizeof(uint32_t));
+		break;
+
+	case SO_TIMESTAMP:
+		/* Only used if the kernel does not support SO_TIMESTAMPNS */
+		memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
+		evt->tstamp = tv;
+		evt->ts_sw.tv_sec = tv.tv_sec;
+		evt->ts_sw.tv_nsec = tv.tv_usec * 1000;
+		break;
+
+	case SO_TIMESTAMPNS:
+		memcpy(&evt->ts_sw, CMSG_DATA(cmsg), sizeof(evt->ts_sw));
+		evt->tstamp.tv_sec = evt->ts_sw.tv_sec;
+		evt->tstamp.tv_usec = evt->ts_sw.tv_nsec / 1000;
+		break;
+
+	case SO_TIMESTAMPING:
+		/*
+		 * stamp[0] is the software timestamp
+		 * stamp[1] is deprecated
+		 * stamp[2] is the raw hardware timestamp
+		 * See chapter 2.1.2 Receive timestamps in
+		 * linux/Documentation/networking/timestamping.txt
+		 */
+		stamp = (struct timespec *)CMSG_DATA(cmsg);
+		evt->ts_sw = stamp[0];
+		evt->ts_hw = stamp[2];
+		evt->tstamp.tv_sec = stamp[2].tv_sec;
+		evt->tstamp.tv_usec = stamp[2].tv_nsec / 1000;
+		break;
 
-	for (cmsg = CMSG_FIRSTHDR(msg);
-		 cmsg && (cmsg->cmsg_level == SOL_SOCKET);
-		 cmsg = CMSG_NXTHDR(msg, cmsg)) {
+	default:
+		break;
+	}
+}
 
-		switch (cmsg->cmsg_type) {
-		case SO_RXQ_OVFL:
-			memcpy(df, CMSG_DATA(cmsg), sizeof(uint32_t));
-			break;
+/* Check there is a SOL_SOCKET control message of 'type' at 'off', if any */
+static bool process_can_cmsg_at(uint8_t *ctrl, int off, int type)
+{
+	struct cmsghdr *cmsg = (struct cmsghdr *)(ctrl + off);
 
-		case SO_TIMESTAMP:
-			memcpy(tv, CMSG_DATA(cmsg), sizeof(*tv));
-			break;
+	return off < 0 ||
+	       (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == type);
+}
 
-		case SO_TIMESTAMPING:
-			/*
-			 * stamp[0] is the software timestamp
-			 * stamp[1] is deprecated
-			 * stamp[2] is the raw hardware timestamp
-			 * See chapter 2.1.2 Receive timestamps in
-			 * linux/Documentation/networking/timestamping.txt
-			 */
-			stamp = (struct timespec *)CMSG_DATA(cmsg);
-			tv->tv_sec = stamp[2].tv_sec;
-			tv->tv_usec = stamp[2].tv_nsec / 1000;
-			break;
+/*
+ * All the rx sockets of an interface are set up with the same options, so
+ * the kernel builds the same control messages for every frame. Once their
+ * layout is learned from a full walk, each message is only checked against
+ * it and parsed at the known offsets. Any mismatch (for example, when the
+ * drop counter first shows up) falls back to the walk, which learns the new
+ * layout.
+ */
+static void process_can_process_msgheader(can_cmsg_layout_t *layout,
+					  struct msghdr *msg,
+					  ldx_can_event_t *evt)
+{
+	uint8_t *ctrl = msg->msg_control;
+	can_cmsg_layout_t learnt;
+	struct cmsghdr *cmsg;
 
-		default:
-			break;
+	if (layout->len && msg->msg_controllen == layout->len &&
+	    process_can_cmsg_at(ctrl, layout->ts_off, layout->ts_type) &&
+	    process_can_cmsg_at(ctrl, layout->ovfl_off, SO_RXQ_OVFL)) {
+		if (layout->ts_off >= 0)
+			process_can_parse_cmsg((struct cmsghdr *)(ctrl + layout->ts_off),
+					       evt);
+		if (layout->ovfl_off >= 0)
+			process_can_parse_cmsg((struct cmsghdr *)(ctrl + layout->ovfl_off),
+					       evt);
+		return;
+	}
+
+	learnt.len = msg->msg_controllen;
+	learnt.ts_off = -1;
+	learnt.ts_type = 0;
+	learnt.ovfl_off = -1;
+
+	for (cmsg = CMSG_FIRSTHDR(msg);
+		 cmsg && (cmsg->cmsg_level == SOL_SOCKET);
+		 cmsg = CMSG_NXTHDR(msg, cmsg)) {
+		int off = (uint8_t *)cmsg - ctrl;
+
+		if (cmsg->cmsg_type == SO_RXQ_OVFL) {
+			learnt.ovfl_off = off;
+		} else if (cmsg->cmsg_type == SO_TIMESTAMP ||
+			   cmsg->cmsg_type == SO_TIMESTAMPNS ||
+			   cmsg->cmsg_type == SO_TIMESTAMPING) {
+			learnt.ts_off = off;
+			learnt.ts_type = cmsg->cmsg_type;
 		}
+		process_can_parse_cmsg(cmsg, evt);
 	}
+
+	/* Only layouts made of known messages can be trusted */
+	if (!cmsg)
+		*layout = learnt;
 }
 
-static void ldx_can_call_err_cb(const can_if_t *cif, int error, void *data)
+void ldx_can_call_err_cb(const can_if_t *cif, int error, void *data)
 {
 	can_priv_t *pdata = cif->_data;
 	can_err_cb_t *err_cb;
@@ -213,9 +340,24 @@ static void ldx_can_call_err_cb(const can_if_t *cif, int error, void *data)
 }
 
 
-static void ldx_can_init_iodata(can_priv_t *pdata)
+static void ldx_can_free_iodata(can_priv_t *pdata)
+{
+	free(pdata->rx_evts);
+	free(pdata->rx_mmsg);
+	free(pdata->rx_iov);
+	free(pdata->rx_ctrl);
+	pdata->rx_evts = NULL;
+	pdata->rx_mmsg = NULL;
+	pdata->rx_iov = NULL;
+	pdata->rx_ctrl = NULL;
+	pdata->rx_batch = 0;
+}
+
+static int ldx_can_init_iodata(can_priv_t *pdata, unsigned int batch)
 {
 	struct msghdr *msg = &pdata->msg;
+	unsigned int i;
+
 	msg->msg_name = &pdata->addr;
 	msg->msg_iov = &pdata->iov;
 	msg->msg_iovlen = 1;
@@ -223,12 +365,49 @@ static void ldx_can_init_iodata(can_priv_t *pdata)
 	msg->msg_namelen = sizeof(struct sockaddr_can);
 	msg->msg_controllen = sizeof(pdata->ctrlmsg);
 	msg->msg_flags = 0;
+
+	/*
+	 * Set up the batched reception ring once, so that each recvmmsg()
+	 * only needs to restore the control buffer length of its slots.
+	 */
+	ldx_can_free_iodata(pdata);
+	if (!batch)
+		batch = LDX_CAN_DEF_RX_BATCH;
+
+	pdata->rx_evts = calloc(batch, sizeof(*pdata->rx_evts));
+	pdata->rx_mmsg = calloc(batch, sizeof(*pdata->rx_mmsg));
+	pdata->rx_iov = calloc(batch, sizeof(*pdata->rx_iov));
+	pdata->rx_ctrl = calloc(batch, sizeof(*pdata->rx_ctrl));
+	if (!pdata->rx_evts || !pdata->rx_mmsg || !pdata->rx_iov ||
+	    !pdata->rx_ctrl) {
+		ldx_can_free_iodata(pdata);
+		return -CAN_ERROR_NO_MEM;
+	}
+	pdata->rx_batch = batch;
+
+	for (i = 0; i < batch; i++) {
+		msg = &pdata->rx_mmsg[i].msg_hdr;
+		pdata->rx_iov[i].iov_base = &pdata->rx_evts[i].frame;
+		pdata->rx_iov[i].iov_len = sizeof(pdata->rx_evts[i].frame);
+		msg->msg_name = NULL;
+		msg->msg_namelen = 0;
+		msg->msg_iov = &pdata->rx_iov[i];
+		msg->msg_iovlen = 1;
+		msg->msg_control = pdata->rx_ctrl[i];
+		msg->msg_controllen = sizeof(pdata->rx_ctrl[i]);
+		msg->msg_flags = 0;
+	}
+
+	return CAN_ERROR_NONE;
 }
 void ldx_can_io_set_evt_ptr(const can_if_t *cif, ldx_can_event_t* evt)
 {
 	can_priv_t *pdata = cif->_data;
 	pdata->iov.iov_base = &evt->frame;
 	pdata->iov.iov_len = sizeof(evt->frame);
+	/* The kernel shrinks it to the length used by the previous read */
+	pdata->msg.msg_controllen = sizeof(pdata->ctrlmsg);
+	pdata->msg.msg_flags = 0;
 }
 void ldx_can_io_clear_evt_ptr(const can_if_t *cif)
 {
@@ -256,38 +435,64 @@ int ldx_can_read_tx_socket_i(const can_if_t *cif, ldx_can_event_t* evt)
 	return nbytes;
 }
 
-void ldx_can_dispatch_evt(const can_if_t *cif, ldx_can_event_t* evt) 
+/*
+ * Report the errors and drops of a received event and account its latency.
+ * Returns true if the event carries a frame to be delivered.
+ */
+static bool ldx_can_rx_prepare(const can_if_t *cif, ldx_can_event_t *evt)
 {
 	can_priv_t *pdata = cif->_data;
+
 	if (evt->is_error) {
-		can_err_cb_t *err_cb;
-		list_for_each_entry(err_cb, &pdata->err_cb_list_head, list) {
-			if (err_cb->handler)
-				err_cb->handler(evt->frame.can_id, NULL);
-		}
+		ldx_can_call_err_cb(cif, evt->frame.can_id, NULL);
+		return false;
 	}
-	else if (evt->is_rx) {
-		can_cb_t *rx_cb;
-		if (evt->dropped_frames) {
-			ldx_can_call_err_cb(cif, CAN_ERROR_DROPPED_FRAMES, NULL);
-		}
 
-		if (evt->is_error) {
-			can_err_cb_t *err_cb;
-			list_for_each_entry(err_cb, &pdata->err_cb_list_head, list) {
-				if (err_cb->handler)
-					err_cb->handler(evt->frame.can_id, NULL);
-			}
-		}
+	if (evt->dropped_frames) {
+		ldx_can_call_err_cb(cif, CAN_ERROR_DROPPED_FRAMES, NULL);
+	}
 
-		list_for_each_entry(rx_cb, &pdata->rx_cb_list_head, list) {
-			if (rx_cb->handler) {
-				if (rx_cb->rx_skt == evt->rx_skt) {
-					rx_cb->handler(&evt->frame, &evt->tstamp);
-				}
-			}
-		}
+	if (pdata->perf && evt->ts_sw.tv_sec) {
+		/* Software timestamps use the real time clock */
+		struct timespec now;
+		int64_t lat;
 
+		clock_gettime(CLOCK_REALTIME, &now);
+		lat = (int64_t)(now.tv_sec - evt->ts_sw.tv_sec) * 1000000000LL +
+		      now.tv_nsec - evt->ts_sw.tv_nsec;
+		ldx_can_perf_hist_record(&pdata->perf->rx_latency_ns,
+					 lat > 0 ? lat : 0);
+	}
+
+	return true;
+}
+
+/* Dispatch an event read from the socket of a known rx handler */
+static void ldx_can_dispatch_rx(const can_if_t *cif, can_cb_t *rx_cb,
+				ldx_can_event_t *evt)
+{
+	bool is_frame = ldx_can_rx_prepare(cif, evt);
+
+	if (rx_cb->batch_handler)
+		rx_cb->batch_handler(rx_cb->ctx, evt, 1);
+	else if (!is_frame)
+		return;
+	else if (rx_cb->id_table)
+		ldx_can_id_table_dispatch(rx_cb->id_table, evt);
+	else if (rx_cb->handler)
+		rx_cb->handler(&evt->frame, &evt->tstamp);
+}
+
+void ldx_can_dispatch_evt(const can_if_t *cif, ldx_can_event_t* evt) 
+{
+	if (evt->is_error) {
+		ldx_can_call_err_cb(cif, evt->frame.can_id, NULL);
+	}
+	else if (evt->is_rx) {
+		can_cb_t *rx_cb = find_rxcb_by_fd(cif, evt->rx_skt);
+
+		if (rx_cb)
+			ldx_can_dispatch_rx(cif, rx_cb, evt);
 	}
 }
 
@@ -305,6 +510,43 @@ static int ldx_can_process_tx_socket(const can_if_t *cif)
 }
 
 
+static void ldx_can_fill_rx_evt(const can_if_t *cif, int rx_skt,
+				struct msghdr *msg, ldx_can_event_t *evt)
+{
+	evt->tstamp.tv_sec = 0;
+	evt->tstamp.tv_usec = 0;
+	evt->ts_sw.tv_sec = 0;
+	evt->ts_sw.tv_nsec = 0;
+	evt->ts_hw = evt->ts_sw;
+	evt->dropped_frames = 0;
+
+	if (cif->cfg.process_header) {
+		can_priv_t *pdata = cif->_data;
+		uint32_t ovfl;
+
+		process_can_process_msgheader(&pdata->cmsg_layout, msg, evt);
+
+		/*
+		 * SO_RXQ_OVFL is the total of frames dropped by the socket, so
+		 * only an increase is reported.
+		 */
+		ovfl = evt->dropped_frames;
+		evt->dropped_frames = 0;
+		if (ovfl > cif->dropped_frames) {
+			log_error("%s: CAN frames dropped", __func__);
+			evt->dropped_frames = ovfl - cif->dropped_frames;
+			((can_if_t*)cif)->dropped_frames = ovfl;
+			if (pdata->perf)
+				ldx_can_perf_add(&pdata->perf->rx_dropped,
+						 evt->dropped_frames);
+		}
+	}
+
+	evt->is_rx = true;
+	evt->rx_skt = rx_skt;
+	evt->is_error = (0 != (evt->frame.can_id & CAN_ERR_FLAG));
+}
+
 int ldx_can_read_rx_socket_i(const can_if_t *cif, int rx_skt, ldx_can_event_t* evt)
 {
 	int ret = 0;
@@ -312,6 +554,13 @@ int ldx_can_read_rx_socket_i(const can_if_t *cif, int rx_skt, ldx_can_event_t* e
 	ldx_can_io_set_evt_ptr(cif, evt);
 	int nbytes = recvmsg(rx_skt, &pdata->msg, 0);
 	ldx_can_io_clear_evt_ptr(cif);
+	if (pdata->perf) {
+		ldx_can_perf_add(&pdata->perf->rx_syscalls, 1);
+		if (nbytes > 0) {
+			ldx_can_perf_add(&pdata->perf->rx_frames, 1);
+			ldx_can_perf_add(&pdata->perf->rx_bytes, nbytes);
+		}
+	}
 	if (nbytes < 0) {
 		if (errno == ENETDOWN) {
 			log_error("%s: CAN network is down", __func__);
@@ -324,148 +573,438 @@ int ldx_can_read_rx_socket_i(const can_if_t *cif, int rx_skt, ldx_can_event_t* e
 		return EXIT_SUCCESS;
 	}
 
-	if(cif->cfg.process_header) {
-		process_can_process_msgheader(&pdata->msg, &evt->tstamp, &evt->dropped_frames);
-		if (evt->dropped_frames) {
-			log_error("%s: CAN frames dropped", __func__);
-			((can_if_t*)cif)->dropped_frames = evt->dropped_frames;
+	ldx_can_fill_rx_evt(cif, rx_skt, &pdata->msg, evt);
+
+	return nbytes;
+}
+
+/*
+ * Drain up to 'vlen' frames (at most 'rx_batch') from the socket with a
+ * single recvmmsg() into the reception ring. Returns the number of events
+ * stored in 'pdata->rx_evts', or a negative error code.
+ */
+static int ldx_can_read_rx_batch_i(const can_if_t *cif, int rx_skt,
+				   unsigned int vlen)
+{
+	can_priv_t *pdata = cif->_data;
+	int i, n;
+
+	if (vlen > pdata->rx_batch)
+		vlen = pdata->rx_batch;
+
+	/* The kernel shrinks them to the length used by the previous read */
+	for (i = 0; i < (int)vlen; i++) {
+		pdata->rx_mmsg[i].msg_hdr.msg_controllen =
+			sizeof(pdata->rx_ctrl[i]);
+		pdata->rx_mmsg[i].msg_hdr.msg_flags = 0;
+	}
+
+	n = recvmmsg(rx_skt, pdata->rx_mmsg, vlen, MSG_DONTWAIT, NULL);
+	if (pdata->perf) {
+		ldx_can_perf_add(&pdata->perf->rx_syscalls, 1);
+		if (n > 0) {
+			uint64_t bytes = 0;
+
+			for (i = 0; i < n; i++)
+				bytes += pdata->rx_mmsg[i].msg_len;
+			ldx_can_perf_add(&pdata->perf->rx_frames, n);
+			ldx_can_perf_add(&pdata->perf->rx_bytes, bytes);
+			ldx_can_perf_hist_record(&pdata->perf->rx_batch, n);
+		}
+	}
+	if (n < 0) {
+		if (errno == ENETDOWN) {
+			log_error("%s: CAN network is down", __func__);
+			return -CAN_ERROR_NETWORK_DOWN;
 		}
+		return 0;
 	}
 
-	evt->is_rx = true;
-	evt->rx_skt = rx_skt;
-	evt->is_error = (0 != (evt->frame.can_id & CAN_ERR_FLAG));
-	
-	return nbytes;
+	for (i = 0; i < n; i++) {
+		struct msghdr *msg = &pdata->rx_mmsg[i].msg_hdr;
+		ldx_can_event_t *evt = &pdata->rx_evts[i];
+
+		ldx_can_fill_rx_evt(cif, rx_skt, msg, evt);
+	}
+
+	return n;
 }
 
+/*
+ * Hand a batch read into 'pdata->rx_evts' over to the consumer of a ring.
+ * Errors and drops are reported as for any other handler; the error frames
+ * are still queued, flagged with 'is_error'.
+ */
+static void ldx_can_ring_feed(const can_if_t *cif, can_cb_t *rx_cb, int n)
+{
+	can_priv_t *pdata = cif->_data;
+	int i;
+
+	for (i = 0; i < n; i++)
+		ldx_can_rx_prepare(cif, &pdata->rx_evts[i]);
+	ldx_can_ring_push_bulk(rx_cb->ring, pdata->rx_evts, n);
+}
 
 static int ldx_can_process_rx_socket(const can_if_t *cif, can_cb_t *rx_cb)
+{
+	can_priv_t *pdata = cif->_data;
+	unsigned int gen = pdata->cb_gen;
+	int i, n;
+
+	/*
+	 * A partially filled batch means the socket queue is empty, so there
+	 * is no need for an extra syscall just to get EAGAIN.
+	 */
+	do {
+		n = ldx_can_read_rx_batch_i(cif, rx_cb->rx_skt,
+					    pdata->rx_batch);
+		if (rx_cb->ring) {
+			/* Hand the whole batch over to the consumer thread */
+			if (n > 0)
+				ldx_can_ring_feed(cif, rx_cb, n);
+			continue;
+		}
+		if (rx_cb->batch_handler) {
+			if (n <= 0)
+				continue;
+			for (i = 0; i < n; i++)
+				ldx_can_rx_prepare(cif, &pdata->rx_evts[i]);
+			rx_cb->batch_handler(rx_cb->ctx, pdata->rx_evts, n);
+			continue;
+		}
+		for (i = 0; i < n; i++)
+			ldx_can_dispatch_rx(cif, rx_cb, &pdata->rx_evts[i]);
+	/* A callback may have released this very handler meanwhile */
+	} while (n == (int)pdata->rx_batch &&
+		 ldx_can_cb_is_valid(pdata, rx_cb, gen));
+
+	return n < 0 ? n : 0;
+}
+
+/*
+ * Broadcast manager sockets only report changes, so a single message is
+ * handled per readiness event; level triggered epoll reports the rest.
+ */
+static int ldx_can_process_bcm_socket(const can_if_t *cif, can_cb_t *bcm_cb)
 {
 	ldx_can_event_t evt;
-	
-	int ret = 1;
-	while (ret > 0) {
-		memset(&evt, 0, sizeof(evt));
-		ret = ldx_can_read_rx_socket_i(cif, rx_cb->rx_skt, &evt);
-		ldx_can_dispatch_evt(cif, &evt);
-	}
-	return ret;
+	int ret;
+
+	memset(&evt, 0, sizeof(evt));
+	ret = ldx_can_read_bcm_socket_i(cif, bcm_cb, &evt);
+	if (ret > 0)
+		ldx_can_dispatch_rx(cif, bcm_cb, &evt);
+
+	return ret < 0 ? ret : 0;
 }
 
+static int ldx_can_tv2ms(const struct timeval *tv)
+{
+	/* A NULL timeout blocks indefinitely, as it did with select() */
+	if (!tv)
+		return -1;
+
+	return tv->tv_sec * 1000 + (tv->tv_usec + 999) / 1000;
+}
 
-int ldx_can_poll_one_read_i(const can_if_t* cif, fd_set* fds, ldx_can_event_t* evt)
+/*
+ * Check that an epoll event still refers to a registered handler. Handlers
+ * can be released by a callback while the events of the same wait are being
+ * processed, which is detected through 'cb_gen'.
+ */
+static bool ldx_can_cb_is_valid(can_priv_t *pdata, can_cb_t *cb,
+				unsigned int gen)
 {
-	int ret;
-	can_cb_t* rx_cb;
-	can_priv_t* pdata = cif->_data;
+	can_cb_t *rx_cb;
+
+	if (gen == pdata->cb_gen || cb == &pdata->tx_cb ||
+	    cb == &pdata->wake_cb || cb == &pdata->link_cb ||
+	    cb == &pdata->txq_cb)
+		return true;
 
-	/*
-	* Check the socket for each registered rx handler and
-	* trigger the callback accordingly
-	*/
 	list_for_each_entry(rx_cb, &pdata->rx_cb_list_head, list) {
-		if (FD_ISSET(rx_cb->rx_skt, fds)) {
-			ret = ldx_can_read_rx_socket_i(cif, rx_cb->rx_skt, evt);
-			if (ret < 0) {
-				log_error("%s|%s: select error (%d|%d)",
-					cif->name, __func__, ret, errno);
-			}
-			return ret;
-		}
+		if (rx_cb == cb)
+			return true;
 	}
 
-	/* Check also the tx socket to detect errors */
-	if (FD_ISSET(pdata->tx_skt, fds)) {
-		ret = ldx_can_read_tx_socket_i(cif, evt);
-		if (ret < 0) {
-			log_error("%s|%s: select error (%d|%d)",
-				cif->name, __func__, ret, errno);
-		}
-		return ret;
-	}
-	return 0;
+	return false;
+}
+
+/* Consume a wakeup request so the eventfd stops being readable */
+static void ldx_can_clear_wakeup(can_priv_t *pdata)
+{
+	uint64_t cnt;
+
+	if (read(pdata->wake_fd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+		log_debug("%s: eventfd read error (%d)", __func__, errno);
+}
+
+int ldx_can_wakeup(const can_if_t *cif)
+{
+	can_priv_t *pdata;
+	uint64_t one = 1;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	pdata = cif->_data;
+	if (write(pdata->wake_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+		return -CAN_ERROR_EVENTFD;
+
+	return EXIT_SUCCESS;
 }
 
 int ldx_can_poll_one(const can_if_t* cif, struct timeval* timeout, ldx_can_event_t* evt)
 {
 	can_priv_t *pdata = cif->_data;
+	struct epoll_event ev;
+	unsigned int gen;
+	can_cb_t *cb;
 	int ret;
-	fd_set fds;
-
-	ldx_can_lock_mutex(cif, __func__);
-	ldx_can_io_set_evt_ptr(cif, evt);
-
-	memcpy(&fds, &pdata->can_fds, sizeof(fds));
 
-	ret = select(pdata->maxfd + 1, &fds, NULL, NULL, timeout);
+	/* The mutex is not held while waiting, so handlers can be changed */
+	gen = __atomic_load_n(&pdata->cb_gen, __ATOMIC_ACQUIRE);
+	ret = epoll_wait(pdata->epfd, &ev, 1, ldx_can_tv2ms(timeout));
 	if (ret < 0 && errno != EINTR) {
-		log_error("%s|%s: select error (%d|%d)",
+		log_error("%s|%s: epoll_wait error (%d|%d)",
 					cif->name, __func__, ret, errno);
-		ldx_can_unlock_mutex(cif);
 		return errno;
 	} else if (ret > 0) {
-		int r = ldx_can_poll_one_read_i(cif, &fds, evt);
-		if (r < 1) {
-			ret = r;
+		int r = 0;
+
+		ret = ldx_can_lock_mutex(cif, __func__);
+		if (ret)
+			return ret;
+
+		cb = ev.data.ptr;
+		if (cb == &pdata->wake_cb)
+			ldx_can_clear_wakeup(pdata);
+		else if (cb == &pdata->txq_cb)
+			ldx_can_txq_drain(cif, true);
+		else if (cb == &pdata->tx_cb &&
+			 !(ev.events & (EPOLLIN | EPOLLERR)))
+			/* Only writable, queued frames were blocked */
+			ldx_can_txq_drain(cif, false);
+		else if (cb == &pdata->tx_cb)
+			/* Check also the tx socket to detect errors */
+			r = ldx_can_read_tx_socket_i(cif, evt);
+		else if (cb == &pdata->link_cb)
+			r = ldx_can_process_link_socket(cif);
+		else if (!ldx_can_cb_is_valid(pdata, cb, gen))
+			r = 0;
+		else if (cb->bcm)
+			r = ldx_can_read_bcm_socket_i(cif, cb, evt);
+		else if (cb->ring)
+			/* Frames go to the ring, nothing is returned here */
+			r = ldx_can_process_rx_socket(cif, cb);
+		else
+			r = ldx_can_read_rx_socket_i(cif, cb->rx_skt, evt);
+		if (r < 0) {
+			log_error("%s|%s: read error (%d|%d)",
+				cif->name, __func__, r, errno);
 		}
+		ret = r > 0 ? 1 : r;
+
+		ldx_can_unlock_mutex(cif);
 	}
-	ldx_can_io_clear_evt_ptr(cif);
 
-	ldx_can_unlock_mutex(cif);
 	return ret;
 }
 
-
-int ldx_can_poll(const can_if_t* cif, struct timeval* tout)
+/*
+ * Read the events of a ready socket into 'evts', up to 'max'. Sockets drained
+ * into a reception ring keep feeding it, as they have their own consumer.
+ * Returns the number of events stored, or a negative error code.
+ */
+static int ldx_can_collect_rx_socket(const can_if_t *cif, can_cb_t *rx_cb,
+				     ldx_can_event_t *evts, unsigned int max)
 {
 	can_priv_t *pdata = cif->_data;
-	int ret;
-	fd_set fds;
+	unsigned int cnt = 0;
+	int n;
+
+	do {
+		n = ldx_can_read_rx_batch_i(cif, rx_cb->rx_skt,
+					    rx_cb->ring ? pdata->rx_batch : max - cnt);
+		if (n <= 0)
+			break;
+		if (rx_cb->ring) {
+			ldx_can_ring_feed(cif, rx_cb, n);
+			continue;
+		}
+		memcpy(&evts[cnt], pdata->rx_evts, n * sizeof(*evts));
+		cnt += n;
+	} while (n == (int)pdata->rx_batch && (rx_cb->ring || cnt < max));
 
-	ldx_can_lock_mutex(cif, __func__);
+	return n < 0 ? n : (int)cnt;
+}
 
-	memcpy(&fds, &pdata->can_fds, sizeof(fds));
+int ldx_can_poll_many(const can_if_t *cif, struct timeval *timeout,
+		      ldx_can_event_t *evts, unsigned int max)
+{
+	can_priv_t *pdata;
+	struct epoll_event evs[CAN_MAX_EPOLL_EVENTS];
+	unsigned int gen, cnt = 0;
+	int i, ret, nevts;
 
-	ret = select(pdata->maxfd + 1, &fds, NULL, NULL, tout);
-	if (ret < 0 && errno != EINTR) {
-		log_error("%s|%s: select error (%d|%d)",
-					cif->name, __func__, ret, errno);
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+	if (!evts || !max)
+		return 0;
+
+	pdata = cif->_data;
+
+	/* The mutex is not held while waiting, so handlers can be changed */
+	gen = __atomic_load_n(&pdata->cb_gen, __ATOMIC_ACQUIRE);
+	nevts = epoll_wait(pdata->epfd, evs, CAN_MAX_EPOLL_EVENTS,
+			   ldx_can_tv2ms(timeout));
+	if (nevts < 0) {
+		if (errno == EINTR)
+			return 0;
+		log_error("%s|%s: epoll_wait error (%d|%d)",
+					cif->name, __func__, nevts, errno);
+		return -errno;
+	}
+	if (nevts == 0)
+		return 0;
+
+	ret = ldx_can_lock_mutex(cif, __func__);
+	if (ret)
+		return ret;
+
+	/*
+	 * Sockets left with pending data once 'evts' is full are reported
+	 * again by the next wait, as epoll is level triggered.
+	 */
+	for (i = 0; i < nevts; i++) {
+		can_cb_t *cb = evs[i].data.ptr;
+
+		ret = 0;
+		if (cb == &pdata->wake_cb) {
+			ldx_can_clear_wakeup(pdata);
+			continue;
+		}
+
+		if (!ldx_can_cb_is_valid(pdata, cb, gen))
+			continue;
+
+		if (cb == &pdata->txq_cb) {
+			ldx_can_txq_drain(cif, true);
+			continue;
+		}
+
+		/* EPOLLOUT is only enabled while queued frames are blocked */
+		if (cb == &pdata->tx_cb && (evs[i].events & EPOLLOUT))
+			ldx_can_txq_drain(cif, false);
+
+		if (cb == &pdata->link_cb) {
+			ret = ldx_can_process_link_socket(cif);
+		} else if (cnt == max) {
+			continue;
+		} else if (cb == &pdata->tx_cb) {
+			if (!(evs[i].events & (EPOLLIN | EPOLLERR)))
+				continue;
+			/* Check also the tx socket to detect errors */
+			do {
+				memset(&evts[cnt], 0, sizeof(*evts));
+				ret = ldx_can_read_tx_socket_i(cif, &evts[cnt]);
+			} while (ret > 0 && ++cnt < max);
+		} else if (cb->bcm) {
+			/* Broadcast manager sockets report one change per wakeup */
+			memset(&evts[cnt], 0, sizeof(*evts));
+			ret = ldx_can_read_bcm_socket_i(cif, cb, &evts[cnt]);
+			if (ret > 0)
+				cnt++;
+		} else {
+			ret = ldx_can_collect_rx_socket(cif, cb, &evts[cnt],
+							max - cnt);
+			if (ret > 0)
+				cnt += ret;
+		}
+		if (ret < 0)
+			log_error("%s|%s: read error (%d|%d)",
+						cif->name, __func__, ret, errno);
+	}
+
+	ldx_can_unlock_mutex(cif);
+
+	return cnt;
+}
+
+int ldx_can_process_events(const can_if_t *cif, int tout_ms)
+{
+	can_priv_t *pdata = cif->_data;
+	struct epoll_event evs[CAN_MAX_EPOLL_EVENTS];
+	unsigned int gen;
+	int i, ret, nevts;
+
+	gen = __atomic_load_n(&pdata->cb_gen, __ATOMIC_ACQUIRE);
+	nevts = epoll_wait(pdata->epfd, evs, CAN_MAX_EPOLL_EVENTS, tout_ms);
+	if (nevts < 0) {
+		if (errno == EINTR)
+			return 0;
+		log_error("%s|%s: epoll_wait error (%d|%d)",
+					cif->name, __func__, nevts, errno);
 		ldx_can_call_err_cb(cif, errno, NULL);
-	} else if (ret > 0) {
-		can_cb_t *rx_cb;
+		return nevts;
+	}
+	if (nevts == 0)
+		return 0;
 
-		/*
-		* Check the socket for each registered rx handler and
-		* trigger the callback accordingly
-		*/
-		list_for_each_entry(rx_cb, &pdata->rx_cb_list_head, list) {
-			if (FD_ISSET(rx_cb->rx_skt, &fds)) {
-				ret = ldx_can_process_rx_socket((can_if_t*)cif, rx_cb);
-				if (ret < 0) {
-					log_error("%s|%s: select error (%d|%d)",
-								cif->name, __func__, ret, errno);
-				}
-			}
+	ret = ldx_can_lock_mutex(cif, __func__);
+	if (ret)
+		return ret;
+
+	/* Only the sockets that are ready are visited */
+	for (i = 0; i < nevts; i++) {
+		can_cb_t *cb = evs[i].data.ptr;
+
+		if (cb == &pdata->wake_cb) {
+			ldx_can_clear_wakeup(pdata);
+			continue;
 		}
 
-		/* Check also the tx socket to detect errors */
-		if (FD_ISSET(pdata->tx_skt, &fds)) {
-			ret = ldx_can_process_tx_socket(cif);
-			if (ret < 0)
-				log_error("%s|%s: select error (%d|%d)",
-							cif->name, __func__, ret, errno);
+		if (!ldx_can_cb_is_valid(pdata, cb, gen))
+			continue;
+
+		if (cb == &pdata->txq_cb) {
+			ldx_can_txq_drain(cif, true);
+			continue;
 		}
 
-		// Should there be an indication that data was processed?
-		// It may be nicer to have a poll_one function and avoid the
-		// callbacks as really they can be factored out in the polled 
-		// case (and actually are quite inconvenient).
-		ret = 0;
+		if (cb == &pdata->tx_cb) {
+			/* EPOLLOUT is only enabled while queued frames are blocked */
+			if (evs[i].events & EPOLLOUT)
+				ldx_can_txq_drain(cif, false);
+			if (!(evs[i].events & (EPOLLIN | EPOLLERR)))
+				continue;
+			/* Check also the tx socket to detect errors */
+			ret = ldx_can_process_tx_socket(cif);
+		} else if (cb == &pdata->link_cb) {
+			ret = ldx_can_process_link_socket(cif);
+		} else if (cb->bcm) {
+			ret = ldx_can_process_bcm_socket(cif, cb);
+		} else {
+			ret = ldx_can_process_rx_socket(cif, cb);
+		}
+		if (ret < 0)
+			log_error("%s|%s: read error (%d|%d)",
+						cif->name, __func__, ret, errno);
 	}
 
 	ldx_can_unlock_mutex(cif);
-	return ret;
+
+	return nevts;
+}
+
+int ldx_can_poll(const can_if_t* cif, struct timeval* tout)
+{
+	int ret = ldx_can_process_events(cif, ldx_can_tv2ms(tout));
+
+	// Should there be an indication that data was processed?
+	// ldx_can_poll_one() and ldx_can_poll_many() avoid the callbacks,
+	// which are quite inconvenient in the polled case.
+	return ret > 0 ? 0 : ret;
 }
 
 int ldx_can_poll_msec(const can_if_t* cif, int milliseconds)
@@ -476,17 +1015,78 @@ int ldx_can_poll_msec(const can_if_t* cif, int milliseconds)
 	return ldx_can_poll(cif, &tout);
 }
 
+static int64_t ldx_can_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Busy-poll for up to 'rx_spin_us' after the last activity, trading CPU for
+ * latency, before going back to a blocking wait.
+ */
+static void ldx_can_thr_spin(const can_if_t *cif)
+{
+	can_priv_t *pdata = cif->_data;
+	int64_t deadline = ldx_can_now_us() + cif->cfg.rx_spin_us;
+
+	while (__atomic_load_n(&pdata->run_thr, __ATOMIC_ACQUIRE)) {
+		int64_t now = ldx_can_now_us();
+
+		if (ldx_can_process_events(cif, 0) > 0)
+			deadline = now + cif->cfg.rx_spin_us;
+		else if (now >= deadline)
+			break;
+	}
+}
+
 static void *ldx_can_thr(void *arg)
 {
 	can_if_t *cif = (can_if_t *)arg;
 	can_priv_t *pdata = cif->_data;
-	while (pdata->run_thr) {
-		(void) ldx_can_poll(cif, &pdata->can_tout);
-		sched_yield();
+
+	/*
+	 * Block until a socket is ready or the thread is woken up through the
+	 * eventfd, so that the CPU usage follows the bus load. A zero poll rate
+	 * (the default) means waiting without timeout.
+	 */
+	while (__atomic_load_n(&pdata->run_thr, __ATOMIC_ACQUIRE)) {
+		int tout = ldx_can_tv2ms(&pdata->can_tout);
+
+		if (ldx_can_process_events(cif, tout ? tout : -1) > 0 &&
+		    cif->cfg.rx_spin_us)
+			ldx_can_thr_spin(cif);
 	}
 	return NULL;
 }
 
+/*
+ * Latency related socket options are best effort: not every kernel supports
+ * them, and not having them must not prevent the interface from working.
+ */
+static void ldx_can_set_skt_latency_opts(const can_if_t *cif, int skt, bool rx)
+{
+	if (cif->cfg.skt_priority >= 0 &&
+	    setsockopt(skt, SOL_SOCKET, SO_PRIORITY, &cif->cfg.skt_priority,
+		       sizeof(cif->cfg.skt_priority)))
+		log_warning("%s|%s: setsockopt SO_PRIORITY error (%d)",
+			    cif->name, __func__, errno);
+
+#ifdef SO_BUSY_POLL
+	if (rx && cif->cfg.busy_poll_us > 0 &&
+	    setsockopt(skt, SOL_SOCKET, SO_BUSY_POLL, &cif->cfg.busy_poll_us,
+		       sizeof(cif->cfg.busy_poll_us)))
+		log_warning("%s|%s: setsockopt SO_BUSY_POLL error (%d)",
+			    cif->name, __func__, errno);
+#else
+	if (rx && cif->cfg.busy_poll_us > 0)
+		log_warning("%s|%s: SO_BUSY_POLL not supported",
+			    cif->name, __func__);
+#endif
+}
+
 int ldx_can_init(can_if_t *cif, can_if_cfg_t *cfg)
 {
 	int ret = 0;
@@ -495,56 +1095,27 @@ int ldx_can_init(can_if_t *cif, can_if_cfg_t *cfg)
 	if (!cif)
 		return -CAN_ERROR_NULL_INTERFACE;
 
-	pdata = cif->_data;
-	cif->cfg = *cfg;
-
-	/* Set bitrate if required */
-	if (cfg->bitrate != LDX_CAN_INVALID_BITRATE) {
-		ret = ldx_can_set_bitrate(cif, cfg->bitrate);
-		if (ret)
-			return ret;
-
-		cif->cfg.bitrate = cfg->bitrate;
-	}
-
-	/* Set data bitrate if required */
-	if (cfg->dbitrate != LDX_CAN_INVALID_BITRATE) {
-		ret = ldx_can_set_data_bitrate(cif, cfg->dbitrate);
-		if (ret)
-			return ret;
-
-		cif->cfg.bitrate = cfg->bitrate;
-	}
-
-	/* Set restart ms if required */
-	if (cfg->restart_ms != LDX_CAN_INVALID_RESTART_MS) {
-		ret = ldx_can_set_restart_ms(cif, cfg->restart_ms);
-		if (ret)
-			return ret;
-
-		cif->cfg.restart_ms = cfg->restart_ms;
-	}
-
-	/* Configure the bit_timing setting */
-	if (cfg->bit_timing.bitrate) {
-		ret = ldx_can_set_restart_ms(cif, cfg->restart_ms);
-		if (ret)
-			return ret;
+	pdata = cif->_data;
+	cif->cfg = *cfg;
 
-		cif->cfg.restart_ms = cfg->restart_ms;
+	ret = ldx_can_init_iodata(pdata, cfg->rx_batch_size);
+	if (ret) {
+		log_error("%s: Unable to allocate reception ring on %s",
+			  __func__, cif->name);
+		return ret;
 	}
 
-	/* Configure the control mode setting */
-	if (cfg->ctrl_mode.mask != LDX_CAN_UNCONFIGURED_MASK) {
-		ret = ldx_can_set_ctrlmode(cif, &cfg->ctrl_mode);
-		if (ret)
-			return ret;
-
-		cif->cfg.ctrl_mode = cfg->ctrl_mode;
+	if (cfg->perf_stats && !pdata->perf) {
+		pdata->perf = calloc(1, sizeof(*pdata->perf));
+		if (!pdata->perf) {
+			log_error("%s: Unable to allocate statistics on %s",
+				  __func__, cif->name);
+			return -CAN_ERROR_NO_MEM;
+		}
 	}
 
-	/* Once configured, start the interface */
-	ret = ldx_can_start(cif);
+	/* Configure and start the interface in a single netlink transaction */
+	ret = ldx_can_link_config(&cif, cfg, 1, true);
 	if (ret)
 		return ret;
 
@@ -648,6 +1219,8 @@ int ldx_can_init(can_if_t *cif, can_if_cfg_t *cfg)
 		}
 	}
 
+	ldx_can_set_skt_latency_opts(cif, pdata->tx_skt, false);
+
 	if (cif->cfg.error_mask) {
 		ret = setsockopt(pdata->tx_skt, SOL_CAN_RAW, CAN_RAW_ERR_FILTER,
 				 &cif->cfg.error_mask,
@@ -667,17 +1240,48 @@ int ldx_can_init(can_if_t *cif, can_if_cfg_t *cfg)
 		goto err_skt_close;
 	}
 
-	/* Add the tx socket to the fd_set structure to detect errors */
-	FD_ZERO(&pdata->can_fds);
-	FD_SET(pdata->tx_skt, &pdata->can_fds);
-	pdata->maxfd = pdata->tx_skt;
+	/* Add the tx socket to the epoll set to detect errors */
+	pdata->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (pdata->epfd < 0) {
+		log_error("%s: Unable to create epoll instance on %s",
+			  __func__, cif->name);
+		ret = -CAN_ERROR_EPOLL_CREATE;
+		goto err_skt_close;
+	}
+
+	pdata->tx_cb.rx_skt = pdata->tx_skt;
+	pdata->tx_cb.handler = NULL;
+	ret = ldx_can_epoll_add(cif, &pdata->tx_cb);
+	if (ret)
+		goto err_epfd_close;
+
+	/* The eventfd allows to wake up (and stop) a blocked poll */
+	pdata->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (pdata->wake_fd < 0) {
+		log_error("%s: Unable to create eventfd on %s",
+			  __func__, cif->name);
+		ret = -CAN_ERROR_EVENTFD;
+		goto err_epfd_close;
+	}
+
+	pdata->wake_cb.rx_skt = pdata->wake_fd;
+	pdata->wake_cb.handler = NULL;
+	ret = ldx_can_epoll_add(cif, &pdata->wake_cb);
+	if (ret)
+		goto err_wakefd_close;
+
+	if (cfg->tx_queue_len && !pdata->txq) {
+		ret = ldx_can_txq_init(cif, cfg->tx_queue_len);
+		if (ret)
+			goto err_wakefd_close;
+	}
 
 	ret = ldx_can_register_error_handler(cif, ldx_can_default_error_handler);
 	if (ret < 0) {
 		log_error("%s|%s: Unable to register default error handler",
 			  cif->name, __func__);
 		ret = -CAN_ERROR_REG_ERR_HDLR;
-		goto err_skt_close;
+		goto err_wakefd_close;
 	}
 
 	pdata->has_mutex = false;
@@ -689,26 +1293,38 @@ int ldx_can_init(can_if_t *cif, can_if_cfg_t *cfg)
 				log_error("%s: Unable to alloc thread memory in %s",
 					__func__, cif->name);
 				ret = -CAN_ERROR_THREAD_ALLOC;
-				goto err_skt_close;
+				goto err_wakefd_close;
 			}
 
-			pthread_attr_init(&pdata->can_thr_attr);
-			pthread_attr_setschedpolicy(&pdata->can_thr_attr, SCHED_FIFO);
+			ret = thread_attr_init(&pdata->can_thr_attr,
+					       cif->cfg.thread_priority,
+					       cif->cfg.thread_cpu_mask);
+			if (ret) {
+				log_error("%s: Unable to set thread attributes in %s (%d)",
+					__func__, cif->name, ret);
+				ret = -CAN_ERROR_THREAD_CREATE;
+				goto err_thr_alloc;
+			}
 
 			ret = pthread_mutex_init(&pdata->mutex, NULL);
 			if (ret) {
 				log_error("%s: Unable init thread mutex %s",
 					__func__, cif->name);
+				pthread_attr_destroy(&pdata->can_thr_attr);
 				ret = -CAN_ERROR_THREAD_MUTEX_INIT;
 				goto err_thr_alloc;
 			}
 			pdata->has_mutex = true;
-			ret = pthread_create(pdata->can_thr, NULL, ldx_can_thr, cif);
+			ret = pthread_create(pdata->can_thr, &pdata->can_thr_attr,
+					     ldx_can_thr, cif);
+			pthread_attr_destroy(&pdata->can_thr_attr);
 			if (ret) {
-				log_error("%s: Unable to create thread in %s",
-					__func__, cif->name);
+				/* EPERM: no privileges for the requested policy */
+				log_error("%s: Unable to create thread in %s (%d)",
+					__func__, cif->name, ret);
 				pthread_mutex_unlock(&pdata->mutex);
 				pthread_mutex_destroy(&pdata->mutex);
+				pdata->has_mutex = false;
 				ret = -CAN_ERROR_THREAD_CREATE;
 				goto err_thr_alloc;
 			}
@@ -719,6 +1335,16 @@ int ldx_can_init(can_if_t *cif, can_if_cfg_t *cfg)
 
 err_thr_alloc:
 	free(pdata->can_thr);
+	pdata->can_thr = NULL;
+
+err_wakefd_close:
+	ldx_can_txq_free(pdata);
+	close(pdata->wake_fd);
+	pdata->wake_fd = -1;
+
+err_epfd_close:
+	close(pdata->epfd);
+	pdata->epfd = -1;
 
 err_skt_close:
 	close(pdata->tx_skt);
@@ -735,6 +1361,40 @@ int ldx_can_get_tx_skt(const can_if_t* cif)
 	return -CAN_ERROR_NULL_INTERFACE;
 }
 
+int ldx_can_get_fd(const can_if_t *cif)
+{
+	can_priv_t *pdata;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	pdata = cif->_data;
+
+	return pdata->epfd;
+}
+
+int ldx_can_drain(const can_if_t *cif)
+{
+	unsigned int i;
+	int ret;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	/*
+	 * With an edge triggered registration of the interface fd, no new
+	 * notification comes until everything pending is consumed. The rounds
+	 * are bounded so a flooded bus does not starve the caller's loop.
+	 */
+	for (i = 0; i < LDX_CAN_DRAIN_ROUNDS; i++) {
+		ret = ldx_can_process_events(cif, 0);
+		if (ret <= 0)
+			return ret;
+	}
+
+	return 1;
+}
+
 can_if_t *ldx_can_request_by_name(const char * const if_name)
 {
 	can_if_t *cif;
@@ -762,7 +1422,12 @@ can_if_t *ldx_can_request_by_name(const char * const if_name)
 	priv->can_tout.tv_sec = LDX_CAN_DEF_TOUT_SEC;
 	priv->can_tout.tv_usec = LDX_CAN_DEF_TOUT_USEC;
 	priv->run_thr = true;
-	ldx_can_init_iodata(priv);
+	priv->epfd = -1;
+	priv->wake_fd = -1;
+	priv->bcm_skt = -1;
+	priv->link_cb.rx_skt = -1;
+	priv->nl_skt = -1;
+	pthread_mutex_init(&priv->nl_mutex, NULL);
 
 	cif->_data = priv;
 
@@ -798,22 +1463,48 @@ int ldx_can_free(can_if_t *cif)
 
 	pdata = cif->_data;
 
+	if (pdata->reactor) {
+		ret = ldx_can_reactor_detach(pdata->reactor, cif);
+		if (ret)
+			return ret;
+	}
+
+	/* Ask the thread to leave its wait and let it finish cleanly */
+	if (pdata->can_thr) {
+		__atomic_store_n(&pdata->run_thr, false, __ATOMIC_RELEASE);
+		ldx_can_wakeup(cif);
+		pthread_join(*pdata->can_thr, NULL);
+		free(pdata->can_thr);
+		pdata->can_thr = NULL;
+	}
+
 	if (pdata->has_mutex) {
-		pthread_mutex_lock(&pdata->mutex);
 		pthread_mutex_destroy(&pdata->mutex);
 		pdata->has_mutex = 0;
 	}
 
-	if (pdata->can_thr) {
-		pthread_cancel(*pdata->can_thr);
-		pdata->can_thr = 0;
-	}
+	ldx_can_id_table_free(pdata->id_table);
+	pdata->id_table = NULL;
 
 	ret = ldx_can_stop(cif);
 	if (ret)
 		log_error("%s: can not stop iface %s", __func__, cif->name);
 
 	close(pdata->tx_skt);
+	if (pdata->bcm_skt >= 0)
+		close(pdata->bcm_skt);
+	if (pdata->link_cb.rx_skt >= 0)
+		close(pdata->link_cb.rx_skt);
+	if (pdata->nl_skt >= 0)
+		close(pdata->nl_skt);
+	pthread_mutex_destroy(&pdata->nl_mutex);
+	ldx_can_txq_free(pdata);
+	if (pdata->wake_fd >= 0)
+		close(pdata->wake_fd);
+	if (pdata->epfd >= 0)
+		close(pdata->epfd);
+	ldx_can_free_iodata(pdata);
+	free(pdata->perf);
 	free(pdata);
 	free(cif);
 
@@ -838,15 +1529,25 @@ int ldx_can_tx_frame(const can_if_t *cif, struct canfd_frame *frame)
 	}
 
 	ret = write(pdata->tx_skt, frame, mtu);
+	if (pdata->perf) {
+		ldx_can_perf_add(&pdata->perf->tx_syscalls, 1);
+		if (ret == mtu) {
+			ldx_can_perf_add(&pdata->perf->tx_frames, 1);
+			ldx_can_perf_add(&pdata->perf->tx_bytes, mtu);
+		}
+	}
 	if (ret == -1) {
-		if (errno == ENOBUFS || errno == EAGAIN)
+		if (errno == ENOBUFS || errno == EAGAIN) {
 			/*
 			 * Nothing to log... the txqueue is full and there are
 			 * no additional buffers. Tell user space to retry, as
 			 * setting the socket as blocking does not seem to have
 			 * any effect.
 			 */
+			if (pdata->perf)
+				ldx_can_perf_add(&pdata->perf->tx_retry_later, 1);
 			return -CAN_ERROR_TX_RETRY_LATER;
+		}
 	} else if (ret < 0) {
 		log_error("%s: socket write (%d/%d) on %s", __func__, ret, errno, cif->name);
 		return -CAN_ERROR_TX_SKT_WR;
@@ -857,6 +1558,167 @@ int ldx_can_tx_frame(const can_if_t *cif, struct canfd_frame *frame)
 	return EXIT_SUCCESS;
 }
 
+static int64_t ldx_can_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Wait until the tx socket is writable or the deadline expires. Returns true
+ * if the transmission should be retried.
+ */
+static bool ldx_can_tx_wait(const can_if_t *cif, int64_t deadline)
+{
+	can_priv_t *pdata = cif->_data;
+	struct pollfd pfd = { .fd = pdata->tx_skt, .events = POLLOUT };
+	int tout = -1;
+	int ret;
+
+	if (cif->cfg.tx_wait_ms == 0)
+		return false;
+
+	if (cif->cfg.tx_wait_ms > 0) {
+		int64_t left = deadline - ldx_can_now_ms();
+
+		if (left <= 0)
+			return false;
+		tout = (int)left;
+	}
+
+	ret = poll(&pfd, 1, tout);
+	if (ret < 0)
+		return errno == EINTR;
+	if (ret == 0)
+		return false;
+
+	/*
+	 * ENOBUFS usually comes from the device queue rather than the socket
+	 * buffer, so POLLOUT may already be asserted. Back off for roughly a
+	 * frame time instead of spinning on sendmmsg().
+	 */
+	usleep(LDX_CAN_TX_BACKOFF_US);
+
+	return true;
+}
+
+int ldx_can_tx_batch_i(const can_if_t *cif, struct canfd_frame *frames,
+		       unsigned int nframes, int mtu, unsigned int *sent,
+		       bool *skt_full)
+{
+	struct mmsghdr mmsg[LDX_CAN_TX_BATCH_MAX];
+	struct iovec iov[LDX_CAN_TX_BATCH_MAX];
+	can_priv_t *pdata = cif->_data;
+	unsigned int i;
+	int nsent;
+
+	*sent = 0;
+	if (skt_full)
+		*skt_full = false;
+
+	if (!mtu)
+		mtu = cif->cfg.canfd_enabled ? CANFD_MTU : CAN_MTU;
+
+	if (nframes > LDX_CAN_TX_BATCH_MAX)
+		nframes = LDX_CAN_TX_BATCH_MAX;
+
+	memset(mmsg, 0, nframes * sizeof(mmsg[0]));
+	for (i = 0; i < nframes; i++) {
+		struct canfd_frame *frame = &frames[i];
+
+		/* Set proper length for fd frames */
+		if (mtu == CANFD_MTU)
+			frame->len = can_dlc2len(CAN_LEN2DLC(frame->len));
+
+		iov[i].iov_base = frame;
+		iov[i].iov_len = mtu;
+		mmsg[i].msg_hdr.msg_iov = &iov[i];
+		mmsg[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	do {
+		nsent = sendmmsg(pdata->tx_skt, mmsg, nframes, MSG_DONTWAIT);
+	} while (nsent < 0 && errno == EINTR);
+	if (pdata->perf) {
+		ldx_can_perf_add(&pdata->perf->tx_syscalls, 1);
+		if (nsent > 0) {
+			ldx_can_perf_add(&pdata->perf->tx_frames, nsent);
+			ldx_can_perf_add(&pdata->perf->tx_bytes,
+					 (uint64_t)nsent * mtu);
+		}
+	}
+	if (nsent < 0) {
+		if (errno == EAGAIN && skt_full)
+			*skt_full = true;
+		if (errno == ENOBUFS || errno == EAGAIN)
+			return -CAN_ERROR_TX_RETRY_LATER;
+
+		log_error("%s: socket write (%d/%d) on %s", __func__,
+			  nsent, errno, cif->name);
+		return -CAN_ERROR_TX_SKT_WR;
+	}
+
+	for (i = 0; i < (unsigned int)nsent; i++) {
+		if (mmsg[i].msg_len < (unsigned int)mtu) {
+			*sent = i;
+			return -CAN_ERROR_INCOMP_FRAME;
+		}
+	}
+	*sent = nsent;
+
+	return EXIT_SUCCESS;
+}
+
+int ldx_can_tx_frames_i(const can_if_t *cif, struct canfd_frame *frames,
+			unsigned int nframes, int mtu, unsigned int *sent)
+{
+	can_priv_t *pdata = NULL;
+	unsigned int done = 0, chunk;
+	int64_t deadline = 0;
+	int ret = EXIT_SUCCESS;
+
+	if (sent)
+		*sent = 0;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	pdata = cif->_data;
+
+	if (cif->cfg.tx_wait_ms > 0)
+		deadline = ldx_can_now_ms() + cif->cfg.tx_wait_ms;
+
+	while (done < nframes) {
+		ret = ldx_can_tx_batch_i(cif, &frames[done], nframes - done,
+					 mtu, &chunk, NULL);
+		done += chunk;
+		if (ret == -CAN_ERROR_TX_RETRY_LATER) {
+			if (ldx_can_tx_wait(cif, deadline)) {
+				ret = EXIT_SUCCESS;
+				continue;
+			}
+			if (pdata->perf)
+				ldx_can_perf_add(&pdata->perf->tx_retry_later, 1);
+			break;
+		}
+		if (ret)
+			break;
+	}
+
+	if (sent)
+		*sent = done;
+
+	return ret;
+}
+
+int ldx_can_tx_frames(const can_if_t *cif, struct canfd_frame *frames,
+		      unsigned int nframes, unsigned int *sent)
+{
+	return ldx_can_tx_frames_i(cif, frames, nframes, 0, sent);
+}
+
 static can_err_cb_t *find_errcb_by_function(const can_if_t *cif,
 					    const ldx_can_error_cb_t cb)
 {
@@ -951,7 +1813,7 @@ static can_cb_t *find_rxcb_by_function(const can_if_t *cif, const ldx_can_rx_cb_
 
 	pdata = cif->_data;
 	list_for_each_entry(rx_cb, &pdata->rx_cb_list_head, list) {
-		if (rx_cb->handler == cb) {
+		if (rx_cb->handler && rx_cb->handler == cb) {
 			return rx_cb;
 		}
 	}
@@ -973,21 +1835,31 @@ static can_cb_t* find_rxcb_by_fd(const can_if_t* cif, int fd)
 	return NULL;
 }
 
-static int ldx_can_register_rx_handler_impl(can_if_t* cif, const ldx_can_rx_cb_t cb,
-	struct can_filter* filters, int nfilters)
+int ldx_can_epoll_add(const can_if_t *cif, can_cb_t *cb)
 {
-	int ret;
-	can_cb_t* rxcb;
-	can_priv_t* pdata = cif->_data;
+	can_priv_t *pdata = cif->_data;
+	struct epoll_event ev;
 
-	/* Ensure the callback is not registered more than once */
-	rxcb = find_rxcb_by_function(cif, cb);
-	if (rxcb) {
-		log_error("%s: callback already registered on %s", __func__, cif->name);
-		return -CAN_ERROR_RX_CB_ALR_REG;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = cb;
+	if (epoll_ctl(pdata->epfd, EPOLL_CTL_ADD, cb->rx_skt, &ev)) {
+		log_error("%s|%s: epoll_ctl add error (%d)",
+			  cif->name, __func__, errno);
+		return -CAN_ERROR_EPOLL_CTL;
 	}
 
-	rxcb = (can_cb_t*)malloc(sizeof(can_cb_t));
+	return CAN_ERROR_NONE;
+}
+
+int ldx_can_add_rx_cb(can_if_t *cif, struct can_filter *filters,
+			     int nfilters, can_cb_t **cb)
+{
+	int ret;
+	can_cb_t *rxcb;
+	can_priv_t *pdata = cif->_data;
+
+	rxcb = (can_cb_t *)calloc(1, sizeof(can_cb_t));
 	if (!rxcb) {
 		log_error("%s: Unable to alloc memory for rx callback on %s",
 			__func__, cif->name);
@@ -1001,10 +1873,38 @@ static int ldx_can_register_rx_handler_impl(can_if_t* cif, const ldx_can_rx_cb_t
 	}
 
 	rxcb->rx_skt = ret;
-	ret = 0;
 
-	rxcb->handler = cb;
+	ret = ldx_can_epoll_add(cif, rxcb);
+	if (ret) {
+		close(rxcb->rx_skt);
+		free(rxcb);
+		return ret;
+	}
+
 	list_add(&(rxcb->list), &(pdata->rx_cb_list_head));
+	*cb = rxcb;
+
+	return CAN_ERROR_NONE;
+}
+
+static int ldx_can_register_rx_handler_impl(can_if_t* cif, const ldx_can_rx_cb_t cb,
+	struct can_filter* filters, int nfilters)
+{
+	int ret;
+	can_cb_t* rxcb;
+
+	/* Ensure the callback is not registered more than once */
+	rxcb = find_rxcb_by_function(cif, cb);
+	if (rxcb) {
+		log_error("%s: callback already registered on %s", __func__, cif->name);
+		return -CAN_ERROR_RX_CB_ALR_REG;
+	}
+
+	ret = ldx_can_add_rx_cb(cif, filters, nfilters, &rxcb);
+	if (ret)
+		return ret;
+
+	rxcb->handler = cb;
 
 	return CAN_ERROR_NONE;
 }
@@ -1051,6 +1951,56 @@ int ldx_can_unregister_rx_handler(const can_if_t *cif, const ldx_can_rx_cb_t cb)
 	return ret;
 }
 
+int ldx_can_register_rx_batch_handler(can_if_t *cif,
+				      const ldx_can_rx_batch_cb_t cb, void *ctx,
+				      struct can_filter *filters, int nfilters)
+{
+	can_cb_t *rxcb;
+	int ret;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	ret = ldx_can_lock_mutex(cif, __func__);
+	if (ret)
+		return ret;
+
+	ret = ldx_can_add_rx_cb(cif, filters, nfilters, &rxcb);
+	if (ret == 0) {
+		rxcb->batch_handler = cb;
+		rxcb->ctx = ctx;
+		/* The socket identifies the registration */
+		ret = rxcb->rx_skt;
+	}
+	ldx_can_unlock_mutex(cif);
+
+	return ret;
+}
+
+int ldx_can_unregister_rx_batch_handler(const can_if_t *cif, int handle)
+{
+	can_cb_t *rxcb;
+	int ret;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	ret = ldx_can_lock_mutex(cif, __func__);
+	if (ret)
+		return ret;
+
+	rxcb = find_rxcb_by_fd(cif, handle);
+	if (!rxcb || !rxcb->batch_handler) {
+		log_error("%s: callback not found on %s", __func__, cif->name);
+		ret = -CAN_ERROR_RX_CB_NOT_FOUND;
+	} else {
+		ldx_can_close_rx_socket_impl(cif, handle);
+	}
+	ldx_can_unlock_mutex(cif);
+
+	return ret;
+}
+
 int ldx_can_init_rx_socket(can_if_t* cif,
 	int rx_skt,
 	struct can_filter* filters, int nfilters
@@ -1072,7 +2022,7 @@ int ldx_can_init_rx_socket(can_if_t* cif,
 		 * For details, check:
 		 * Documentation/networking/timestamping.txt
 		 */
-		int option_name, tstamp_flags;
+		int option_name, tstamp_flags, one = 1;
 
 		if (cif->cfg.hw_timestamp) {
 			option_name = SO_TIMESTAMPING;
@@ -1081,18 +2031,28 @@ int ldx_can_init_rx_socket(can_if_t* cif,
 				SOF_TIMESTAMPING_RAW_HARDWARE;
 		}
 		else {
-			option_name = SO_TIMESTAMP;
+			option_name = SO_TIMESTAMPNS;
 			tstamp_flags = 1;
 		}
 
 		ret = setsockopt(rx_skt, SOL_SOCKET, option_name,
 			&tstamp_flags, sizeof(tstamp_flags));
+		if (ret && option_name == SO_TIMESTAMPNS) {
+			/* Fall back to microsecond resolution */
+			option_name = SO_TIMESTAMP;
+			ret = setsockopt(rx_skt, SOL_SOCKET, option_name,
+				&tstamp_flags, sizeof(tstamp_flags));
+		}
 		if (ret) {
 			log_info("%s: setsockopt %s not supported",
 				__func__, cif->cfg.hw_timestamp ?
 				"SO_TIMESTAMPING" : "SO_TIMESTAMP");
 			return -CAN_ERROR_SETSKTOPT_TIMESTAMP;
 		}
+
+		if (setsockopt(rx_skt, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one)))
+			log_info("%s: setsockopt SO_RXQ_OVFL not supported",
+				__func__);
 	}
 
 	if (cif->cfg.canfd_enabled) {
@@ -1137,6 +2097,8 @@ int ldx_can_init_rx_socket(can_if_t* cif,
 		}
 	}
 
+	ldx_can_set_skt_latency_opts(cif, rx_skt, true);
+
 	if (cif->cfg.error_mask) {
 		ret = setsockopt(rx_skt, SOL_CAN_RAW, CAN_RAW_ERR_FILTER,
 			&cif->cfg.error_mask,
@@ -1164,11 +2126,6 @@ int ldx_can_init_rx_socket(can_if_t* cif,
 		return -CAN_ERROR_RX_SKT_BIND;
 	}
 
-	FD_SET(rx_skt, &pdata->can_fds);
-	if (rx_skt > pdata->maxfd) {
-		pdata->maxfd = rx_skt;
-	}
-
 	return ret;
 }
 
@@ -1209,17 +2166,18 @@ int ldx_can_open_rx_socket(can_if_t* cif,
 	return ret;
 }
 
-static void ldx_can_close_rx_socket_impl(const can_if_t* cif, int rx_skt)
+void ldx_can_close_rx_socket_impl(const can_if_t* cif, int rx_skt)
 {
 	can_priv_t* pdata = cif->_data;
 	can_cb_t* rxcb = find_rxcb_by_fd(cif, rx_skt);
-	/* Remove the socket from can_fds and release the resources */
-	FD_CLR(rx_skt, &pdata->can_fds);
-	close(rx_skt);
+	/* Remove the socket from the epoll set and release the resources */
 	if (rxcb) {
+		epoll_ctl(pdata->epfd, EPOLL_CTL_DEL, rx_skt, NULL);
 		list_del(&rxcb->list);
 		free(rxcb);
+		__atomic_add_fetch(&pdata->cb_gen, 1, __ATOMIC_RELEASE);
 	}
+	close(rx_skt);
 }
 int ldx_can_close_rx_socket(const can_if_t* cif, int rx_skt)
 {
@@ -1235,6 +2193,59 @@ int ldx_can_close_rx_socket(const can_if_t* cif, int rx_skt)
 	return ret;
 }
 
+ldx_can_ring_t *ldx_can_open_rx_ring(can_if_t *cif, struct can_filter *filters,
+				     int nfilters, unsigned int size, bool notify)
+{
+	ldx_can_ring_t *ring;
+	can_cb_t *rxcb;
+	int ret;
+
+	if (!cif)
+		return NULL;
+
+	ring = ldx_can_ring_alloc(size, notify);
+	if (!ring) {
+		log_error("%s: Unable to allocate ring on %s", __func__, cif->name);
+		return NULL;
+	}
+
+	ret = ldx_can_lock_mutex(cif, __func__);
+	if (ret) {
+		ldx_can_ring_release(ring);
+		return NULL;
+	}
+
+	ret = ldx_can_add_rx_cb(cif, filters, nfilters, &rxcb);
+	if (ret) {
+		ldx_can_unlock_mutex(cif);
+		ldx_can_ring_release(ring);
+		return NULL;
+	}
+	rxcb->ring = ring;
+	ring->rx_skt = rxcb->rx_skt;
+
+	ldx_can_unlock_mutex(cif);
+
+	return ring;
+}
+
+int ldx_can_close_rx_ring(const can_if_t *cif, ldx_can_ring_t *ring)
+{
+	int ret;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	if (!ring)
+		return EXIT_SUCCESS;
+
+	ret = ldx_can_close_rx_socket(cif, ring->rx_skt);
+	if (ret == 0)
+		ldx_can_ring_release(ring);
+
+	return ret;
+}
+
 int ldx_can_set_thread_poll_rate(const can_if_t* cif, struct timeval* timeout)
 {
 	can_priv_t *pdata = cif->_data;
@@ -0,0 +1,342 @@
+/*
+ * Copyright 2018, Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <errno.h>
+#include <linux/can/bcm.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "can.h"
+#include "_can.h"
+#include "_log.h"
+
+/**
+ * can_bcm_msg_t - Message exchanged with the broadcast manager
+ *
+ * @head:	Operation header.
+ * @frame:	The single frame of the operation, a 'struct can_frame' unless
+ *		CAN_FD_FRAME is set in the header flags.
+ */
+typedef struct {
+	struct bcm_msg_head	head;
+	struct canfd_frame	frame;
+} can_bcm_msg_t;
+
+static int can_bcm_open(const can_if_t *cif)
+{
+	can_priv_t *pdata = cif->_data;
+	int skt;
+
+	skt = socket(PF_CAN, SOCK_DGRAM, CAN_BCM);
+	if (skt < 0) {
+		log_error("%s: Unable to create BCM socket on %s", __func__,
+			  cif->name);
+		return -CAN_ERROR_BCM_SKT;
+	}
+
+	/* Broadcast manager sockets are connected, not bound */
+	if (connect(skt, (struct sockaddr *)&pdata->addr, sizeof(pdata->addr))) {
+		log_error("%s: BCM socket connect error (%d) on %s", __func__,
+			  errno, cif->name);
+		close(skt);
+		return -CAN_ERROR_BCM_SKT;
+	}
+
+	return skt;
+}
+
+static void can_bcm_init_msg(const can_if_t *cif, can_bcm_msg_t *msg,
+			     uint32_t opcode, canid_t can_id)
+{
+	can_priv_t *pdata = cif->_data;
+
+	memset(msg, 0, sizeof(*msg));
+	msg->head.opcode = opcode;
+	msg->head.can_id = can_id;
+	/* Frames have the size of the ones written to the tx socket */
+	if (pdata->mtu == CANFD_MTU)
+		msg->head.flags = CAN_FD_FRAME;
+}
+
+static void can_bcm_set_ival(struct bcm_timeval *ival, uint32_t us)
+{
+	ival->tv_sec = us / 1000000;
+	ival->tv_usec = us % 1000000;
+}
+
+static int can_bcm_write(const can_if_t *cif, int skt, can_bcm_msg_t *msg)
+{
+	size_t len = sizeof(msg->head);
+	ssize_t ret;
+
+	if (msg->head.nframes)
+		len += (msg->head.flags & CAN_FD_FRAME) ? CANFD_MTU : CAN_MTU;
+
+	ret = write(skt, msg, len);
+	if (ret != (ssize_t)len) {
+		log_error("%s: BCM request %u for 0x%x rejected (%d) on %s",
+			  __func__, msg->head.opcode, msg->head.can_id, errno,
+			  cif->name);
+		return -CAN_ERROR_BCM_WR;
+	}
+
+	return CAN_ERROR_NONE;
+}
+
+/* Send a transmission request through the interface BCM socket */
+static int can_bcm_tx_request(const can_if_t *cif, can_bcm_msg_t *msg)
+{
+	can_priv_t *pdata = cif->_data;
+	int ret;
+
+	ret = ldx_can_lock_mutex(cif, __func__);
+	if (ret)
+		return ret;
+
+	/* All the cyclic transmissions share one socket, opened on demand */
+	if (pdata->bcm_skt < 0) {
+		ret = can_bcm_open(cif);
+		if (ret < 0)
+			goto out;
+		pdata->bcm_skt = ret;
+	}
+
+	ret = can_bcm_write(cif, pdata->bcm_skt, msg);
+
+out:
+	ldx_can_unlock_mutex(cif);
+
+	return ret;
+}
+
+int ldx_can_cyclic_tx_start(const can_if_t *cif,
+			    const struct canfd_frame *frame, uint32_t period_us)
+{
+	can_bcm_msg_t msg;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+	if (!frame)
+		return -CAN_ERROR_INCOMP_FRAME;
+
+	can_bcm_init_msg(cif, &msg, TX_SETUP, frame->can_id);
+	msg.head.flags |= SETTIMER | STARTTIMER;
+	can_bcm_set_ival(&msg.head.ival2, period_us);
+	msg.head.nframes = 1;
+	msg.frame = *frame;
+
+	return can_bcm_tx_request(cif, &msg);
+}
+
+int ldx_can_cyclic_tx_update(const can_if_t *cif,
+			     const struct canfd_frame *frame)
+{
+	can_bcm_msg_t msg;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+	if (!frame)
+		return -CAN_ERROR_INCOMP_FRAME;
+
+	/* Without SETTIMER the kernel only replaces the frame content */
+	can_bcm_init_msg(cif, &msg, TX_SETUP, frame->can_id);
+	msg.head.nframes = 1;
+	msg.frame = *frame;
+
+	return can_bcm_tx_request(cif, &msg);
+}
+
+int ldx_can_cyclic_tx_stop(const can_if_t *cif, canid_t can_id)
+{
+	can_bcm_msg_t msg;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	can_bcm_init_msg(cif, &msg, TX_DELETE, can_id);
+
+	return can_bcm_tx_request(cif, &msg);
+}
+
+int ldx_can_register_change_handler(can_if_t *cif, const ldx_can_rx_cb_t cb,
+				    canid_t can_id, const uint8_t *mask,
+				    uint8_t mask_len, uint32_t timeout_us)
+{
+	can_priv_t *pdata;
+	can_bcm_msg_t msg;
+	can_cb_t *bcm_cb;
+	int ret, skt, on = 1;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	pdata = cif->_data;
+
+	can_bcm_init_msg(cif, &msg, RX_SETUP, can_id);
+	msg.head.flags |= RX_CHECK_DLC;
+	if (timeout_us) {
+		msg.head.flags |= SETTIMER | STARTTIMER;
+		can_bcm_set_ival(&msg.head.ival1, timeout_us);
+	}
+	/* The single frame of the operation is the mask of relevant bits */
+	msg.head.nframes = 1;
+	msg.frame.len = pdata->maxdlen;
+	if (mask) {
+		if (mask_len > pdata->maxdlen)
+			mask_len = pdata->maxdlen;
+		memcpy(msg.frame.data, mask, mask_len);
+	} else {
+		memset(msg.frame.data, 0xFF, pdata->maxdlen);
+	}
+
+	bcm_cb = calloc(1, sizeof(can_cb_t));
+	if (!bcm_cb) {
+		log_error("%s: Unable to alloc memory for change handler on %s",
+			  __func__, cif->name);
+		return -CAN_ERROR_NO_MEM;
+	}
+
+	ret = ldx_can_lock_mutex(cif, __func__);
+	if (ret)
+		goto err_free;
+
+	skt = can_bcm_open(cif);
+	if (skt < 0) {
+		ret = skt;
+		goto err_unlock;
+	}
+
+	if (setsockopt(skt, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on)))
+		log_info("%s: Unable to enable BCM timestamps on %s", __func__,
+			 cif->name);
+
+	ret = can_bcm_write(cif, skt, &msg);
+	if (ret)
+		goto err_close;
+
+	bcm_cb->rx_skt = skt;
+	bcm_cb->handler = cb;
+	bcm_cb->bcm = true;
+	ret = ldx_can_epoll_add(cif, bcm_cb);
+	if (ret)
+		goto err_close;
+
+	list_add(&bcm_cb->list, &pdata->rx_cb_list_head);
+	ldx_can_unlock_mutex(cif);
+
+	/* The socket identifies the registration */
+	return skt;
+
+err_close:
+	close(skt);
+err_unlock:
+	ldx_can_unlock_mutex(cif);
+err_free:
+	free(bcm_cb);
+
+	return ret;
+}
+
+int ldx_can_unregister_change_handler(const can_if_t *cif, int handle)
+{
+	can_priv_t *pdata;
+	can_cb_t *bcm_cb;
+	int ret;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	pdata = cif->_data;
+
+	ret = ldx_can_lock_mutex(cif, __func__);
+	if (ret)
+		return ret;
+
+	ret = -CAN_ERROR_RX_CB_NOT_FOUND;
+	list_for_each_entry(bcm_cb, &pdata->rx_cb_list_head, list) {
+		if (bcm_cb->bcm && bcm_cb->rx_skt == handle) {
+			/* Closing the socket removes the kernel operation */
+			ldx_can_close_rx_socket_impl(cif, handle);
+			ret = EXIT_SUCCESS;
+			break;
+		}
+	}
+	if (ret)
+		log_error("%s: change handler not found on %s", __func__,
+			  cif->name);
+
+	ldx_can_unlock_mutex(cif);
+
+	return ret;
+}
+
+int ldx_can_read_bcm_socket_i(const can_if_t *cif, can_cb_t *bcm_cb,
+			      ldx_can_event_t *evt)
+{
+	char ctrl[CMSG_SPACE(sizeof(struct timeval))];
+	can_bcm_msg_t msg;
+	struct iovec iov = { .iov_base = &msg, .iov_len = sizeof(msg) };
+	struct msghdr mh;
+	struct cmsghdr *cmsg;
+	ssize_t n;
+
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = ctrl;
+	mh.msg_controllen = sizeof(ctrl);
+
+	n = recvmsg(bcm_cb->rx_skt, &mh, MSG_DONTWAIT);
+	if (n < 0) {
+		if (errno == ENETDOWN) {
+			log_error("%s: CAN network is down", __func__);
+			return -CAN_ERROR_NETWORK_DOWN;
+		}
+		return 0;
+	}
+	if (n < (ssize_t)sizeof(msg.head))
+		return 0;
+
+	if (msg.head.opcode == RX_TIMEOUT) {
+		ldx_can_call_err_cb(cif, CAN_ERROR_BCM_RX_TIMEOUT, NULL);
+		return 0;
+	}
+	if (msg.head.opcode != RX_CHANGED ||
+	    n < (ssize_t)(sizeof(msg.head) + CAN_MTU))
+		return 0;
+
+	memset(evt, 0, sizeof(*evt));
+	memcpy(&evt->frame, &msg.frame, n - sizeof(msg.head));
+	for (cmsg = CMSG_FIRSTHDR(&mh); cmsg; cmsg = CMSG_NXTHDR(&mh, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET &&
+		    cmsg->cmsg_type == SCM_TIMESTAMP) {
+			memcpy(&evt->tstamp, CMSG_DATA(cmsg),
+			       sizeof(evt->tstamp));
+			evt->ts_sw.tv_sec = evt->tstamp.tv_sec;
+			evt->ts_sw.tv_nsec = evt->tstamp.tv_usec * 1000;
+		}
+	}
+	evt->is_rx = true;
+	evt->rx_skt = bcm_cb->rx_skt;
+
+	return n;
+}
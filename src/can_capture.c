@@ -0,0 +1,315 @@
+/*
+ * Copyright 2018, Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/net_tstamp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "can.h"
+#include "_can.h"
+#include "_log.h"
+
+/* Nominal frame size, only used by the kernel to validate the ring setup */
+#define CAN_CAPTURE_FRAME_SIZE	128
+
+static struct tpacket_block_desc *ldx_can_capture_desc(ldx_can_capture_t *cap,
+						       unsigned int idx)
+{
+	return (struct tpacket_block_desc *)(cap->map + (size_t)idx * cap->block_size);
+}
+
+ldx_can_capture_t *ldx_can_capture_open(const can_if_t *cif,
+					const ldx_can_capture_cfg_t *cfg)
+{
+	ldx_can_capture_t *cap;
+	struct tpacket_req3 req;
+	struct sockaddr_ll addr;
+	int version = TPACKET_V3;
+	unsigned int ifindex;
+	int ret;
+
+	if (!cif)
+		return NULL;
+
+	ifindex = if_nametoindex(cif->name);
+	if (!ifindex) {
+		log_error("%s: Unable to get interface index on %s",
+			  __func__, cif->name);
+		return NULL;
+	}
+
+	cap = calloc(1, sizeof(ldx_can_capture_t));
+	if (!cap) {
+		log_error("%s: Unable to allocate memory for %s capture",
+			  __func__, cif->name);
+		return NULL;
+	}
+
+	cap->block_size = (cfg && cfg->block_size) ? cfg->block_size :
+			  LDX_CAN_CAPTURE_DEF_BLOCK_SIZE;
+	cap->block_nr = (cfg && cfg->block_nr) ? cfg->block_nr :
+			LDX_CAN_CAPTURE_DEF_BLOCK_NR;
+
+	cap->fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, htons(ETH_P_ALL));
+	if (cap->fd < 0) {
+		log_error("%s: Unable to create packet socket on %s (%d)",
+			  __func__, cif->name, errno);
+		goto err_free;
+	}
+
+	ret = setsockopt(cap->fd, SOL_PACKET, PACKET_VERSION, &version,
+			 sizeof(version));
+	if (ret < 0) {
+		log_error("%s: setsockopt PACKET_VERSION error on %s",
+			  __func__, cif->name);
+		goto err_skt_close;
+	}
+
+	if (cif->cfg.hw_timestamp) {
+		int tstamp_flags = SOF_TIMESTAMPING_RAW_HARDWARE;
+
+		/* Fall back to software timestamps if not supported */
+		if (setsockopt(cap->fd, SOL_PACKET, PACKET_TIMESTAMP,
+			       &tstamp_flags, sizeof(tstamp_flags)) < 0)
+			log_info("%s: PACKET_TIMESTAMP not supported on %s",
+				 __func__, cif->name);
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = cap->block_size;
+	req.tp_block_nr = cap->block_nr;
+	req.tp_frame_size = CAN_CAPTURE_FRAME_SIZE;
+	req.tp_frame_nr = (cap->block_size / CAN_CAPTURE_FRAME_SIZE) * cap->block_nr;
+	req.tp_retire_blk_tov = (cfg && cfg->block_tout_ms) ? cfg->block_tout_ms :
+				LDX_CAN_CAPTURE_DEF_TOUT_MS;
+
+	ret = setsockopt(cap->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req));
+	if (ret < 0) {
+		log_error("%s: setsockopt PACKET_RX_RING error on %s (%d)",
+			  __func__, cif->name, errno);
+		goto err_skt_close;
+	}
+
+	cap->map_len = (size_t)cap->block_size * cap->block_nr;
+	cap->map = mmap(NULL, cap->map_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+			cap->fd, 0);
+	if (cap->map == MAP_FAILED) {
+		log_error("%s: Unable to map capture ring on %s (%d)",
+			  __func__, cif->name, errno);
+		goto err_skt_close;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sll_family = AF_PACKET;
+	addr.sll_protocol = htons(ETH_P_ALL);
+	addr.sll_ifindex = ifindex;
+	ret = bind(cap->fd, (struct sockaddr *)&addr, sizeof(addr));
+	if (ret < 0) {
+		log_error("%s: socket bind error on %s", __func__, cif->name);
+		goto err_unmap;
+	}
+
+	return cap;
+
+err_unmap:
+	munmap(cap->map, cap->map_len);
+
+err_skt_close:
+	close(cap->fd);
+
+err_free:
+	free(cap);
+
+	return NULL;
+}
+
+int ldx_can_capture_get_fd(const ldx_can_capture_t *cap)
+{
+	return cap ? cap->fd : -CAN_ERROR_NULL_INTERFACE;
+}
+
+static int64_t ldx_can_capture_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int ldx_can_capture_next_block(ldx_can_capture_t *cap,
+			       ldx_can_capture_block_t *blk, int timeout_ms)
+{
+	struct tpacket_block_desc *desc;
+	int64_t deadline = 0;
+	bool polled = false;
+
+	if (!cap || !blk)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	/* Interruptions and spurious wakeups do not extend the timeout */
+	if (timeout_ms >= 0)
+		deadline = ldx_can_capture_now_ms() + timeout_ms;
+
+	desc = ldx_can_capture_desc(cap, cap->cur);
+	while (!(__atomic_load_n(&desc->hdr.bh1.block_status, __ATOMIC_ACQUIRE) &
+		 TP_STATUS_USER)) {
+		struct pollfd pfd = {
+			.fd = cap->fd,
+			.events = POLLIN | POLLERR,
+		};
+		int tout = -1;
+		int ret;
+
+		if (timeout_ms >= 0) {
+			int64_t left = deadline - ldx_can_capture_now_ms();
+
+			if (left <= 0 && polled)
+				return 0;
+			tout = left > 0 ? (int)left : 0;
+		}
+
+		ret = poll(&pfd, 1, tout);
+		polled = true;
+		if (ret == 0)
+			return 0;
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			log_error("%s: poll error (%d)", __func__, errno);
+			return -CAN_ERROR_CAPTURE;
+		}
+		if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+			log_error("%s: capture socket error (0x%x)", __func__,
+				  pfd.revents);
+			return -CAN_ERROR_CAPTURE;
+		}
+	}
+
+	blk->nframes = desc->hdr.bh1.num_pkts;
+	blk->_left = blk->nframes;
+	blk->_desc = desc;
+	blk->_next = (uint8_t *)desc + desc->hdr.bh1.offset_to_first_pkt;
+
+	cap->cur = (cap->cur + 1) % cap->block_nr;
+
+	return 1;
+}
+
+static struct tpacket3_hdr *ldx_can_capture_next_hdr(ldx_can_capture_block_t *blk)
+{
+	struct tpacket3_hdr *hdr;
+
+	while (blk->_left) {
+		hdr = blk->_next;
+		blk->_left--;
+		blk->_next = (uint8_t *)hdr + hdr->tp_next_offset;
+
+		/* Skip anything that is neither a CAN nor a CAN FD frame */
+		if (hdr->tp_snaplen == CAN_MTU || hdr->tp_snaplen == CANFD_MTU)
+			return hdr;
+	}
+
+	return NULL;
+}
+
+const struct canfd_frame *ldx_can_capture_next_frame(ldx_can_capture_block_t *blk,
+						     struct timespec *ts)
+{
+	struct tpacket3_hdr *hdr;
+
+	if (!blk)
+		return NULL;
+
+	hdr = ldx_can_capture_next_hdr(blk);
+	if (!hdr)
+		return NULL;
+
+	if (ts) {
+		ts->tv_sec = hdr->tp_sec;
+		ts->tv_nsec = hdr->tp_nsec;
+	}
+
+	return (const struct canfd_frame *)((uint8_t *)hdr + hdr->tp_mac);
+}
+
+int ldx_can_capture_next_event(ldx_can_capture_block_t *blk,
+			       ldx_can_event_t *evt)
+{
+	struct tpacket3_hdr *hdr;
+
+	if (!blk || !evt)
+		return 0;
+
+	hdr = ldx_can_capture_next_hdr(blk);
+	if (!hdr)
+		return 0;
+
+	memset(evt, 0, sizeof(*evt));
+	memcpy(&evt->frame, (uint8_t *)hdr + hdr->tp_mac, hdr->tp_snaplen);
+	evt->tstamp.tv_sec = hdr->tp_sec;
+	evt->tstamp.tv_usec = hdr->tp_nsec / 1000;
+	if (hdr->tp_status & TP_STATUS_TS_RAW_HARDWARE) {
+		evt->ts_hw.tv_sec = hdr->tp_sec;
+		evt->ts_hw.tv_nsec = hdr->tp_nsec;
+	} else {
+		evt->ts_sw.tv_sec = hdr->tp_sec;
+		evt->ts_sw.tv_nsec = hdr->tp_nsec;
+	}
+	evt->is_rx = true;
+	evt->rx_skt = -1;
+	evt->is_error = (0 != (evt->frame.can_id & CAN_ERR_FLAG));
+
+	return 1;
+}
+
+void ldx_can_capture_release_block(ldx_can_capture_t *cap,
+				   ldx_can_capture_block_t *blk)
+{
+	struct tpacket_block_desc *desc;
+
+	if (!cap || !blk || !blk->_desc)
+		return;
+
+	desc = blk->_desc;
+	__atomic_store_n(&desc->hdr.bh1.block_status, TP_STATUS_KERNEL,
+			 __ATOMIC_RELEASE);
+	blk->_desc = NULL;
+	blk->_left = 0;
+}
+
+void ldx_can_capture_close(ldx_can_capture_t *cap)
+{
+	if (!cap)
+		return;
+
+	munmap(cap->map, cap->map_len);
+	close(cap->fd);
+	free(cap);
+}
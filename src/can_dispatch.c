@@ -0,0 +1,567 @@
+/*
+ * Copyright 2018, Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "can.h"
+#include "_can.h"
+#include "_log.h"
+
+#define CAN_ID_TABLE_EMPTY	0xFFFFFFFFU
+#define CAN_ID_TABLE_MIN_HASH	16
+
+/* Unused run entries tolerated before the table is compiled again */
+#define CAN_ID_TABLE_MIN_GARBAGE	4096
+
+/* Index of the empty run, 'runs[0]' is always NULL */
+#define CAN_ID_TABLE_NO_RUN	0
+
+/*
+ * Run builder used while compiling. Runs are stored back to back in a single
+ * NULL terminated array so that dispatching is a linear, cache friendly walk.
+ */
+typedef struct {
+	can_id_handler_t	**runs;
+	uint32_t		len;
+	uint32_t		size;
+} can_run_builder_t;
+
+static bool can_id_is_eff(canid_t id)
+{
+	return (id & CAN_EFF_FLAG) != 0;
+}
+
+static bool can_id_handler_match(const can_id_handler_t *h, canid_t id)
+{
+	return ((h->id ^ id) & h->mask) == 0;
+}
+
+static bool can_id_handler_is_exact(const can_id_handler_t *h)
+{
+	return (h->mask & CAN_EFF_MASK) == CAN_EFF_MASK;
+}
+
+static uint32_t can_id_hash(uint32_t id, uint32_t mask)
+{
+	return (id * 0x9E3779B1U) >> 7 & mask;
+}
+
+static int can_run_push(can_run_builder_t *b, can_id_handler_t *h)
+{
+	if (b->len == b->size) {
+		uint32_t size = b->size ? b->size * 2 : 64;
+		can_id_handler_t **runs = realloc(b->runs, size * sizeof(*runs));
+
+		if (!runs)
+			return -CAN_ERROR_NO_MEM;
+		b->runs = runs;
+		b->size = size;
+	}
+	b->runs[b->len++] = h;
+
+	return CAN_ERROR_NONE;
+}
+
+/* Make room for 'n' more entries, so that pushing them can not fail */
+static int can_run_reserve(can_run_builder_t *b, uint64_t n)
+{
+	can_id_handler_t **runs;
+	uint64_t size = b->size ? b->size : 64;
+
+	while (size - b->len < n)
+		size *= 2;
+	if (size == b->size)
+		return CAN_ERROR_NONE;
+	if (size > UINT32_MAX)
+		return -CAN_ERROR_NO_MEM;
+
+	runs = realloc(b->runs, size * sizeof(*runs));
+	if (!runs)
+		return -CAN_ERROR_NO_MEM;
+	b->runs = runs;
+	b->size = size;
+
+	return CAN_ERROR_NONE;
+}
+
+/*
+ * Append the run of handlers matching 'id' (from 'first' on in the list).
+ * If it is identical to the previous run, that one is reused instead.
+ * Returns the index of the run, CAN_ID_TABLE_NO_RUN if there are no handlers
+ * or a negative error code.
+ */
+static int64_t can_run_add(can_run_builder_t *b, can_id_table_t *table,
+			   canid_t id, bool only_wild, uint32_t prev)
+{
+	can_id_handler_t *h;
+	uint32_t start = b->len;
+	int ret;
+
+	list_for_each_entry(h, &table->handlers_head, list) {
+		if (can_id_is_eff(h->id) != can_id_is_eff(id))
+			continue;
+		if (only_wild && can_id_handler_is_exact(h))
+			continue;
+		if (can_id_handler_match(h, id)) {
+			ret = can_run_push(b, h);
+			if (ret)
+				return ret;
+		}
+	}
+
+	if (b->len == start)
+		return CAN_ID_TABLE_NO_RUN;
+
+	if (prev != CAN_ID_TABLE_NO_RUN &&
+	    prev + (b->len - start) < start &&
+	    b->runs[prev + (b->len - start)] == NULL &&
+	    !memcmp(&b->runs[prev], &b->runs[start],
+		    (b->len - start) * sizeof(*b->runs))) {
+		b->len = start;
+		return prev;
+	}
+
+	ret = can_run_push(b, NULL);
+	if (ret)
+		return ret;
+
+	return start;
+}
+
+static void ldx_can_id_table_release(can_id_table_t *table)
+{
+	free(table->runs);
+	free(table->eff_keys);
+	free(table->eff_runs);
+	table->runs = NULL;
+	table->runs_len = 0;
+	table->runs_size = 0;
+	table->runs_compiled = 0;
+	table->eff_keys = NULL;
+	table->eff_runs = NULL;
+	table->eff_mask = 0;
+	table->eff_wild = CAN_ID_TABLE_NO_RUN;
+	memset(table->sff, 0, sizeof(table->sff));
+}
+
+static uint32_t can_id_table_nhandlers(const can_id_table_t *table)
+{
+	const can_id_handler_t *h;
+	uint32_t n = 0;
+
+	list_for_each_entry(h, &table->handlers_head, list)
+		n++;
+
+	return n;
+}
+
+/*
+ * Append the 29-bit part of the table to the runs: the run of the partial
+ * mask handlers and the hash of the exact ones. Nothing is appended if an
+ * error is returned.
+ */
+static int can_id_table_build_eff(can_id_table_t *table, can_run_builder_t *b,
+				  uint32_t **keys, uint32_t **runs,
+				  uint32_t *hsize, uint32_t *wild)
+{
+	uint32_t *eff_keys, *eff_runs;
+	uint32_t nwild = 0, nexact = 0, size = CAN_ID_TABLE_MIN_HASH;
+	can_id_handler_t *h;
+	int ret;
+
+	list_for_each_entry(h, &table->handlers_head, list) {
+		if (!can_id_is_eff(h->id))
+			continue;
+		if (can_id_handler_is_exact(h))
+			nexact++;
+		else
+			nwild++;
+	}
+	while (size < nexact * 2)
+		size <<= 1;
+
+	eff_keys = malloc(size * sizeof(*eff_keys));
+	eff_runs = calloc(size, sizeof(*eff_runs));
+	ret = (eff_keys && eff_runs) ? CAN_ERROR_NONE : -CAN_ERROR_NO_MEM;
+	if (!ret)
+		ret = can_run_reserve(b, nwild + 1 + (uint64_t)nexact *
+				      (can_id_table_nhandlers(table) + 1));
+	if (ret) {
+		free(eff_keys);
+		free(eff_runs);
+		return ret;
+	}
+	memset(eff_keys, 0xFF, size * sizeof(*eff_keys));
+
+	/* 29-bit IDs with a partial mask, used when the hash misses */
+	*wild = CAN_ID_TABLE_NO_RUN;
+	list_for_each_entry(h, &table->handlers_head, list) {
+		if (can_id_is_eff(h->id) && !can_id_handler_is_exact(h)) {
+			if (*wild == CAN_ID_TABLE_NO_RUN)
+				*wild = b->len;
+			can_run_push(b, h);
+		}
+	}
+	if (*wild != CAN_ID_TABLE_NO_RUN)
+		can_run_push(b, NULL);
+
+	/* 29-bit IDs with an exact mask, hashed */
+	list_for_each_entry(h, &table->handlers_head, list) {
+		uint32_t key, slot;
+
+		if (!can_id_is_eff(h->id) || !can_id_handler_is_exact(h))
+			continue;
+
+		key = h->id & CAN_EFF_MASK;
+		slot = can_id_hash(key, size - 1);
+		while (eff_keys[slot] != CAN_ID_TABLE_EMPTY && eff_keys[slot] != key)
+			slot = (slot + 1) & (size - 1);
+		if (eff_keys[slot] == key)
+			continue;
+
+		/* The run includes the partial mask handlers that match too */
+		eff_keys[slot] = key;
+		eff_runs[slot] = can_run_add(b, table, key | CAN_EFF_FLAG, false,
+					     CAN_ID_TABLE_NO_RUN);
+	}
+
+	*keys = eff_keys;
+	*runs = eff_runs;
+	*hsize = size;
+
+	return CAN_ERROR_NONE;
+}
+
+static void can_id_table_set_eff(can_id_table_t *table, uint32_t *keys,
+				 uint32_t *runs, uint32_t hsize, uint32_t wild)
+{
+	free(table->eff_keys);
+	free(table->eff_runs);
+	table->eff_keys = keys;
+	table->eff_runs = runs;
+	table->eff_mask = hsize - 1;
+	table->eff_wild = wild;
+}
+
+/*
+ * Rebuild the dispatch table from the list of registered handlers. It is
+ * only called with the mutex held, which also serializes the dispatch.
+ */
+static int ldx_can_id_table_compile(can_id_table_t *table)
+{
+	can_run_builder_t b = { NULL, 0, 0 };
+	uint32_t *eff_keys, *eff_runs;
+	uint32_t sff[CAN_SFF_MASK + 1];
+	uint32_t hsize, eff_wild, prev;
+	int64_t run;
+	canid_t id;
+	int ret;
+
+	ret = can_run_push(&b, NULL);
+	if (ret)
+		return ret;
+
+	/* 11-bit IDs: one entry per possible ID */
+	prev = CAN_ID_TABLE_NO_RUN;
+	for (id = 0; id <= CAN_SFF_MASK; id++) {
+		run = can_run_add(&b, table, id, false, prev);
+		if (run < 0) {
+			ret = run;
+			goto err_free;
+		}
+		sff[id] = run;
+		if (run != CAN_ID_TABLE_NO_RUN)
+			prev = run;
+	}
+
+	ret = can_id_table_build_eff(table, &b, &eff_keys, &eff_runs, &hsize,
+				     &eff_wild);
+	if (ret)
+		goto err_free;
+
+	ldx_can_id_table_release(table);
+	table->runs = b.runs;
+	table->runs_len = b.len;
+	table->runs_size = b.size;
+	table->runs_compiled = b.len;
+	memcpy(table->sff, sff, sizeof(sff));
+	can_id_table_set_eff(table, eff_keys, eff_runs, hsize, eff_wild);
+
+	return CAN_ERROR_NONE;
+
+err_free:
+	free(b.runs);
+
+	return ret;
+}
+
+/*
+ * Update the table after 'h' was added to or removed from the list. Only
+ * the 11-bit IDs 'h' matches get new runs, appended to the existing ones;
+ * the runs they used before are left unused until the next compilation.
+ * The 29-bit part is small and rebuilt as a whole.
+ */
+static int ldx_can_id_table_update(can_id_table_t *table,
+				   const can_id_handler_t *h)
+{
+	can_run_builder_t b;
+	uint32_t *eff_keys, *eff_runs;
+	uint32_t hsize, eff_wild, prev, n = 0;
+	canid_t id;
+	int ret;
+
+	if (!table->runs ||
+	    table->runs_len > 2 * table->runs_compiled + CAN_ID_TABLE_MIN_GARBAGE)
+		return ldx_can_id_table_compile(table);
+
+	b.runs = table->runs;
+	b.len = table->runs_len;
+	b.size = table->runs_size;
+
+	if (can_id_is_eff(h->id)) {
+		ret = can_id_table_build_eff(table, &b, &eff_keys, &eff_runs,
+					     &hsize, &eff_wild);
+		if (!ret)
+			can_id_table_set_eff(table, eff_keys, eff_runs, hsize,
+					     eff_wild);
+		goto out;
+	}
+
+	for (id = 0; id <= CAN_SFF_MASK; id++)
+		n += can_id_handler_match(h, id);
+	ret = can_run_reserve(&b, (uint64_t)n *
+			      (can_id_table_nhandlers(table) + 1));
+	if (ret)
+		goto out;
+
+	prev = CAN_ID_TABLE_NO_RUN;
+	for (id = 0; id <= CAN_SFF_MASK; id++) {
+		if (!can_id_handler_match(h, id))
+			continue;
+		table->sff[id] = can_run_add(&b, table, id, false, prev);
+		if (table->sff[id] != CAN_ID_TABLE_NO_RUN)
+			prev = table->sff[id];
+	}
+
+out:
+	/* The runs may have been moved even if nothing was appended */
+	table->runs = b.runs;
+	table->runs_len = b.len;
+	table->runs_size = b.size;
+
+	return ret;
+}
+
+static uint32_t ldx_can_id_table_lookup(const can_id_table_t *table, canid_t can_id)
+{
+	uint32_t key, slot;
+
+	if (!can_id_is_eff(can_id))
+		return table->sff[can_id & CAN_SFF_MASK];
+
+	key = can_id & CAN_EFF_MASK;
+	slot = can_id_hash(key, table->eff_mask);
+	while (table->eff_keys[slot] != CAN_ID_TABLE_EMPTY) {
+		if (table->eff_keys[slot] == key)
+			return table->eff_runs[slot];
+		slot = (slot + 1) & table->eff_mask;
+	}
+
+	return table->eff_wild;
+}
+
+void ldx_can_id_table_dispatch(can_id_table_t *table, ldx_can_event_t *evt)
+{
+	can_id_handler_t **run;
+	canid_t can_id = evt->frame.can_id;
+
+	if (!table->runs)
+		return;
+
+	run = &table->runs[ldx_can_id_table_lookup(table, can_id)];
+	if (can_id_is_eff(can_id) && run != &table->runs[table->eff_wild]) {
+		for (; *run; run++)
+			(*run)->handler(&evt->frame, &evt->tstamp);
+		return;
+	}
+
+	/* The run of partial mask 29-bit handlers still needs the ID check */
+	for (; *run; run++) {
+		if (!can_id_is_eff(can_id) || can_id_handler_match(*run, can_id))
+			(*run)->handler(&evt->frame, &evt->tstamp);
+	}
+}
+
+void ldx_can_id_table_free(can_id_table_t *table)
+{
+	can_id_handler_t *h, *tmp;
+
+	if (!table)
+		return;
+
+	list_for_each_entry_safe(h, tmp, &table->handlers_head, list) {
+		list_del(&h->list);
+		free(h);
+	}
+	ldx_can_id_table_release(table);
+	free(table);
+}
+
+static canid_t can_id_normalize_mask(canid_t id, canid_t mask)
+{
+	/* The frame format is always part of the match */
+	return (mask & (can_id_is_eff(id) ? CAN_EFF_MASK : CAN_SFF_MASK)) |
+	       CAN_EFF_FLAG;
+}
+
+static canid_t can_id_normalize(canid_t id)
+{
+	return id & (can_id_is_eff(id) ? (CAN_EFF_FLAG | CAN_EFF_MASK) :
+					 CAN_SFF_MASK);
+}
+
+int ldx_can_register_id_handler(can_if_t *cif, canid_t id, canid_t mask,
+				const ldx_can_rx_cb_t cb)
+{
+	can_priv_t *pdata;
+	can_id_table_t *table;
+	can_id_handler_t *h;
+	int ret;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	pdata = cif->_data;
+
+	ret = ldx_can_lock_mutex(cif, __func__);
+	if (ret)
+		return ret;
+
+	table = pdata->id_table;
+	if (!table) {
+		table = calloc(1, sizeof(can_id_table_t));
+		if (!table) {
+			log_error("%s: Unable to alloc memory for dispatch table on %s",
+				  __func__, cif->name);
+			ret = -CAN_ERROR_NO_MEM;
+			goto err_unlock;
+		}
+		INIT_LIST_HEAD(&table->handlers_head);
+
+		/* A single socket without kernel filters feeds all handlers */
+		ret = ldx_can_add_rx_cb(cif, NULL, 0, &table->rxcb);
+		if (ret) {
+			free(table);
+			goto err_unlock;
+		}
+		pdata->id_table = table;
+	}
+
+	h = calloc(1, sizeof(can_id_handler_t));
+	if (!h) {
+		log_error("%s: Unable to alloc memory for rx callback on %s",
+			  __func__, cif->name);
+		ret = -CAN_ERROR_NO_MEM;
+		goto err_unlock;
+	}
+	h->id = can_id_normalize(id);
+	h->mask = can_id_normalize_mask(id, mask);
+	h->handler = cb;
+	list_add_tail(&h->list, &table->handlers_head);
+
+	ret = ldx_can_id_table_update(table, h);
+	if (ret) {
+		log_error("%s: Unable to compile dispatch table on %s",
+			  __func__, cif->name);
+		list_del(&h->list);
+		free(h);
+		goto err_unlock;
+	}
+	table->rxcb->id_table = table;
+
+err_unlock:
+	ldx_can_unlock_mutex(cif);
+
+	return ret;
+}
+
+int ldx_can_unregister_id_handler(can_if_t *cif, canid_t id, canid_t mask,
+				  const ldx_can_rx_cb_t cb)
+{
+	can_priv_t *pdata;
+	can_id_table_t *table;
+	can_id_handler_t *h;
+	canid_t nid, nmask;
+	int ret;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	pdata = cif->_data;
+	nid = can_id_normalize(id);
+	nmask = can_id_normalize_mask(id, mask);
+
+	ret = ldx_can_lock_mutex(cif, __func__);
+	if (ret)
+		return ret;
+
+	ret = -CAN_ERROR_RX_CB_NOT_FOUND;
+	table = pdata->id_table;
+	if (!table)
+		goto err_unlock;
+
+	list_for_each_entry(h, &table->handlers_head, list) {
+		if (h->id == nid && h->mask == nmask && h->handler == cb) {
+			ret = CAN_ERROR_NONE;
+			break;
+		}
+	}
+	if (ret) {
+		log_error("%s: callback not found on %s", __func__, cif->name);
+		goto err_unlock;
+	}
+	list_del(&h->list);
+
+	if (list_empty(&table->handlers_head)) {
+		free(h);
+		ldx_can_close_rx_socket_impl(cif, table->rxcb->rx_skt);
+		ldx_can_id_table_free(table);
+		pdata->id_table = NULL;
+		goto err_unlock;
+	}
+
+	/* The runs still point to the handler until they are updated */
+	ret = ldx_can_id_table_update(table, h);
+	if (ret) {
+		log_error("%s: Unable to compile dispatch table on %s",
+			  __func__, cif->name);
+		list_add_tail(&h->list, &table->handlers_head);
+		goto err_unlock;
+	}
+	free(h);
+
+err_unlock:
+	ldx_can_unlock_mutex(cif);
+
+	return ret;
+}
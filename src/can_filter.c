@@ -0,0 +1,185 @@
+/*
+ * Copyright 2018, Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <errno.h>
+#include <linux/can/raw.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "can.h"
+#include "_can.h"
+#include "_log.h"
+
+/* Bits of 'can_id' that are flags of the filter, not part of the match */
+#define CAN_FILTER_FLAGS	(CAN_INV_FILTER | CAN_ERR_FLAG)
+
+static int can_filter_cmp(const void *a, const void *b)
+{
+	const struct can_filter *fa = a, *fb = b;
+
+	if (fa->can_mask != fb->can_mask)
+		return fa->can_mask < fb->can_mask ? -1 : 1;
+	if (fa->can_id != fb->can_id)
+		return fa->can_id < fb->can_id ? -1 : 1;
+
+	return 0;
+}
+
+/* Every frame matching 'f' also matches 'wide' */
+static bool can_filter_covers(const struct can_filter *wide,
+			      const struct can_filter *f)
+{
+	if ((wide->can_id | f->can_id) & CAN_FILTER_FLAGS)
+		return false;
+
+	return !(wide->can_mask & ~f->can_mask) &&
+	       (f->can_id & wide->can_mask) == wide->can_id;
+}
+
+ldx_can_filter_set_t *ldx_can_filter_set_create(const struct can_filter *filters,
+						int nfilters, bool join)
+{
+	ldx_can_filter_set_t *set;
+	unsigned int i, j, n = 0;
+
+	if (nfilters < 0 || (nfilters && !filters))
+		return NULL;
+
+	set = calloc(1, sizeof(*set) + nfilters * sizeof(struct can_filter));
+	if (!set) {
+		log_error("%s: Unable to allocate memory for filter set",
+			  __func__);
+		return NULL;
+	}
+	set->join = join;
+
+	/* Only the masked bits of the ID take part in the match */
+	for (i = 0; i < (unsigned int)nfilters; i++) {
+		struct can_filter *f = &set->filters[i];
+
+		f->can_mask = filters[i].can_mask;
+		f->can_id = (filters[i].can_id & f->can_mask & ~CAN_FILTER_FLAGS) |
+			    (filters[i].can_id & CAN_FILTER_FLAGS);
+	}
+
+	/* Masks with fewer bits first, so broad filters are kept first */
+	qsort(set->filters, nfilters, sizeof(struct can_filter),
+	      can_filter_cmp);
+
+	for (i = 0; i < (unsigned int)nfilters; i++) {
+		const struct can_filter *f = &set->filters[i];
+		bool redundant = false;
+
+		for (j = 0; j < n && !redundant; j++) {
+			if (!memcmp(&set->filters[j], f, sizeof(*f)))
+				redundant = true;
+			/* With joined filters every one of them restricts more */
+			else if (!join && can_filter_covers(&set->filters[j], f))
+				redundant = true;
+		}
+		if (!redundant)
+			set->filters[n++] = *f;
+	}
+	set->n = n;
+
+	return set;
+}
+
+void ldx_can_filter_set_free(ldx_can_filter_set_t *set)
+{
+	free(set);
+}
+
+int ldx_can_set_rx_filters(const can_if_t *cif, int rx_skt,
+			   const ldx_can_filter_set_t *set)
+{
+	int join;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+	if (!set || rx_skt < 0)
+		return -CAN_ERROR_SETSKTOPT_RAW_FLT;
+
+	/*
+	 * The kernel registers the new filters before releasing the old ones.
+	 * The join mode is changed on the side where the socket temporarily
+	 * receives more, not less.
+	 */
+	join = 0;
+	if (!set->join &&
+	    setsockopt(rx_skt, SOL_CAN_RAW, CAN_RAW_JOIN_FILTERS, &join,
+		       sizeof(join)) && errno != ENOPROTOOPT) {
+		log_error("%s: setsockopt CAN_RAW_JOIN_FILTERS error (%d) on %s",
+			  __func__, errno, cif->name);
+		return -CAN_ERROR_SETSKTOPT_RAW_FLT;
+	}
+
+	if (setsockopt(rx_skt, SOL_CAN_RAW, CAN_RAW_FILTER,
+		       set->n ? set->filters : NULL,
+		       set->n * sizeof(struct can_filter))) {
+		log_error("%s: setsockopt CAN_RAW_FILTER error (%d) on %s",
+			  __func__, errno, cif->name);
+		return -CAN_ERROR_SETSKTOPT_RAW_FLT;
+	}
+
+	join = 1;
+	if (set->join &&
+	    setsockopt(rx_skt, SOL_CAN_RAW, CAN_RAW_JOIN_FILTERS, &join,
+		       sizeof(join))) {
+		log_error("%s: setsockopt CAN_RAW_JOIN_FILTERS error (%d) on %s",
+			  __func__, errno, cif->name);
+		return -CAN_ERROR_SETSKTOPT_RAW_FLT;
+	}
+
+	return CAN_ERROR_NONE;
+}
+
+int ldx_can_set_rx_handler_filters(const can_if_t *cif, const ldx_can_rx_cb_t cb,
+				   const ldx_can_filter_set_t *set)
+{
+	can_priv_t *pdata;
+	can_cb_t *rx_cb;
+	int ret;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	pdata = cif->_data;
+
+	ret = ldx_can_lock_mutex(cif, __func__);
+	if (ret)
+		return ret;
+
+	ret = -CAN_ERROR_RX_CB_NOT_FOUND;
+	list_for_each_entry(rx_cb, &pdata->rx_cb_list_head, list) {
+		if (!rx_cb->bcm && rx_cb->handler && rx_cb->handler == cb) {
+			ret = ldx_can_set_rx_filters(cif, rx_cb->rx_skt, set);
+			break;
+		}
+	}
+	if (ret == -CAN_ERROR_RX_CB_NOT_FOUND)
+		log_error("%s: rx handler not found on %s", __func__,
+			  cif->name);
+
+	ldx_can_unlock_mutex(cif);
+
+	return ret;
+}
@@ -0,0 +1,291 @@
+/*
+ * Copyright 2018, Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <errno.h>
+#if defined(__has_include)
+#if __has_include(<linux/can/gw.h>)
+#include <linux/can/gw.h>
+#endif
+#endif
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "can.h"
+#include "_can.h"
+#include "_log.h"
+
+#ifdef CGW_MOD_ID
+/* Room for the attributes of a gateway job */
+#define CAN_GW_ATTR_LEN		256
+
+typedef struct {
+	struct nlmsghdr		n;
+	struct rtcanmsg		r;
+	char			buf[CAN_GW_ATTR_LEN];
+} can_gw_req_t;
+
+static void can_gw_addattr(can_gw_req_t *req, int type, const void *data,
+			   int len)
+{
+	struct rtattr *rta;
+
+	rta = (struct rtattr *)((char *)req + NLMSG_ALIGN(req->n.nlmsg_len));
+	rta->rta_type = type;
+	rta->rta_len = RTA_LENGTH(len);
+	memcpy(RTA_DATA(rta), data, len);
+	req->n.nlmsg_len = NLMSG_ALIGN(req->n.nlmsg_len) +
+			   RTA_ALIGN(rta->rta_len);
+}
+
+/*
+ * Build the message of a kernel gateway job. Jobs are deleted with the same
+ * attributes they were created with, so both operations share this code.
+ */
+static void can_gw_build_job(can_gw_req_t *req, uint16_t type,
+			     const ldx_can_route_t *route, unsigned int job)
+{
+	const can_priv_t *src = route->src->_data;
+	const can_priv_t *dst = route->dst->_data;
+	uint32_t ifindex;
+
+	memset(req, 0, sizeof(*req));
+	req->n.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtcanmsg));
+	req->n.nlmsg_type = type;
+	req->r.can_family = AF_CAN;
+	req->r.gwtype = CGW_TYPE_CAN_CAN;
+
+	if (job == CAN_GW_JOB_CANFD) {
+		/* Only created when the headers know about CAN FD jobs */
+#ifdef CGW_FLAGS_CAN_FD
+		req->r.flags |= CGW_FLAGS_CAN_FD;
+		if (route->cfg.set_id) {
+			struct cgw_fdframe_mod mod;
+
+			memset(&mod, 0, sizeof(mod));
+			mod.cf.can_id = route->cfg.new_id;
+			mod.modtype = CGW_MOD_ID;
+			can_gw_addattr(req, CGW_FDMOD_SET, &mod, CGW_FDMODATTR_LEN);
+		}
+#endif
+	} else if (route->cfg.set_id) {
+		struct cgw_frame_mod mod;
+
+		memset(&mod, 0, sizeof(mod));
+		mod.cf.can_id = route->cfg.new_id;
+		mod.modtype = CGW_MOD_ID;
+		can_gw_addattr(req, CGW_MOD_SET, &mod, CGW_MODATTR_LEN);
+	}
+
+	if (route->cfg.max_hops)
+		can_gw_addattr(req, CGW_LIM_HOPS, &route->cfg.max_hops,
+			       sizeof(route->cfg.max_hops));
+
+	can_gw_addattr(req, CGW_FILTER, &route->cfg.filter,
+		       sizeof(route->cfg.filter));
+
+	ifindex = src->addr.can_ifindex;
+	can_gw_addattr(req, CGW_SRC_IF, &ifindex, sizeof(ifindex));
+	ifindex = dst->addr.can_ifindex;
+	can_gw_addattr(req, CGW_DST_IF, &ifindex, sizeof(ifindex));
+}
+
+static void can_gw_del_jobs(ldx_can_route_t *route)
+{
+	can_gw_req_t req;
+	unsigned int job;
+
+	for (job = CAN_GW_JOB_CAN; job <= CAN_GW_JOB_CANFD; job <<= 1) {
+		if (!(route->kjobs & job))
+			continue;
+		can_gw_build_job(&req, RTM_DELROUTE, route, job);
+		if (ldx_can_nl_request(route->src, &req.n, CAN_ERROR_GW_ROUTE))
+			log_error("%s: Unable to delete gateway job %s -> %s",
+				  __func__, route->src->name, route->dst->name);
+		route->kjobs &= ~job;
+	}
+}
+
+/* A gateway job only handles one frame type, CAN FD needs a second one */
+static int can_gw_add_jobs(ldx_can_route_t *route)
+{
+	can_gw_req_t req;
+	unsigned int job, jobs = CAN_GW_JOB_CAN;
+	int ret;
+
+	if (route->cfg.canfd) {
+#ifdef CGW_FLAGS_CAN_FD
+		jobs |= CAN_GW_JOB_CANFD;
+#else
+		return -CAN_ERROR_NOT_SUPPORTED;
+#endif
+	}
+
+	for (job = CAN_GW_JOB_CAN; job <= CAN_GW_JOB_CANFD; job <<= 1) {
+		if (!(jobs & job))
+			continue;
+		can_gw_build_job(&req, RTM_NEWROUTE, route, job);
+		ret = ldx_can_nl_request(route->src, &req.n, CAN_ERROR_GW_ROUTE);
+		if (ret) {
+			can_gw_del_jobs(route);
+			return ret;
+		}
+		route->kjobs |= job;
+	}
+
+	return CAN_ERROR_NONE;
+}
+#else
+static void can_gw_del_jobs(ldx_can_route_t *route)
+{
+	route->kjobs = 0;
+}
+
+static int can_gw_add_jobs(ldx_can_route_t *route)
+{
+	return -CAN_ERROR_NOT_SUPPORTED;
+}
+#endif /* CGW_MOD_ID */
+
+static void can_gw_forward(void *ctx, const ldx_can_event_t *evts, size_t n)
+{
+	ldx_can_route_t *route = ctx;
+	unsigned int nframes = 0, sent;
+	/* Classic frames stay classic on a CAN FD destination */
+	int mtu = route->cfg.canfd ? CANFD_MTU : CAN_MTU;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		struct canfd_frame *frame = &route->frames[nframes];
+
+		if (!evts[i].is_rx || evts[i].is_error)
+			continue;
+		if (!route->cfg.canfd &&
+		    (evts[i].frame.len > CAN_MAX_DLEN || evts[i].frame.flags))
+			continue;
+
+		*frame = evts[i].frame;
+		if (route->cfg.set_id)
+			frame->can_id = route->cfg.new_id;
+		if (route->cfg.cb && !route->cfg.cb(route->cfg.ctx, frame))
+			continue;
+
+		/* Send what is collected when the batch buffer is full */
+		if (++nframes == route->nframes) {
+			ldx_can_tx_frames_i(route->dst, route->frames, nframes,
+					    mtu, &sent);
+			nframes = 0;
+		}
+	}
+
+	if (nframes && ldx_can_tx_frames_i(route->dst, route->frames, nframes,
+					   mtu, &sent))
+		log_debug("%s: %u of %u frames forwarded %s -> %s", __func__,
+			  sent, nframes, route->src->name, route->dst->name);
+}
+
+ldx_can_route_t *ldx_can_route_add(can_if_t *src, const can_if_t *dst,
+				   const ldx_can_route_cfg_t *cfg)
+{
+	can_priv_t *pdata;
+	ldx_can_route_t *route;
+	struct can_filter filter;
+
+	if (!src || !dst || !cfg)
+		return NULL;
+
+	if (cfg->canfd && (!src->cfg.canfd_enabled || !dst->cfg.canfd_enabled)) {
+		log_error("%s: CAN FD route needs CAN FD on %s and %s", __func__,
+			  src->name, dst->name);
+		return NULL;
+	}
+
+	pdata = src->_data;
+
+	route = calloc(1, sizeof(ldx_can_route_t));
+	if (!route) {
+		log_error("%s: Unable to allocate memory for route on %s",
+			  __func__, src->name);
+		return NULL;
+	}
+	route->src = src;
+	route->dst = dst;
+	route->cfg = *cfg;
+	route->handle = -1;
+
+	if (!cfg->cb && !cfg->no_offload) {
+		if (!can_gw_add_jobs(route))
+			return route;
+		log_info("%s: kernel gateway not available, forwarding %s -> %s in user space",
+			 __func__, src->name, dst->name);
+	}
+
+	route->nframes = pdata->rx_batch ? pdata->rx_batch : 1;
+	route->frames = calloc(route->nframes, sizeof(*route->frames));
+	if (!route->frames) {
+		log_error("%s: Unable to allocate memory for route on %s",
+			  __func__, src->name);
+		goto err_free;
+	}
+
+	filter = cfg->filter;
+	route->handle = ldx_can_register_rx_batch_handler(src, can_gw_forward,
+							  route, &filter, 1);
+	if (route->handle < 0) {
+		log_error("%s: Unable to register forwarder on %s", __func__,
+			  src->name);
+		goto err_free;
+	}
+
+	return route;
+
+err_free:
+	free(route->frames);
+	free(route);
+
+	return NULL;
+}
+
+bool ldx_can_route_is_offloaded(const ldx_can_route_t *route)
+{
+	return route && route->kjobs;
+}
+
+int ldx_can_route_del(ldx_can_route_t *route)
+{
+	int ret = CAN_ERROR_NONE;
+
+	if (!route)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	if (route->kjobs)
+		can_gw_del_jobs(route);
+
+	if (route->handle >= 0)
+		ret = ldx_can_unregister_rx_batch_handler(route->src,
+							  route->handle);
+
+	free(route->frames);
+	free(route);
+
+	return ret;
+}
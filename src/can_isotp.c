@@ -0,0 +1,661 @@
+/*
+ * Copyright 2018, Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__has_include)
+#if __has_include(<linux/can/isotp.h>)
+#include <linux/can/isotp.h>
+#endif
+#endif
+
+#include "can.h"
+#include "_can.h"
+#include "_log.h"
+
+/* Protocol control information (high nibble of the first byte) */
+#define ISOTP_PCI_SF		0x00
+#define ISOTP_PCI_FF		0x10
+#define ISOTP_PCI_CF		0x20
+#define ISOTP_PCI_FC		0x30
+#define ISOTP_PCI_MASK		0xF0
+
+/* Flow status of a flow control frame */
+#define ISOTP_FC_CTS		0
+#define ISOTP_FC_WAIT		1
+#define ISOTP_FC_OVFLW		2
+
+/* Largest PDU length that fits in the 12-bit first frame length */
+#define ISOTP_FF_DL12_MAX	4095
+
+/* Maximum number of consecutive FC.WAIT accepted while sending (N_WFTmax) */
+#define ISOTP_MAX_WFT		16
+
+/* Back-off used when the socket is writable but the device queue is full */
+#define ISOTP_TX_BACKOFF_US	100
+
+static int64_t isotp_now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int isotp_timeout_ms(const ldx_can_isotp_t *tp)
+{
+	return tp->cfg.timeout_ms > 0 ? tp->cfg.timeout_ms :
+	       LDX_CAN_ISOTP_DEF_TOUT_MS;
+}
+
+/* Remaining time to a deadline for poll(), a negative deadline never expires */
+static int isotp_left_ms(int64_t deadline)
+{
+	int64_t left;
+
+	if (deadline < 0)
+		return -1;
+
+	left = deadline - isotp_now_ms();
+	return left > 0 ? (int)left : 0;
+}
+
+/* Decode a separation time (STmin) into microseconds */
+static unsigned int isotp_stmin_us(uint8_t st_min)
+{
+	if (st_min <= 0x7F)
+		return st_min * 1000;
+	if (st_min >= 0xF1 && st_min <= 0xF9)
+		return (st_min - 0xF0) * 100;
+
+	/* Reserved values must be handled as the longest time */
+	return 127000;
+}
+
+/* Length of the frame carrying 'len' bytes, including the padding */
+static unsigned int isotp_frame_len(const ldx_can_isotp_t *tp, unsigned int len)
+{
+	static const uint8_t fd_len[] = { 8, 12, 16, 20, 24, 32, 48, 64 };
+	unsigned int i;
+
+	if (tp->cfg.tx_padding)
+		return tp->tx_dl;
+	if (len <= CAN_MAX_DLEN)
+		return len;
+
+	/* CAN FD frames above 8 bytes only come in a few lengths */
+	for (i = 0; i < sizeof(fd_len) - 1; i++) {
+		if (len <= fd_len[i])
+			break;
+	}
+
+	return fd_len[i];
+}
+
+static int isotp_write(ldx_can_isotp_t *tp, struct canfd_frame *frame,
+		       unsigned int len)
+{
+	unsigned int flen = isotp_frame_len(tp, len);
+	int64_t deadline = isotp_now_ms() + isotp_timeout_ms(tp);
+
+	if (flen > len)
+		memset(frame->data + len, tp->cfg.pad_byte, flen - len);
+	frame->can_id = tp->cfg.tx_id;
+	frame->len = flen;
+
+	for (;;) {
+		struct pollfd pfd = { .fd = tp->fd, .events = POLLOUT };
+		int ret = write(tp->fd, frame, tp->mtu);
+
+		if (ret == (int)tp->mtu)
+			return CAN_ERROR_NONE;
+
+		if (ret >= 0) {
+			return -CAN_ERROR_INCOMP_FRAME;
+		} else if (errno != ENOBUFS && errno != EAGAIN && errno != EINTR) {
+			log_error("%s: socket write error (%d) on %s", __func__,
+				  errno, tp->cif->name);
+			return -CAN_ERROR_TX_SKT_WR;
+		}
+
+		if (isotp_left_ms(deadline) == 0)
+			return -CAN_ERROR_ISOTP_TIMEOUT;
+
+		/* See ldx_can_tx_wait() for the reason of the back-off */
+		ret = poll(&pfd, 1, isotp_left_ms(deadline));
+		if (ret > 0) {
+			usleep(ISOTP_TX_BACKOFF_US);
+		} else if (ret < 0 && errno != EINTR) {
+			log_error("%s: poll error (%d) on %s", __func__, errno,
+				  tp->cif->name);
+			return -CAN_ERROR_ISOTP_SKT;
+		}
+	}
+}
+
+/*
+ * Read the next frame addressed to the session.
+ * Return: 1 if a frame was read, 0 on timeout, error code otherwise.
+ */
+static int isotp_read(ldx_can_isotp_t *tp, struct canfd_frame *frame,
+		      int64_t deadline)
+{
+	for (;;) {
+		struct pollfd pfd = { .fd = tp->fd, .events = POLLIN };
+		int ret;
+
+		ret = poll(&pfd, 1, isotp_left_ms(deadline));
+		if (ret == 0)
+			return 0;
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -CAN_ERROR_ISOTP_SKT;
+		}
+
+		ret = read(tp->fd, frame, sizeof(*frame));
+		if (ret < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				continue;
+			if (errno == ENETDOWN)
+				return -CAN_ERROR_NETWORK_DOWN;
+			return -CAN_ERROR_ISOTP_SKT;
+		}
+
+		/* The socket also gets the error frames of the interface */
+		if (ret < (int)CAN_MTU || !frame->len ||
+		    (frame->can_id & (CAN_ERR_FLAG | CAN_RTR_FLAG)))
+			continue;
+
+		return 1;
+	}
+}
+
+static int isotp_send_fc(ldx_can_isotp_t *tp, uint8_t fs)
+{
+	struct canfd_frame frame;
+
+	memset(&frame, 0, sizeof(frame));
+	frame.data[0] = ISOTP_PCI_FC | fs;
+	frame.data[1] = tp->cfg.block_size;
+	frame.data[2] = tp->cfg.st_min;
+
+	return isotp_write(tp, &frame, 3);
+}
+
+/* Wait for a clear to send flow control, following the WAIT requests */
+static int isotp_wait_cts(ldx_can_isotp_t *tp, uint8_t *bs, uint8_t *st_min)
+{
+	struct canfd_frame frame;
+	int64_t deadline = isotp_now_ms() + isotp_timeout_ms(tp);
+	unsigned int wft = 0;
+
+	for (;;) {
+		int ret = isotp_read(tp, &frame, deadline);
+
+		if (ret < 0)
+			return ret;
+		if (ret == 0)
+			return -CAN_ERROR_ISOTP_TIMEOUT;
+
+		if ((frame.data[0] & ISOTP_PCI_MASK) != ISOTP_PCI_FC ||
+		    frame.len < 3)
+			continue;
+
+		switch (frame.data[0] & 0x0F) {
+		case ISOTP_FC_CTS:
+			*bs = frame.data[1];
+			*st_min = frame.data[2];
+			return CAN_ERROR_NONE;
+		case ISOTP_FC_WAIT:
+			if (++wft > ISOTP_MAX_WFT)
+				return -CAN_ERROR_ISOTP_TIMEOUT;
+			deadline = isotp_now_ms() + isotp_timeout_ms(tp);
+			break;
+		case ISOTP_FC_OVFLW:
+			return -CAN_ERROR_ISOTP_OVERFLOW;
+		default:
+			return -CAN_ERROR_ISOTP_PROTOCOL;
+		}
+	}
+}
+
+static int isotp_user_send(ldx_can_isotp_t *tp, const uint8_t *data,
+			   size_t len)
+{
+	struct canfd_frame frame;
+	unsigned int hdr, n, sn = 1;
+	size_t off;
+	int ret;
+
+	memset(&frame, 0, sizeof(frame));
+
+	/* Single frame, with the escape sequence for CAN FD lengths */
+	if (len <= CAN_MAX_DLEN - 1 ||
+	    (tp->tx_dl > CAN_MAX_DLEN && len <= tp->tx_dl - 2)) {
+		hdr = 1;
+		if (len <= CAN_MAX_DLEN - 1) {
+			frame.data[0] = ISOTP_PCI_SF | len;
+		} else {
+			frame.data[0] = ISOTP_PCI_SF;
+			frame.data[1] = len;
+			hdr = 2;
+		}
+		memcpy(frame.data + hdr, data, len);
+
+		return isotp_write(tp, &frame, hdr + len);
+	}
+
+	/* First frame, with the escape sequence for lengths above 4095 */
+	if (len <= ISOTP_FF_DL12_MAX) {
+		frame.data[0] = ISOTP_PCI_FF | (len >> 8);
+		frame.data[1] = len & 0xFF;
+		hdr = 2;
+	} else if (len <= UINT32_MAX) {
+		frame.data[0] = ISOTP_PCI_FF;
+		frame.data[1] = 0;
+		frame.data[2] = (len >> 24) & 0xFF;
+		frame.data[3] = (len >> 16) & 0xFF;
+		frame.data[4] = (len >> 8) & 0xFF;
+		frame.data[5] = len & 0xFF;
+		hdr = 6;
+	} else {
+		return -CAN_ERROR_ISOTP_OVERFLOW;
+	}
+	n = tp->tx_dl - hdr;
+	memcpy(frame.data + hdr, data, n);
+	ret = isotp_write(tp, &frame, tp->tx_dl);
+	if (ret)
+		return ret;
+	off = n;
+
+	while (off < len) {
+		unsigned int blk, st_us;
+		uint8_t bs, st_min;
+
+		ret = isotp_wait_cts(tp, &bs, &st_min);
+		if (ret)
+			return ret;
+		st_us = isotp_stmin_us(st_min);
+
+		for (blk = 0; off < len && (!bs || blk < bs); blk++) {
+			if (blk && st_us)
+				usleep(st_us);
+
+			n = tp->tx_dl - 1;
+			if (n > len - off)
+				n = len - off;
+			frame.data[0] = ISOTP_PCI_CF | (sn++ & 0x0F);
+			memcpy(frame.data + 1, data + off, n);
+			ret = isotp_write(tp, &frame, n + 1);
+			if (ret)
+				return ret;
+			off += n;
+		}
+	}
+
+	return CAN_ERROR_NONE;
+}
+
+static int isotp_user_recv(ldx_can_isotp_t *tp, uint8_t *buf, size_t size,
+			   int timeout_ms)
+{
+	struct canfd_frame frame;
+	int64_t deadline = timeout_ms < 0 ? -1 : isotp_now_ms() + timeout_ms;
+	unsigned int hdr, n, sn = 1, blk = 0;
+	size_t total, off;
+	int ret;
+
+	for (;;) {
+		unsigned int pci;
+
+		ret = isotp_read(tp, &frame, deadline);
+		if (ret <= 0)
+			return ret;
+
+		pci = frame.data[0] & ISOTP_PCI_MASK;
+		if (pci == ISOTP_PCI_FF)
+			break;
+		if (pci != ISOTP_PCI_SF)
+			/* Stray consecutive or flow control frames */
+			continue;
+
+		total = frame.data[0] & 0x0F;
+		hdr = 1;
+		if (!total && frame.len > CAN_MAX_DLEN) {
+			total = frame.data[1];
+			hdr = 2;
+		}
+		/* Invalid single frames are ignored */
+		if (!total || total + hdr > frame.len)
+			continue;
+		if (total > size)
+			return -CAN_ERROR_ISOTP_OVERFLOW;
+
+		memcpy(buf, frame.data + hdr, total);
+		return total;
+	}
+
+	if (frame.len < 2)
+		return -CAN_ERROR_ISOTP_PROTOCOL;
+	total = ((frame.data[0] & 0x0F) << 8) | frame.data[1];
+	hdr = 2;
+	if (!total) {
+		if (frame.len < 6)
+			return -CAN_ERROR_ISOTP_PROTOCOL;
+		total = ((size_t)frame.data[2] << 24) | (frame.data[3] << 16) |
+			(frame.data[4] << 8) | frame.data[5];
+		hdr = 6;
+	}
+	/* A PDU that fits in a single frame must not be segmented */
+	if (total <= (frame.len > CAN_MAX_DLEN ? frame.len - 2U :
+		      CAN_MAX_DLEN - 1U)) {
+		log_error("%s: invalid first frame length on %s", __func__,
+			  tp->cif->name);
+		return -CAN_ERROR_ISOTP_PROTOCOL;
+	}
+	if (total > size || total > INT_MAX) {
+		isotp_send_fc(tp, ISOTP_FC_OVFLW);
+		return -CAN_ERROR_ISOTP_OVERFLOW;
+	}
+
+	n = frame.len - hdr;
+	if (n > total)
+		n = total;
+	memcpy(buf, frame.data + hdr, n);
+	off = n;
+
+	ret = isotp_send_fc(tp, ISOTP_FC_CTS);
+	if (ret)
+		return ret;
+
+	while (off < total) {
+		ret = isotp_read(tp, &frame,
+				 isotp_now_ms() + isotp_timeout_ms(tp));
+		if (ret < 0)
+			return ret;
+		if (ret == 0)
+			return -CAN_ERROR_ISOTP_TIMEOUT;
+
+		if ((frame.data[0] & ISOTP_PCI_MASK) != ISOTP_PCI_CF)
+			continue;
+		if ((frame.data[0] & 0x0F) != (sn & 0x0F)) {
+			log_error("%s: wrong sequence number on %s", __func__,
+				  tp->cif->name);
+			return -CAN_ERROR_ISOTP_PROTOCOL;
+		}
+		sn++;
+
+		n = frame.len - 1;
+		if (n > total - off)
+			n = total - off;
+		memcpy(buf + off, frame.data + 1, n);
+		off += n;
+
+		if (tp->cfg.block_size && ++blk == tp->cfg.block_size &&
+		    off < total) {
+			blk = 0;
+			ret = isotp_send_fc(tp, ISOTP_FC_CTS);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return total;
+}
+
+#ifdef SOL_CAN_ISOTP
+static int isotp_kernel_open(ldx_can_isotp_t *tp)
+{
+	can_priv_t *pdata = tp->cif->_data;
+	struct can_isotp_options opts;
+	struct can_isotp_fc_options fc;
+	struct sockaddr_can addr;
+	int fd;
+
+	fd = socket(PF_CAN, SOCK_DGRAM, CAN_ISOTP);
+	if (fd < 0)
+		return -1;
+
+	memset(&opts, 0, sizeof(opts));
+	opts.flags = tp->cfg.tx_padding ? CAN_ISOTP_TX_PADDING : 0;
+#ifdef CAN_ISOTP_WAIT_TX_DONE
+	/* Report the transmission errors in the write() call */
+	opts.flags |= CAN_ISOTP_WAIT_TX_DONE;
+#endif
+	opts.frame_txtime = CAN_ISOTP_DEFAULT_FRAME_TXTIME;
+	opts.txpad_content = tp->cfg.pad_byte;
+	opts.rxpad_content = tp->cfg.pad_byte;
+	if (setsockopt(fd, SOL_CAN_ISOTP, CAN_ISOTP_OPTS, &opts, sizeof(opts)))
+		goto err_close;
+
+	memset(&fc, 0, sizeof(fc));
+	fc.bs = tp->cfg.block_size;
+	fc.stmin = tp->cfg.st_min;
+	if (setsockopt(fd, SOL_CAN_ISOTP, CAN_ISOTP_RECV_FC, &fc, sizeof(fc)))
+		goto err_close;
+
+	if (tp->tx_dl > CAN_MAX_DLEN) {
+		struct can_isotp_ll_options ll;
+
+		memset(&ll, 0, sizeof(ll));
+		ll.mtu = CANFD_MTU;
+		ll.tx_dl = tp->tx_dl;
+		if (setsockopt(fd, SOL_CAN_ISOTP, CAN_ISOTP_LL_OPTS, &ll,
+			       sizeof(ll)))
+			goto err_close;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.can_family = AF_CAN;
+	addr.can_ifindex = pdata->addr.can_ifindex;
+	addr.can_addr.tp.tx_id = tp->cfg.tx_id;
+	addr.can_addr.tp.rx_id = tp->cfg.rx_id;
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)))
+		goto err_close;
+
+	return fd;
+
+err_close:
+	log_debug("%s: CAN_ISOTP setup error (%d) on %s", __func__, errno,
+		  tp->cif->name);
+	close(fd);
+
+	return -1;
+}
+
+static int isotp_kernel_send(ldx_can_isotp_t *tp, const void *buf, size_t len)
+{
+	ssize_t ret;
+
+	do {
+		ret = write(tp->fd, buf, len);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret == (ssize_t)len)
+		return CAN_ERROR_NONE;
+	if (ret >= 0)
+		return -CAN_ERROR_INCOMP_FRAME;
+
+	switch (errno) {
+	case EMSGSIZE:
+		return -CAN_ERROR_ISOTP_OVERFLOW;
+	case ECOMM:
+	case ETIMEDOUT:
+		return -CAN_ERROR_ISOTP_TIMEOUT;
+	case ENETDOWN:
+		return -CAN_ERROR_NETWORK_DOWN;
+	default:
+		log_error("%s: socket write error (%d) on %s", __func__, errno,
+			  tp->cif->name);
+		return -CAN_ERROR_TX_SKT_WR;
+	}
+}
+
+static int isotp_kernel_recv(ldx_can_isotp_t *tp, void *buf, size_t size,
+			     int timeout_ms)
+{
+	struct pollfd pfd = { .fd = tp->fd, .events = POLLIN };
+	struct iovec iov = { .iov_base = buf, .iov_len = size };
+	struct msghdr msg;
+	ssize_t ret;
+
+	do {
+		ret = poll(&pfd, 1, timeout_ms);
+	} while (ret < 0 && errno == EINTR);
+	if (ret <= 0)
+		return ret < 0 ? -CAN_ERROR_ISOTP_SKT : 0;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	ret = recvmsg(tp->fd, &msg, MSG_DONTWAIT);
+	if (ret < 0) {
+		if (errno == EAGAIN)
+			return 0;
+		if (errno == ENETDOWN)
+			return -CAN_ERROR_NETWORK_DOWN;
+		/* Reception errors, such as timeouts or wrong sequence numbers */
+		return -CAN_ERROR_ISOTP_PROTOCOL;
+	}
+	if (msg.msg_flags & MSG_TRUNC)
+		return -CAN_ERROR_ISOTP_OVERFLOW;
+
+	return ret;
+}
+#endif /* SOL_CAN_ISOTP */
+
+static int isotp_user_open(ldx_can_isotp_t *tp)
+{
+	struct can_filter filter;
+
+	filter.can_id = tp->cfg.rx_id;
+	filter.can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG |
+			  ((tp->cfg.rx_id & CAN_EFF_FLAG) ? CAN_EFF_MASK :
+							    CAN_SFF_MASK);
+
+	return ldx_can_open_rx_socket(tp->cif, &filter, 1);
+}
+
+ldx_can_isotp_t *ldx_can_isotp_open(can_if_t *cif,
+				    const ldx_can_isotp_cfg_t *cfg)
+{
+	ldx_can_isotp_t *tp;
+
+	if (!cif || !cfg)
+		return NULL;
+
+	tp = calloc(1, sizeof(ldx_can_isotp_t));
+	if (!tp) {
+		log_error("%s: Unable to allocate memory for ISO-TP session on %s",
+			  __func__, cif->name);
+		return NULL;
+	}
+
+	tp->cif = cif;
+	tp->cfg = *cfg;
+	tp->fd = -1;
+	if (cif->cfg.canfd_enabled) {
+		tp->tx_dl = CANFD_MAX_DLEN;
+		tp->mtu = CANFD_MTU;
+	} else {
+		tp->tx_dl = CAN_MAX_DLEN;
+		tp->mtu = CAN_MTU;
+	}
+
+#ifdef SOL_CAN_ISOTP
+	if (!cfg->no_offload) {
+		tp->fd = isotp_kernel_open(tp);
+		tp->offloaded = tp->fd >= 0;
+	}
+#endif
+
+	if (tp->fd < 0) {
+		log_debug("%s: Using the user space ISO-TP engine on %s",
+			  __func__, cif->name);
+		tp->fd = isotp_user_open(tp);
+		if (tp->fd < 0) {
+			log_error("%s: Unable to open ISO-TP socket on %s",
+				  __func__, cif->name);
+			free(tp);
+			return NULL;
+		}
+	}
+
+	return tp;
+}
+
+bool ldx_can_isotp_is_offloaded(const ldx_can_isotp_t *tp)
+{
+	return tp && tp->offloaded;
+}
+
+int ldx_can_isotp_get_fd(const ldx_can_isotp_t *tp)
+{
+	return tp ? tp->fd : -1;
+}
+
+int ldx_can_isotp_send(ldx_can_isotp_t *tp, const void *buf, size_t len)
+{
+	if (!tp)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	if (!len)
+		return CAN_ERROR_NONE;
+
+#ifdef SOL_CAN_ISOTP
+	if (tp->offloaded)
+		return isotp_kernel_send(tp, buf, len);
+#endif
+
+	return isotp_user_send(tp, buf, len);
+}
+
+int ldx_can_isotp_recv(ldx_can_isotp_t *tp, void *buf, size_t len,
+		       int timeout_ms)
+{
+	if (!tp)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+#ifdef SOL_CAN_ISOTP
+	if (tp->offloaded)
+		return isotp_kernel_recv(tp, buf, len, timeout_ms);
+#endif
+
+	return isotp_user_recv(tp, buf, len, timeout_ms);
+}
+
+void ldx_can_isotp_close(ldx_can_isotp_t *tp)
+{
+	if (!tp)
+		return;
+
+	if (tp->offloaded)
+		close(tp->fd);
+	else
+		ldx_can_close_rx_socket(tp->cif, tp->fd);
+	free(tp);
+}
@@ -25,12 +25,14 @@
 #include <linux/can/error.h>
 #include <linux/netlink.h>
 #include <linux/rtnetlink.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "can.h"
@@ -39,142 +41,1033 @@
 
 int ldx_can_get_state(const can_if_t *cif, enum can_state *state)
 {
+	ldx_can_link_snapshot_t snap;
 	int ret;
 
-	if (!cif)
-		return -CAN_ERROR_NULL_INTERFACE;
-
-	ret = can_get_state(cif->name, (int *)state);
+	ret = ldx_can_get_link_snapshot(cif, &snap);
+	if (ret == -CAN_ERROR_NULL_INTERFACE)
+		return ret;
 	if (ret) {
 		log_error("%s: Unable to get %s interface state",
 			  __func__, cif->name);
 		return -CAN_ERROR_NL_GET_STATE;
 	}
 
+	*state = snap.state;
+
 	return CAN_ERROR_NONE;
 }
 
 int ldx_can_get_dev_stats(const can_if_t *cif, struct can_device_stats *cds)
 {
+	ldx_can_link_snapshot_t snap;
 	int ret;
 
-	if (!cif)
-		return -CAN_ERROR_NULL_INTERFACE;
-
-	ret = can_get_device_stats(cif->name, cds);
-	if (ret) {
+	ret = ldx_can_get_link_snapshot(cif, &snap);
+	if (ret == -CAN_ERROR_NULL_INTERFACE)
+		return ret;
+	if (ret || !snap.has_stats) {
 		log_error("%s: Unable to get %s device stats",
 			  __func__, cif->name);
 		return -CAN_ERROR_NL_GET_DEV_STATS;
 	}
 
+	*cds = snap.stats;
+
 	return CAN_ERROR_NONE;
 }
 
 int ldx_can_get_bit_error_counter(const can_if_t *cif, struct can_berr_counter *bc)
 {
+	ldx_can_link_snapshot_t snap;
 	int ret;
 
-	if (!cif)
-		return -CAN_ERROR_NULL_INTERFACE;
-
-	ret = can_get_berr_counter(cif->name, bc);
-	if (ret) {
+	ret = ldx_can_get_link_snapshot(cif, &snap);
+	if (ret == -CAN_ERROR_NULL_INTERFACE)
+		return ret;
+	if (ret || !snap.has_berr) {
 		log_error("%s: Unable to get %s bit error counter",
 			  __func__, cif->name);
 		return -CAN_ERROR_NL_GET_BIT_ERR_CNT;
 	}
 
+	*bc = snap.berr;
+
 	return CAN_ERROR_NONE;
 }
 
-int ldx_can_start(const can_if_t *cif)
+/* Room for the attributes of a link configuration message */
+#define CAN_NL_ATTR_LEN		512
+
+/* Size of the buffer used to receive the netlink answers */
+#define CAN_NL_RECV_LEN		16384
+
+/* Default wait of 'ldx_can_link_config()' */
+#define CAN_NL_DEF_TOUT_MS	5000
+
+typedef struct {
+	struct nlmsghdr		n;
+	struct ifinfomsg	i;
+	char			buf[CAN_NL_ATTR_LEN];
+} can_nl_req_t;
+
+static int64_t can_nl_now_ms(void)
 {
-	int ret, state;
+	struct timespec ts;
 
-	if (!cif)
-		return -CAN_ERROR_NULL_INTERFACE;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-	ret = can_do_start(cif->name);
-	if (ret) {
-		log_error("%s: Unable to start %s interface",
+static struct rtattr *can_nl_tail(can_nl_req_t *req)
+{
+	return (struct rtattr *)((char *)req + NLMSG_ALIGN(req->n.nlmsg_len));
+}
+
+static void can_nl_addattr(can_nl_req_t *req, int type, const void *data,
+			   int len)
+{
+	struct rtattr *rta = can_nl_tail(req);
+
+	rta->rta_type = type;
+	rta->rta_len = RTA_LENGTH(len);
+	if (len)
+		memcpy(RTA_DATA(rta), data, len);
+	req->n.nlmsg_len = NLMSG_ALIGN(req->n.nlmsg_len) +
+			   RTA_ALIGN(rta->rta_len);
+}
+
+static struct rtattr *can_nl_nest_start(can_nl_req_t *req, int type)
+{
+	struct rtattr *nest = can_nl_tail(req);
+
+	can_nl_addattr(req, type, NULL, 0);
+
+	return nest;
+}
+
+static void can_nl_nest_end(can_nl_req_t *req, struct rtattr *nest)
+{
+	nest->rta_len = (char *)can_nl_tail(req) - (char *)nest;
+}
+
+static int can_nl_init_req(can_nl_req_t *req, const can_if_t *cif,
+			   uint16_t type, uint32_t seq)
+{
+	unsigned int ifindex = if_nametoindex(cif->name);
+
+	if (!ifindex) {
+		log_error("%s: Unable to get interface index on %s", __func__,
+			  cif->name);
+		return -CAN_ERROR_IFR_IDX;
+	}
+
+	memset(req, 0, sizeof(*req));
+	req->n.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg));
+	req->n.nlmsg_type = type;
+	req->n.nlmsg_flags = NLM_F_REQUEST;
+	req->n.nlmsg_seq = seq;
+	req->i.ifi_family = AF_UNSPEC;
+	req->i.ifi_index = ifindex;
+
+	return CAN_ERROR_NONE;
+}
+
+static bool can_nl_has_can_attrs(const can_if_cfg_t *cfg)
+{
+	return cfg->bit_timing.bitrate || cfg->dbit_timing.bitrate ||
+	       cfg->bitrate != LDX_CAN_INVALID_BITRATE ||
+	       cfg->dbitrate != LDX_CAN_INVALID_BITRATE ||
+	       cfg->restart_ms != LDX_CAN_INVALID_RESTART_MS ||
+	       cfg->ctrl_mode.mask != LDX_CAN_UNCONFIGURED_MASK;
+}
+
+/* A single RTM_NEWLINK carrying every link setting of the interface */
+static int can_nl_build_link(can_nl_req_t *req, const can_if_t *cif,
+			     const can_if_cfg_t *cfg, bool start, uint32_t seq)
+{
+	struct rtattr *linkinfo, *data;
+	int ret;
+
+	ret = can_nl_init_req(req, cif, RTM_NEWLINK, seq);
+	if (ret)
+		return ret;
+
+	req->n.nlmsg_flags |= NLM_F_ACK;
+	if (start) {
+		/* The kernel applies the CAN settings before the flags */
+		req->i.ifi_change = IFF_UP;
+		req->i.ifi_flags = IFF_UP;
+	}
+
+	/*
+	 * The kernel rejects CAN link data for devices of another kind, such
+	 * as vcan, so it is only sent when there is something to set.
+	 */
+	if (!can_nl_has_can_attrs(cfg))
+		return CAN_ERROR_NONE;
+
+	linkinfo = can_nl_nest_start(req, IFLA_LINKINFO);
+	can_nl_addattr(req, IFLA_INFO_KIND, "can", strlen("can"));
+	data = can_nl_nest_start(req, IFLA_INFO_DATA);
+
+	if (cfg->bit_timing.bitrate) {
+		can_nl_addattr(req, IFLA_CAN_BITTIMING, &cfg->bit_timing,
+			       sizeof(cfg->bit_timing));
+	} else if (cfg->bitrate != LDX_CAN_INVALID_BITRATE) {
+		struct can_bittiming bt = { .bitrate = cfg->bitrate };
+
+		can_nl_addattr(req, IFLA_CAN_BITTIMING, &bt, sizeof(bt));
+	}
+
+	if (cfg->dbit_timing.bitrate) {
+		can_nl_addattr(req, IFLA_CAN_DATA_BITTIMING,
+			       &cfg->dbit_timing, sizeof(cfg->dbit_timing));
+	} else if (cfg->dbitrate != LDX_CAN_INVALID_BITRATE) {
+		struct can_bittiming dbt = { .bitrate = cfg->dbitrate };
+
+		can_nl_addattr(req, IFLA_CAN_DATA_BITTIMING, &dbt,
+			       sizeof(dbt));
+	}
+
+	if (cfg->restart_ms != LDX_CAN_INVALID_RESTART_MS)
+		can_nl_addattr(req, IFLA_CAN_RESTART_MS, &cfg->restart_ms,
+			       sizeof(cfg->restart_ms));
+
+	if (cfg->ctrl_mode.mask != LDX_CAN_UNCONFIGURED_MASK)
+		can_nl_addattr(req, IFLA_CAN_CTRLMODE, &cfg->ctrl_mode,
+			       sizeof(cfg->ctrl_mode));
+
+	can_nl_nest_end(req, data);
+	can_nl_nest_end(req, linkinfo);
+
+	return CAN_ERROR_NONE;
+}
+
+/*
+ * Send one message per interface not flagged in 'skip', all of them in a
+ * single datagram. Message 'i' uses sequence number 'seq_base + i'.
+ */
+static int can_nl_send(ldx_can_link_req_t *req, bool verify, uint32_t seq_base,
+		       const bool *skip)
+{
+	size_t off = 0, step = NLMSG_ALIGN(sizeof(can_nl_req_t));
+	char *buf;
+	unsigned int i;
+	int ret = CAN_ERROR_NONE;
+
+	buf = calloc(req->n, step);
+	if (!buf)
+		return -CAN_ERROR_NO_MEM;
+
+	for (i = 0; i < req->n; i++) {
+		can_nl_req_t *msg = (can_nl_req_t *)(buf + off);
+
+		if (skip && skip[i])
+			continue;
+		if (verify)
+			ret = can_nl_init_req(msg, req->cifs[i], RTM_GETLINK,
+					      seq_base + i);
+		else
+			ret = can_nl_build_link(msg, req->cifs[i], &req->cfgs[i],
+						req->start, seq_base + i);
+		if (ret)
+			goto out;
+		off += NLMSG_ALIGN(msg->n.nlmsg_len);
+	}
+
+	if (off && send(req->fd, buf, off, 0) != (ssize_t)off) {
+		log_error("%s: netlink send error (%d)", __func__, errno);
+		ret = -CAN_ERROR_NL_SKT;
+	}
+
+out:
+	free(buf);
+
+	return ret;
+}
+
+/* Compare the link attributes read back with the configuration */
+static int can_nl_verify(const can_if_t *cif, const can_if_cfg_t *cfg,
+			 bool start, struct nlmsghdr *nh)
+{
+	struct ifinfomsg *ifi = NLMSG_DATA(nh);
+	const struct can_bittiming *bt = NULL, *dbt = NULL;
+	const struct can_ctrlmode *cm = NULL;
+	const uint32_t *restart_ms = NULL, *state = NULL;
+	struct rtattr *rta, *info = NULL, *data = NULL;
+	uint32_t bitrate;
+	int len;
+
+	len = nh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi));
+	for (rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type == IFLA_LINKINFO)
+			info = rta;
+	}
+	if (info) {
+		len = RTA_PAYLOAD(info);
+		for (rta = RTA_DATA(info); RTA_OK(rta, len);
+		     rta = RTA_NEXT(rta, len)) {
+			if (rta->rta_type == IFLA_INFO_DATA)
+				data = rta;
+		}
+	}
+	if (!data && can_nl_has_can_attrs(cfg)) {
+		log_error("%s: Unable to get %s link info", __func__,
+			  cif->name);
+		return -CAN_ERROR_NL_GET_STATE;
+	}
+
+	len = data ? RTA_PAYLOAD(data) : 0;
+	for (rta = data ? RTA_DATA(data) : NULL; RTA_OK(rta, len);
+	     rta = RTA_NEXT(rta, len)) {
+		switch (rta->rta_type) {
+		case IFLA_CAN_BITTIMING:
+			bt = RTA_DATA(rta);
+			break;
+		case IFLA_CAN_DATA_BITTIMING:
+			dbt = RTA_DATA(rta);
+			break;
+		case IFLA_CAN_RESTART_MS:
+			restart_ms = RTA_DATA(rta);
+			break;
+		case IFLA_CAN_CTRLMODE:
+			cm = RTA_DATA(rta);
+			break;
+		case IFLA_CAN_STATE:
+			state = RTA_DATA(rta);
+			break;
+		}
+	}
+
+	bitrate = cfg->bit_timing.bitrate ? cfg->bit_timing.bitrate :
+		  cfg->bitrate;
+	if (bitrate != LDX_CAN_INVALID_BITRATE &&
+	    (!bt || bt->bitrate != bitrate)) {
+		log_error("%s: on %s bitrate set does not match bitrate read",
 			  __func__, cif->name);
-		return -CAN_ERROR_NL_START;
+		return -CAN_ERROR_NL_BR_MISSMATCH;
 	}
 
-	if (cif->cfg.nl_cmd_verify) {
-		ret = can_get_state(cif->name, &state);
-		if (ret) {
-			log_error("%s: Unable to get %s interface state",
-				  __func__, cif->name);
-			return -CAN_ERROR_NL_GET_STATE;
+	bitrate = cfg->dbit_timing.bitrate ? cfg->dbit_timing.bitrate :
+		  cfg->dbitrate;
+	if (bitrate != LDX_CAN_INVALID_BITRATE &&
+	    (!dbt || dbt->bitrate != bitrate)) {
+		log_error("%s: on %s data bitrate set does not match data bitrate read",
+			  __func__, cif->name);
+		return -CAN_ERROR_NL_BR_MISSMATCH;
+	}
+
+	if (cfg->restart_ms != LDX_CAN_INVALID_RESTART_MS &&
+	    (!restart_ms || *restart_ms != cfg->restart_ms)) {
+		log_error("%s: on %s restart ms set does not match value read",
+			  __func__, cif->name);
+		return -CAN_ERROR_NL_RSTMS_MISSMATCH;
+	}
+
+	if (cfg->ctrl_mode.mask != LDX_CAN_UNCONFIGURED_MASK &&
+	    (!cm || ((cm->flags ^ cfg->ctrl_mode.flags) & cfg->ctrl_mode.mask))) {
+		log_error("%s: on %s control mode set does not match with control mode read",
+			  __func__, cif->name);
+		return -CAN_ERROR_NL_CTRL_MISSMATCH;
+	}
+
+	/* Links without CAN data, such as vcan, only report their flags */
+	if (start && (state ? *state != CAN_STATE_ERROR_ACTIVE :
+			      !(ifi->ifi_flags & IFF_UP))) {
+		log_error("%s: Unexpected state %d, in %s interface", __func__,
+			  state ? (int)*state : -1, cif->name);
+		return -CAN_ERROR_NL_STATE_MISSMATCH;
+	}
+
+	return CAN_ERROR_NONE;
+}
+
+/*
+ * Collect the answers to the messages sent with 'seq_base' until every
+ * entry of 'done' is set or the deadline expires.
+ */
+static int can_nl_collect(ldx_can_link_req_t *req, int64_t deadline,
+			  uint32_t seq_base, bool verify, int *res, bool *done)
+{
+	unsigned int i, pending = 0;
+	char *buf;
+	int ret = CAN_ERROR_NONE;
+
+	for (i = 0; i < req->n; i++)
+		pending += !done[i];
+	if (!pending)
+		return CAN_ERROR_NONE;
+
+	buf = malloc(CAN_NL_RECV_LEN);
+	if (!buf)
+		return -CAN_ERROR_NO_MEM;
+
+	while (pending) {
+		struct pollfd pfd = { .fd = req->fd, .events = POLLIN };
+		int tout = -1, len;
+		struct nlmsghdr *nh;
+
+		if (deadline >= 0) {
+			int64_t left = deadline - can_nl_now_ms();
+
+			tout = left > 0 ? (int)left : 0;
+		}
+		len = poll(&pfd, 1, tout);
+		if (len == 0) {
+			ret = -CAN_ERROR_NL_TIMEOUT;
+			break;
 		}
 
-		if (state != CAN_STATE_ERROR_ACTIVE) {
-			log_error("%s: Unexpected state %d, in %s interface",
-				  __func__, state, cif->name);
-			return -CAN_ERROR_NL_STATE_MISSMATCH;
+		len = recv(req->fd, buf, CAN_NL_RECV_LEN, 0);
+		if (len < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			log_error("%s: netlink recv error (%d)", __func__, errno);
+			ret = -CAN_ERROR_NL_SKT;
+			break;
+		}
+
+		for (nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, (unsigned int)len);
+		     nh = NLMSG_NEXT(nh, len)) {
+			i = nh->nlmsg_seq - seq_base;
+			if (i >= req->n || done[i])
+				continue;
+
+			if (nh->nlmsg_type == NLMSG_ERROR) {
+				struct nlmsgerr *err = NLMSG_DATA(nh);
+
+				res[i] = CAN_ERROR_NONE;
+				if (err->error) {
+					log_error("%s: Unable to %s %s link (%d)",
+						  __func__,
+						  verify ? "read" : "configure",
+						  req->cifs[i]->name, -err->error);
+					res[i] = verify ? -CAN_ERROR_NL_GET_STATE :
+							  -CAN_ERROR_NL_SET_LINK;
+				}
+			} else if (verify && nh->nlmsg_type == RTM_NEWLINK) {
+				res[i] = can_nl_verify(req->cifs[i],
+						       &req->cfgs[i], req->start,
+						       nh);
+			} else {
+				continue;
+			}
+			done[i] = true;
+			pending--;
 		}
 	}
 
+	free(buf);
+
+	return ret;
+}
+
+static void can_nl_req_free(ldx_can_link_req_t *req)
+{
+	if (req->fd >= 0)
+		close(req->fd);
+	free(req->cfgs);
+	free(req->cifs);
+	free(req);
+}
+
+ldx_can_link_req_t *ldx_can_link_config_send(can_if_t *const *cifs,
+					     const can_if_cfg_t *cfgs,
+					     unsigned int n, bool start)
+{
+	struct sockaddr_nl addr;
+	ldx_can_link_req_t *req;
+	unsigned int i;
+
+	if (!cifs || !cfgs || !n)
+		return NULL;
+
+	for (i = 0; i < n; i++) {
+		if (!cifs[i])
+			return NULL;
+	}
+
+	req = calloc(1, sizeof(ldx_can_link_req_t));
+	if (!req) {
+		log_error("%s: Unable to allocate memory for link request",
+			  __func__);
+		return NULL;
+	}
+	req->fd = -1;
+	req->n = n;
+	req->start = start;
+	req->cifs = calloc(n, sizeof(*req->cifs));
+	req->cfgs = calloc(n, sizeof(*req->cfgs));
+	if (!req->cifs || !req->cfgs) {
+		log_error("%s: Unable to allocate memory for link request",
+			  __func__);
+		goto err_free;
+	}
+	memcpy(req->cifs, cifs, n * sizeof(*req->cifs));
+	memcpy(req->cfgs, cfgs, n * sizeof(*req->cfgs));
+
+	req->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+			 NETLINK_ROUTE);
+	if (req->fd < 0) {
+		log_error("%s: Unable to create netlink socket", __func__);
+		goto err_free;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	if (bind(req->fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		log_error("%s: netlink socket bind error (%d)", __func__, errno);
+		goto err_free;
+	}
+
+	if (can_nl_send(req, false, 1, NULL))
+		goto err_free;
+
+	return req;
+
+err_free:
+	can_nl_req_free(req);
+
+	return NULL;
+}
+
+int ldx_can_link_config_get_fd(const ldx_can_link_req_t *req)
+{
+	return req ? req->fd : -1;
+}
+
+int ldx_can_link_config_wait(ldx_can_link_req_t *req, int timeout_ms,
+			     int *errors)
+{
+	int64_t deadline = -1;
+	unsigned int i;
+	bool *done;
+	int *res;
+	int ret;
+
+	if (!req)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	if (timeout_ms >= 0)
+		deadline = can_nl_now_ms() + timeout_ms;
+
+	res = calloc(req->n, sizeof(*res));
+	done = calloc(req->n, sizeof(*done));
+	if (!res || !done) {
+		ret = -CAN_ERROR_NO_MEM;
+		goto out;
+	}
+
+	/* Request 'i' was sent with sequence number 'i + 1' */
+	ret = can_nl_collect(req, deadline, 1, false, res, done);
+
+	if (!ret) {
+		/* Read back, again in one go, what needs verification */
+		for (i = 0; i < req->n; i++)
+			done[i] = res[i] || !req->cfgs[i].nl_cmd_verify;
+		ret = can_nl_send(req, true, req->n + 1, done);
+		if (!ret)
+			ret = can_nl_collect(req, deadline, req->n + 1, true,
+					     res, done);
+	}
+
+	for (i = 0; i < req->n; i++) {
+		if (!done[i])
+			res[i] = ret ? ret : -CAN_ERROR_NL_TIMEOUT;
+		if (errors)
+			errors[i] = res[i];
+		if (!ret)
+			ret = res[i];
+	}
+
+out:
+	free(done);
+	free(res);
+	can_nl_req_free(req);
+
+	return ret;
+}
+
+int ldx_can_link_config(can_if_t *const *cifs, const can_if_cfg_t *cfgs,
+			unsigned int n, bool start)
+{
+	ldx_can_link_req_t *req;
+
+	req = ldx_can_link_config_send(cifs, cfgs, n, start);
+	if (!req)
+		return -CAN_ERROR_NL_SKT;
+
+	return ldx_can_link_config_wait(req, CAN_NL_DEF_TOUT_MS, NULL);
+}
+
+static struct rtattr *can_nl_find_attr(struct rtattr *rta, int len, int type)
+{
+	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type == type)
+			return rta;
+	}
+
+	return NULL;
+}
+
+static void can_nl_parse_link(struct nlmsghdr *nh,
+			      ldx_can_link_snapshot_t *snap)
+{
+	struct ifinfomsg *ifi = NLMSG_DATA(nh);
+	struct rtattr *info, *data, *rta;
+
+	memset(snap, 0, sizeof(*snap));
+	snap->running = (ifi->ifi_flags & (IFF_UP | IFF_RUNNING)) ==
+			(IFF_UP | IFF_RUNNING);
+	snap->state = snap->running ? CAN_STATE_ERROR_ACTIVE : CAN_STATE_STOPPED;
+
+	info = can_nl_find_attr(IFLA_RTA(ifi),
+				nh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifi)),
+				IFLA_LINKINFO);
+	if (!info)
+		return;
+
+	rta = can_nl_find_attr(RTA_DATA(info), RTA_PAYLOAD(info),
+			       IFLA_INFO_XSTATS);
+	if (rta && RTA_PAYLOAD(rta) >= sizeof(snap->stats)) {
+		memcpy(&snap->stats, RTA_DATA(rta), sizeof(snap->stats));
+		snap->has_stats = true;
+	}
+
+	data = can_nl_find_attr(RTA_DATA(info), RTA_PAYLOAD(info),
+				IFLA_INFO_DATA);
+	if (!data)
+		return;
+
+	rta = can_nl_find_attr(RTA_DATA(data), RTA_PAYLOAD(data),
+			       IFLA_CAN_STATE);
+	if (rta)
+		snap->state = *(uint32_t *)RTA_DATA(rta);
+
+	rta = can_nl_find_attr(RTA_DATA(data), RTA_PAYLOAD(data),
+			       IFLA_CAN_BITTIMING);
+	if (rta && RTA_PAYLOAD(rta) >= sizeof(snap->bt)) {
+		memcpy(&snap->bt, RTA_DATA(rta), sizeof(snap->bt));
+		snap->has_bt = true;
+	}
+
+	rta = can_nl_find_attr(RTA_DATA(data), RTA_PAYLOAD(data),
+			       IFLA_CAN_DATA_BITTIMING);
+	if (rta && RTA_PAYLOAD(rta) >= sizeof(snap->dbt)) {
+		memcpy(&snap->dbt, RTA_DATA(rta), sizeof(snap->dbt));
+		snap->has_dbt = true;
+	}
+
+	rta = can_nl_find_attr(RTA_DATA(data), RTA_PAYLOAD(data),
+			       IFLA_CAN_BERR_COUNTER);
+	if (rta && RTA_PAYLOAD(rta) >= sizeof(snap->berr)) {
+		memcpy(&snap->berr, RTA_DATA(rta), sizeof(snap->berr));
+		snap->has_berr = true;
+	}
+}
+
+static void can_nl_parse_link_evt(struct nlmsghdr *nh, ldx_can_link_event_t *evt)
+{
+	ldx_can_link_snapshot_t snap;
+
+	can_nl_parse_link(nh, &snap);
+
+	/* Events are compared as a whole, padding included */
+	memset(evt, 0, sizeof(*evt));
+	evt->state = snap.state;
+	evt->running = snap.running;
+	evt->has_berr = snap.has_berr;
+	evt->has_stats = snap.has_stats;
+	evt->berr = snap.berr;
+	evt->stats = snap.stats;
+}
+
+/* Ask for the link of the interface, the answer is read by the event loop */
+static int can_nl_request_link(const can_if_t *cif)
+{
+	can_priv_t *pdata = cif->_data;
+	can_nl_req_t req;
+	int ret;
+
+	ret = can_nl_init_req(&req, cif, RTM_GETLINK, 0);
+	if (ret)
+		return ret;
+
+	if (send(pdata->link_cb.rx_skt, &req, req.n.nlmsg_len, 0) < 0) {
+		log_error("%s: netlink send error (%d) on %s", __func__, errno,
+			  cif->name);
+		return -CAN_ERROR_NL_SKT;
+	}
+
 	return CAN_ERROR_NONE;
 }
 
-int ldx_can_stop(const can_if_t *cif)
+int ldx_can_process_link_socket(const can_if_t *cif)
+{
+	can_priv_t *pdata = cif->_data;
+	char buf[CAN_NL_RECV_LEN] __attribute__((aligned(NLMSG_ALIGNTO)));
+	ldx_can_link_event_t evt;
+	struct nlmsghdr *nh;
+	int len;
+
+	/* The subscription may have been cancelled by a handler of this wait */
+	while (pdata->link_cb.rx_skt >= 0) {
+		len = recv(pdata->link_cb.rx_skt, buf, sizeof(buf), MSG_DONTWAIT);
+		if (len < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			if (errno == EINTR)
+				continue;
+			if (errno == ENOBUFS) {
+				/* Notifications were lost, read the current status */
+				log_debug("%s: link events overrun on %s", __func__,
+					  cif->name);
+				can_nl_request_link(cif);
+				continue;
+			}
+			log_error("%s: netlink recv error (%d) on %s", __func__,
+				  errno, cif->name);
+			return -CAN_ERROR_NL_SKT;
+		}
+
+		for (nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, (unsigned int)len);
+		     nh = NLMSG_NEXT(nh, len)) {
+			struct ifinfomsg *ifi = NLMSG_DATA(nh);
+
+			if (nh->nlmsg_type != RTM_NEWLINK ||
+			    ifi->ifi_index != pdata->addr.can_ifindex)
+				continue;
+
+			/* Only the changes are reported */
+			can_nl_parse_link_evt(nh, &evt);
+			if (!memcmp(&evt, &pdata->link_evt, sizeof(evt)))
+				continue;
+			pdata->link_evt = evt;
+			ldx_can_call_err_cb(cif, CAN_ERROR_LINK_EVENT, &evt);
+		}
+	}
+
+	return 0;
+}
+
+int ldx_can_subscribe_link_events(can_if_t *cif)
 {
-	int ret, state;
+	struct sockaddr_nl addr;
+	can_priv_t *pdata;
+	int ret, skt;
 
 	if (!cif)
 		return -CAN_ERROR_NULL_INTERFACE;
 
-	ret = can_do_stop(cif->name);
+	pdata = cif->_data;
+
+	ret = ldx_can_lock_mutex(cif, __func__);
+	if (ret)
+		return ret;
+
+	if (pdata->link_cb.rx_skt >= 0)
+		goto out;
+
+	skt = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+		     NETLINK_ROUTE);
+	if (skt < 0) {
+		log_error("%s: Unable to create netlink socket on %s", __func__,
+			  cif->name);
+		ret = -CAN_ERROR_NL_SKT;
+		goto out;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = RTMGRP_LINK;
+	if (bind(skt, (struct sockaddr *)&addr, sizeof(addr))) {
+		log_error("%s: netlink socket bind error (%d) on %s", __func__,
+			  errno, cif->name);
+		close(skt);
+		ret = -CAN_ERROR_NL_SKT;
+		goto out;
+	}
+
+	pdata->link_cb.rx_skt = skt;
+	pdata->link_cb.handler = NULL;
+	ret = ldx_can_epoll_add(cif, &pdata->link_cb);
+	if (ret)
+		goto err_close;
+
+	/* Report the current status as the first event */
+	memset(&pdata->link_evt, 0, sizeof(pdata->link_evt));
+	pdata->link_evt.state = CAN_STATE_MAX;
+	ret = can_nl_request_link(cif);
 	if (ret) {
-		log_error("%s: Unable to stop %s interface",
-			  __func__, cif->name);
-		return -CAN_ERROR_NL_STOP;
+		epoll_ctl(pdata->epfd, EPOLL_CTL_DEL, skt, NULL);
+		goto err_close;
 	}
 
-	if (cif->cfg.nl_cmd_verify) {
-		ret = can_get_state(cif->name, &state);
-		if (ret) {
-			log_error("%s: Unable to get %s interface state",
-				  __func__, cif->name);
-			return -CAN_ERROR_NL_GET_STATE;
+	goto out;
+
+err_close:
+	close(skt);
+	pdata->link_cb.rx_skt = -1;
+out:
+	ldx_can_unlock_mutex(cif);
+
+	return ret;
+}
+
+int ldx_can_refresh_link_event(const can_if_t *cif)
+{
+	can_priv_t *pdata;
+	int ret;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	pdata = cif->_data;
+
+	ret = ldx_can_lock_mutex(cif, __func__);
+	if (ret)
+		return ret;
+
+	if (pdata->link_cb.rx_skt < 0) {
+		log_error("%s: %s is not subscribed to link events", __func__,
+			  cif->name);
+		ret = -CAN_ERROR_NL_SKT;
+	} else {
+		ret = can_nl_request_link(cif);
+	}
+
+	ldx_can_unlock_mutex(cif);
+
+	return ret;
+}
+
+int ldx_can_unsubscribe_link_events(const can_if_t *cif)
+{
+	can_priv_t *pdata;
+	int ret;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	pdata = cif->_data;
+
+	ret = ldx_can_lock_mutex(cif, __func__);
+	if (ret)
+		return ret;
+
+	if (pdata->link_cb.rx_skt >= 0) {
+		epoll_ctl(pdata->epfd, EPOLL_CTL_DEL, pdata->link_cb.rx_skt,
+			  NULL);
+		close(pdata->link_cb.rx_skt);
+		pdata->link_cb.rx_skt = -1;
+	}
+
+	ldx_can_unlock_mutex(cif);
+
+	return ret;
+}
+
+static int can_nl_open_query_skt(const can_if_t *cif)
+{
+	struct sockaddr_nl addr;
+	int skt;
+
+	skt = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+		     NETLINK_ROUTE);
+	if (skt < 0) {
+		log_error("%s: Unable to create netlink socket on %s", __func__,
+			  cif->name);
+		return -CAN_ERROR_NL_SKT;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.nl_family = AF_NETLINK;
+	if (bind(skt, (struct sockaddr *)&addr, sizeof(addr))) {
+		log_error("%s: netlink socket bind error (%d) on %s", __func__,
+			  errno, cif->name);
+		close(skt);
+		return -CAN_ERROR_NL_SKT;
+	}
+
+	return skt;
+}
+
+/*
+ * Send a message on the cached socket and wait for its answer. A
+ * RTM_NEWLINK answer is parsed into 'snap'. Kernel errors are logged and
+ * reported as 'err_code'. Must be called with 'nl_mutex' held.
+ */
+static int can_nl_exchange(const can_if_t *cif, struct nlmsghdr *msg,
+			   ldx_can_link_snapshot_t *snap, int err_code)
+{
+	can_priv_t *pdata = cif->_data;
+	char buf[CAN_NL_RECV_LEN] __attribute__((aligned(NLMSG_ALIGNTO)));
+	int64_t deadline;
+	struct nlmsghdr *nh;
+	int ret, len;
+
+	if (pdata->nl_skt < 0) {
+		ret = can_nl_open_query_skt(cif);
+		if (ret < 0)
+			return ret;
+		pdata->nl_skt = ret;
+	}
+
+	msg->nlmsg_seq = ++pdata->nl_seq;
+	if (send(pdata->nl_skt, msg, msg->nlmsg_len, 0) < 0) {
+		log_error("%s: netlink send error (%d) on %s", __func__, errno,
+			  cif->name);
+		return -CAN_ERROR_NL_SKT;
+	}
+
+	deadline = can_nl_now_ms() + CAN_NL_DEF_TOUT_MS;
+	for (;;) {
+		struct pollfd pfd = { .fd = pdata->nl_skt, .events = POLLIN };
+		int64_t left = deadline - can_nl_now_ms();
+
+		if (left <= 0 || !poll(&pfd, 1, (int)left)) {
+			log_error("%s: no netlink answer on %s", __func__,
+				  cif->name);
+			return -CAN_ERROR_NL_TIMEOUT;
 		}
 
-		if (state != CAN_STATE_STOPPED) {
-			log_error("%s: Unexpected state %d, in %s interface",
-				  __func__, state, cif->name);
-			return -CAN_ERROR_NL_STATE_MISSMATCH;
+		len = recv(pdata->nl_skt, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			log_error("%s: netlink recv error (%d) on %s", __func__,
+				  errno, cif->name);
+			return -CAN_ERROR_NL_SKT;
+		}
+
+		for (nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, (unsigned int)len);
+		     nh = NLMSG_NEXT(nh, len)) {
+			/* Late answers of timed out requests are discarded */
+			if (nh->nlmsg_seq != pdata->nl_seq)
+				continue;
+
+			if (nh->nlmsg_type == NLMSG_ERROR) {
+				struct nlmsgerr *err = NLMSG_DATA(nh);
+
+				if (!err->error)
+					return CAN_ERROR_NONE;
+				log_error("%s: netlink request %u failed (%d) on %s",
+					  __func__, msg->nlmsg_type, -err->error,
+					  cif->name);
+				return -err_code;
+			}
+			if (snap && nh->nlmsg_type == RTM_NEWLINK) {
+				can_nl_parse_link(nh, snap);
+				return CAN_ERROR_NONE;
+			}
 		}
 	}
+}
+
+static int can_nl_lock(const can_if_t *cif, const char *fn)
+{
+	can_priv_t *pdata = cif->_data;
+
+	if (pthread_mutex_lock(&pdata->nl_mutex)) {
+		log_error("%s: error mutex lock %s", fn, cif->name);
+		return -CAN_ERROR_THREAD_MUTEX_LOCK;
+	}
 
 	return CAN_ERROR_NONE;
 }
 
-int ldx_can_restart(const can_if_t *cif)
+int ldx_can_nl_request(const can_if_t *cif, struct nlmsghdr *msg, int err_code)
 {
-	int ret, state;
+	can_priv_t *pdata = cif->_data;
+	int ret;
+
+	ret = can_nl_lock(cif, __func__);
+	if (ret)
+		return ret;
+
+	msg->nlmsg_flags |= NLM_F_REQUEST | NLM_F_ACK;
+	ret = can_nl_exchange(cif, msg, NULL, err_code);
+
+	pthread_mutex_unlock(&pdata->nl_mutex);
+
+	return ret;
+}
+
+int ldx_can_get_link_snapshot(const can_if_t *cif,
+			      ldx_can_link_snapshot_t *snap)
+{
+	can_priv_t *pdata;
+	can_nl_req_t req;
+	int ret;
 
 	if (!cif)
 		return -CAN_ERROR_NULL_INTERFACE;
+	if (!snap)
+		return -CAN_ERROR_NL_GET_STATE;
 
-	ret = can_do_restart(cif->name);
-	if (ret) {
-		log_error("%s: Unable to restart %s interface",
-			  __func__, cif->name);
-		return -CAN_ERROR_NL_RESTART;
+	pdata = cif->_data;
+
+	ret = can_nl_init_req(&req, cif, RTM_GETLINK, 0);
+	if (ret)
+		return ret;
+
+	ret = can_nl_lock(cif, __func__);
+	if (ret)
+		return ret;
+
+	ret = can_nl_exchange(cif, &req.n, snap, CAN_ERROR_NL_GET_STATE);
+
+	pthread_mutex_unlock(&pdata->nl_mutex);
+
+	return ret;
+}
+
+enum {
+	CAN_NL_START,
+	CAN_NL_STOP,
+	CAN_NL_RESTART,
+};
+
+/* Bring the link up or down, or restart it after a bus-off */
+static int can_nl_set_running(const can_if_t *cif, int op, int err_code)
+{
+	enum can_state state, expected = CAN_STATE_ERROR_ACTIVE;
+	can_nl_req_t req;
+	int ret;
+
+	ret = can_nl_init_req(&req, cif, RTM_NEWLINK, 0);
+	if (ret)
+		return ret;
+
+	if (op == CAN_NL_RESTART) {
+		struct rtattr *linkinfo, *data;
+		uint32_t restart = 1;
+
+		linkinfo = can_nl_nest_start(&req, IFLA_LINKINFO);
+		can_nl_addattr(&req, IFLA_INFO_KIND, "can", strlen("can"));
+		data = can_nl_nest_start(&req, IFLA_INFO_DATA);
+		can_nl_addattr(&req, IFLA_CAN_RESTART, &restart,
+			       sizeof(restart));
+		can_nl_nest_end(&req, data);
+		can_nl_nest_end(&req, linkinfo);
+	} else {
+		req.i.ifi_change = IFF_UP;
+		req.i.ifi_flags = op == CAN_NL_START ? IFF_UP : 0;
+		if (op == CAN_NL_STOP)
+			expected = CAN_STATE_STOPPED;
 	}
 
+	ret = ldx_can_nl_request(cif, &req.n, err_code);
+	if (ret)
+		return ret;
+
 	if (cif->cfg.nl_cmd_verify) {
-		ret = can_get_state(cif->name, &state);
-		if (ret) {
-			log_error("%s: Unable to get %s interface state",
-				  __func__, cif->name);
-			return -CAN_ERROR_NL_GET_STATE;
-		}
+		ret = ldx_can_get_state(cif, &state);
+		if (ret)
+			return ret;
 
-		if (state != CAN_STATE_ERROR_ACTIVE) {
+		if (state != expected) {
 			log_error("%s: Unexpected state %d, in %s interface",
 				  __func__, state, cif->name);
 			return -CAN_ERROR_NL_STATE_MISSMATCH;
@@ -184,200 +1077,179 @@ int ldx_can_restart(const can_if_t *cif)
 	return CAN_ERROR_NONE;
 }
 
+int ldx_can_start(const can_if_t *cif)
+{
+	int ret;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	ret = can_nl_set_running(cif, CAN_NL_START, CAN_ERROR_NL_START);
+	if (ret)
+		log_error("%s: Unable to start %s interface", __func__,
+			  cif->name);
+
+	return ret;
+}
+
+int ldx_can_stop(const can_if_t *cif)
+{
+	int ret;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	ret = can_nl_set_running(cif, CAN_NL_STOP, CAN_ERROR_NL_STOP);
+	if (ret)
+		log_error("%s: Unable to stop %s interface", __func__,
+			  cif->name);
+
+	return ret;
+}
+
+int ldx_can_restart(const can_if_t *cif)
+{
+	int ret;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	ret = can_nl_set_running(cif, CAN_NL_RESTART, CAN_ERROR_NL_RESTART);
+	if (ret)
+		log_error("%s: Unable to restart %s interface", __func__,
+			  cif->name);
+
+	return ret;
+}
+
+/* A configuration where nothing but the verification mode is set */
+static void can_nl_attr_cfg(const can_if_t *cif, can_if_cfg_t *cfg)
+{
+	memset(cfg, 0, sizeof(*cfg));
+	ldx_can_set_defconfig(cfg);
+	cfg->nl_cmd_verify = cif->cfg.nl_cmd_verify;
+}
+
+/*
+ * Apply the single setting configured in 'cfg', verifying it if the
+ * interface is configured so. Kernel errors are reported as 'err_code'.
+ */
+static int can_nl_set_attr(can_if_t *cif, const can_if_cfg_t *cfg,
+			   int err_code)
+{
+	int ret;
+
+	ret = ldx_can_link_config(&cif, cfg, 1, false);
+	if (ret == -CAN_ERROR_NL_SET_LINK)
+		return -err_code;
+
+	return ret;
+}
+
 int ldx_can_set_bitrate(can_if_t *cif, uint32_t bitrate)
 {
+	can_if_cfg_t cfg;
 	int ret;
-	struct can_bittiming bt;
 
 	if (!cif)
 		return -CAN_ERROR_NULL_INTERFACE;
 
-	ret = can_set_bitrate(cif->name, bitrate);
-	if (ret) {
+	can_nl_attr_cfg(cif, &cfg);
+	cfg.bitrate = bitrate;
+	ret = can_nl_set_attr(cif, &cfg, CAN_ERROR_NL_BITRATE);
+	if (ret)
 		log_error("%s: Unable to set bitrate to %u",
 			  __func__, bitrate);
-		return -CAN_ERROR_NL_BITRATE;
-	}
-
-	if (cif->cfg.nl_cmd_verify) {
-		ret = can_get_bittiming(cif->name, &bt);
-		if (ret) {
-			log_error("%s: Unable to get %s bit timing info",
-				  __func__, cif->name);
-			return -CAN_ERROR_NL_GET_BIT_TIMING;
-		}
 
-		if (bt.bitrate != bitrate) {
-			log_error("%s: on %s bitrate set does not match bitrate read",
-				  __func__, cif->name);
-			return -CAN_ERROR_NL_BR_MISSMATCH;
-		}
-	}
-
-	return CAN_ERROR_NONE;
+	return ret;
 }
 
 int ldx_can_set_data_bitrate(can_if_t *cif, uint32_t dbitrate)
 {
+	can_if_cfg_t cfg;
 	int ret;
-	struct can_bittiming dbt;
 
 	if (!cif)
 		return -CAN_ERROR_NULL_INTERFACE;
 
-	ret = can_set_data_bitrate(cif->name, dbitrate);
-	if (ret) {
+	can_nl_attr_cfg(cif, &cfg);
+	cfg.dbitrate = dbitrate;
+	ret = can_nl_set_attr(cif, &cfg, CAN_ERROR_NL_BITRATE);
+	if (ret)
 		log_error("%s: Unable to set data bitrate to %u",
 			  __func__, dbitrate);
-		return -CAN_ERROR_NL_BITRATE;
-	}
-
-	if (cif->cfg.nl_cmd_verify) {
-		ret = can_get_data_bittiming(cif->name, &dbt);
-		if (ret) {
-			log_error("%s: Unable to get %s bit timing info",
-				  __func__, cif->name);
-			return -CAN_ERROR_NL_GET_BIT_TIMING;
-		}
-
-		if (dbt.bitrate != dbitrate) {
-			log_error("%s: on %s data bitrate set does not match data bitrate read",
-				  __func__, cif->name);
-			return -CAN_ERROR_NL_BR_MISSMATCH;
-		}
-	}
 
-	return CAN_ERROR_NONE;
+	return ret;
 }
 
 int ldx_can_set_restart_ms(can_if_t *cif, uint32_t restart_ms)
 {
+	can_if_cfg_t cfg;
 	int ret;
-	uint32_t read_restart_ms;
 
 	if (!cif)
 		return -CAN_ERROR_NULL_INTERFACE;
 
-	ret = can_set_restart_ms(cif->name, restart_ms);
-	if (ret) {
+	can_nl_attr_cfg(cif, &cfg);
+	cfg.restart_ms = restart_ms;
+	ret = can_nl_set_attr(cif, &cfg, CAN_ERROR_NL_SET_RESTART_MS);
+	if (ret)
 		log_error("%s: Unable to set restart ms to %u",
 			  __func__, restart_ms);
-		return -CAN_ERROR_NL_SET_RESTART_MS;
-	}
-
-	if (cif->cfg.nl_cmd_verify) {
-		ret = can_get_restart_ms(cif->name, &read_restart_ms);
-		if (ret) {
-			log_error("%s: Unable read restart ms value",
-				  __func__);
-			return -CAN_ERROR_NL_GET_RESTART_MS;
-		}
-
-		if (restart_ms != read_restart_ms)
-			return -CAN_ERROR_NL_RSTMS_MISSMATCH;
-	}
 
-	return CAN_ERROR_NONE;
+	return ret;
 }
 
 int ldx_can_set_bit_timing(can_if_t *cif, struct can_bittiming *bt)
 {
+	can_if_cfg_t cfg;
 	int ret;
-	struct can_bittiming bt_read;
 
 	if (!cif)
 		return -CAN_ERROR_NULL_INTERFACE;
 
-	ret = can_set_bittiming(cif->name, bt);
-	if (ret) {
+	can_nl_attr_cfg(cif, &cfg);
+	cfg.bit_timing = *bt;
+	ret = can_nl_set_attr(cif, &cfg, CAN_ERROR_NL_SET_BIT_TIMING);
+	if (ret)
 		log_error("%s: Unable to set bit timing on %s",
 			  __func__, cif->name);
-		return -CAN_ERROR_NL_SET_BIT_TIMING;
-	}
 
-	if (cif->cfg.nl_cmd_verify) {
-		ret = can_get_bittiming(cif->name, &bt_read);
-		if (ret) {
-			log_error("%s: Unable to get %s bit timing info",
-				  __func__, cif->name);
-			return -CAN_ERROR_NL_GET_BIT_TIMING;
-		}
-
-		ret = memcmp(bt, &bt_read, sizeof(bt_read));
-		if (ret) {
-			log_error("%s: on %s bit timing set does not match bit timing read",
-				  __func__, cif->name);
-			return -CAN_ERROR_NL_BT_MISSMATCH;
-		}
-	}
-
-	return CAN_ERROR_NONE;
+	return ret;
 }
 
 int ldx_can_set_data_bit_timing(can_if_t *cif, struct can_bittiming *dbt)
 {
+	can_if_cfg_t cfg;
 	int ret;
-	struct can_bittiming dbt_read;
 
 	if (!cif)
 		return -CAN_ERROR_NULL_INTERFACE;
 
-	ret = can_set_data_bittiming(cif->name, dbt);
-	if (ret) {
+	can_nl_attr_cfg(cif, &cfg);
+	cfg.dbit_timing = *dbt;
+	ret = can_nl_set_attr(cif, &cfg, CAN_ERROR_NL_SET_BIT_TIMING);
+	if (ret)
 		log_error("%s: Unable to set data bit timing on %s",
 			  __func__, cif->name);
-		return -CAN_ERROR_NL_SET_BIT_TIMING;
-	}
-
-	if (cif->cfg.nl_cmd_verify) {
-		ret = can_get_data_bittiming(cif->name, &dbt_read);
-		if (ret) {
-			log_error("%s: Unable to get %s data bit timing info",
-				  __func__, cif->name);
-			return -CAN_ERROR_NL_GET_BIT_TIMING;
-		}
 
-		ret = memcmp(dbt, &dbt_read, sizeof(dbt_read));
-		if (ret) {
-			log_error("%s: on %s data bit timing set does not match bit timing read",
-				  __func__, cif->name);
-			return -CAN_ERROR_NL_BT_MISSMATCH;
-		}
-	}
-
-	return CAN_ERROR_NONE;
+	return ret;
 }
 
 int ldx_can_set_ctrlmode(can_if_t *cif, struct can_ctrlmode *cm)
 {
+	can_if_cfg_t cfg;
 	int ret;
-	struct can_ctrlmode cm_read;
 
 	if (!cif)
 		return -CAN_ERROR_NULL_INTERFACE;
 
-	ret = can_set_ctrlmode(cif->name, cm);
-	if (ret) {
+	can_nl_attr_cfg(cif, &cfg);
+	cfg.ctrl_mode = *cm;
+	ret = can_nl_set_attr(cif, &cfg, CAN_ERROR_NL_SET_CTRL_MODE);
+	if (ret)
 		log_error("%s: Unable to set control mode on %s",
 			  __func__, cif->name);
-		return -CAN_ERROR_NL_SET_CTRL_MODE;
-	}
 
-	if (cif->cfg.nl_cmd_verify) {
-		ret = can_get_ctrlmode(cif->name, &cm_read);
-		if (ret) {
-			log_error("%s: Unable to get %s ctrlmode info",
-					__func__, cif->name);
-			return -CAN_ERROR_NL_GET_CTRL_MODE;
-		}
-
-		ret = memcmp(cm, &cm_read, sizeof(cm_read));
-		if (ret) {
-			log_error("%s: on %s control mode set does not match with control mode read",
-					__func__, cif->name);
-			return -CAN_ERROR_NL_CTRL_MISSMATCH;
-		}
-	}
-
-	return CAN_ERROR_NONE;
+	return ret;
 }
@@ -0,0 +1,160 @@
+/*
+ * Copyright 2018, Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "can.h"
+#include "_can.h"
+#include "_log.h"
+
+/*
+ * The statistics are made only of 64-bit counters, which allows taking and
+ * clearing them word by word with atomic operations.
+ */
+#define CAN_PERF_NWORDS	(sizeof(ldx_can_perf_stats_t) / sizeof(uint64_t))
+
+#define CAN_PERF_HIST_SUB	(1U << LDX_CAN_PERF_HIST_SUB_BITS)
+
+/*
+ * HDR layout: the bucket index is made of the position of the most
+ * significant bit of the value and the LDX_CAN_PERF_HIST_SUB_BITS bits that
+ * follow it.
+ */
+static unsigned int can_perf_hist_bucket(uint64_t val)
+{
+	unsigned int msb, bucket;
+
+	if (val < CAN_PERF_HIST_SUB)
+		return val;
+
+	msb = 63 - __builtin_clzll(val);
+	bucket = ((msb - LDX_CAN_PERF_HIST_SUB_BITS + 1) <<
+		  LDX_CAN_PERF_HIST_SUB_BITS) +
+		 ((val >> (msb - LDX_CAN_PERF_HIST_SUB_BITS)) &
+		  (CAN_PERF_HIST_SUB - 1));
+
+	return bucket < LDX_CAN_PERF_HIST_BUCKETS ?
+	       bucket : LDX_CAN_PERF_HIST_BUCKETS - 1;
+}
+
+/* Largest value recorded in 'bucket' */
+static uint64_t can_perf_hist_upper(unsigned int bucket)
+{
+	unsigned int shift;
+
+	if (bucket < CAN_PERF_HIST_SUB)
+		return bucket;
+
+	shift = (bucket >> LDX_CAN_PERF_HIST_SUB_BITS) - 1;
+
+	return ((uint64_t)(CAN_PERF_HIST_SUB +
+			   (bucket & (CAN_PERF_HIST_SUB - 1))) << shift) +
+	       (1ULL << shift) - 1;
+}
+
+void ldx_can_perf_hist_record(ldx_can_perf_hist_t *hist, uint64_t val)
+{
+	unsigned int bucket = can_perf_hist_bucket(val);
+	uint64_t max;
+
+	ldx_can_perf_add(&hist->buckets[bucket], 1);
+	ldx_can_perf_add(&hist->count, 1);
+	ldx_can_perf_add(&hist->sum, val);
+
+	max = __atomic_load_n(&hist->max, __ATOMIC_RELAXED);
+	while (val > max &&
+	       !__atomic_compare_exchange_n(&hist->max, &max, val, true,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+static int ldx_can_perf_copy(const can_if_t *cif, ldx_can_perf_stats_t *stats,
+			     bool reset)
+{
+	can_priv_t *pdata;
+	uint64_t *src, *dst;
+	unsigned int i;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	pdata = cif->_data;
+	if (!pdata->perf)
+		return -CAN_ERROR_PERF_DISABLED;
+
+	src = (uint64_t *)pdata->perf;
+	dst = (uint64_t *)stats;
+	for (i = 0; i < CAN_PERF_NWORDS; i++) {
+		uint64_t val;
+
+		if (reset)
+			val = __atomic_exchange_n(&src[i], 0, __ATOMIC_RELAXED);
+		else
+			val = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+		if (dst)
+			dst[i] = val;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+int ldx_can_get_perf_stats(const can_if_t *cif, ldx_can_perf_stats_t *stats)
+{
+	if (!stats)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	return ldx_can_perf_copy(cif, stats, false);
+}
+
+int ldx_can_reset_perf_stats(const can_if_t *cif, ldx_can_perf_stats_t *stats)
+{
+	return ldx_can_perf_copy(cif, stats, true);
+}
+
+uint64_t ldx_can_perf_hist_percentile(const ldx_can_perf_hist_t *hist,
+				      double pct)
+{
+	uint64_t target, acc = 0;
+	unsigned int i;
+
+	if (!hist || !hist->count)
+		return 0;
+
+	if (pct < 0)
+		pct = 0;
+	else if (pct > 100)
+		pct = 100;
+
+	target = (uint64_t)(hist->count * pct / 100.0 + 0.5);
+	if (!target)
+		target = 1;
+
+	for (i = 0; i < LDX_CAN_PERF_HIST_BUCKETS - 1; i++) {
+		acc += hist->buckets[i];
+		if (acc >= target) {
+			uint64_t upper = can_perf_hist_upper(i);
+
+			return upper < hist->max ? upper : hist->max;
+		}
+	}
+
+	return hist->max;
+}
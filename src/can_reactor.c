@@ -0,0 +1,375 @@
+/*
+ * Copyright 2018, Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "can.h"
+#include "_can.h"
+#include "_common.h"
+#include "_log.h"
+
+/* epoll data of the wakeup eventfd, interface ids start at 1 */
+#define CAN_REACTOR_WAKE_ID	0
+
+static can_reactor_if_t *find_rif_by_id(ldx_can_reactor_t *reactor, uint64_t id)
+{
+	can_reactor_if_t *rif;
+
+	list_for_each_entry(rif, &reactor->if_list_head, list) {
+		if (rif->id == id)
+			return rif;
+	}
+
+	return NULL;
+}
+
+static can_reactor_if_t *find_rif_by_cif(ldx_can_reactor_t *reactor,
+					 const can_if_t *cif)
+{
+	can_reactor_if_t *rif;
+
+	list_for_each_entry(rif, &reactor->if_list_head, list) {
+		if (rif->cif == cif)
+			return rif;
+	}
+
+	return NULL;
+}
+
+static int ldx_can_reactor_arm(ldx_can_reactor_t *reactor,
+			       can_reactor_if_t *rif, int op)
+{
+	can_priv_t *pdata = rif->cif->_data;
+	struct epoll_event ev;
+
+	/*
+	 * One shot, so that an interface is never processed by two workers at
+	 * the same time. It is re-armed once the worker is done with it.
+	 */
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.u64 = rif->id;
+
+	return epoll_ctl(reactor->epfd, op, pdata->epfd, &ev);
+}
+
+static void ldx_can_reactor_service(ldx_can_reactor_t *reactor, uint64_t id)
+{
+	can_reactor_if_t *rif;
+
+	/*
+	 * The interface may have been detached since the event was retrieved,
+	 * hence the lookup by id under the lock.
+	 */
+	pthread_mutex_lock(&reactor->mutex);
+	rif = find_rif_by_id(reactor, id);
+	if (!rif) {
+		pthread_mutex_unlock(&reactor->mutex);
+		return;
+	}
+	rif->busy = true;
+	rif->worker = pthread_self();
+	pthread_mutex_unlock(&reactor->mutex);
+
+	(void) ldx_can_process_events(rif->cif, 0);
+
+	pthread_mutex_lock(&reactor->mutex);
+	rif->busy = false;
+	if (find_rif_by_id(reactor, id)) {
+		if (ldx_can_reactor_arm(reactor, rif, EPOLL_CTL_MOD))
+			log_error("%s|%s: epoll_ctl mod error (%d)",
+				  rif->cif->name, __func__, errno);
+	} else {
+		pthread_cond_broadcast(&reactor->idle);
+	}
+	pthread_mutex_unlock(&reactor->mutex);
+}
+
+static void *ldx_can_reactor_thr(void *arg)
+{
+	ldx_can_reactor_t *reactor = arg;
+	struct epoll_event evs[CAN_MAX_EPOLL_EVENTS];
+
+	while (__atomic_load_n(&reactor->run, __ATOMIC_ACQUIRE)) {
+		int i, nevts;
+
+		nevts = epoll_wait(reactor->epfd, evs, CAN_MAX_EPOLL_EVENTS, -1);
+		if (nevts < 0) {
+			if (errno == EINTR)
+				continue;
+			log_error("%s: epoll_wait error (%d)", __func__, errno);
+			break;
+		}
+
+		for (i = 0; i < nevts; i++) {
+			/* The wakeup eventfd is never read, so all workers see it */
+			if (evs[i].data.u64 == CAN_REACTOR_WAKE_ID)
+				continue;
+			ldx_can_reactor_service(reactor, evs[i].data.u64);
+		}
+	}
+
+	return NULL;
+}
+
+static void ldx_can_reactor_stop(ldx_can_reactor_t *reactor, unsigned int nthreads)
+{
+	uint64_t one = 1;
+	unsigned int i;
+
+	__atomic_store_n(&reactor->run, false, __ATOMIC_RELEASE);
+	if (write(reactor->wake_fd, &one, sizeof(one)) < 0)
+		log_error("%s: eventfd write error (%d)", __func__, errno);
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(reactor->threads[i], NULL);
+}
+
+ldx_can_reactor_t *ldx_can_reactor_create(const ldx_can_reactor_cfg_t *cfg)
+{
+	ldx_can_reactor_t *reactor;
+	struct epoll_event ev;
+	unsigned int i;
+	int ret;
+
+	reactor = calloc(1, sizeof(ldx_can_reactor_t));
+	if (!reactor) {
+		log_error("%s: Unable to allocate memory for reactor", __func__);
+		return NULL;
+	}
+
+	INIT_LIST_HEAD(&reactor->if_list_head);
+	reactor->nthreads = (cfg && cfg->nthreads) ? cfg->nthreads : 1;
+	reactor->next_id = CAN_REACTOR_WAKE_ID + 1;
+	reactor->run = true;
+
+	reactor->threads = calloc(reactor->nthreads, sizeof(pthread_t));
+	if (!reactor->threads) {
+		log_error("%s: Unable to allocate memory for threads", __func__);
+		goto err_free;
+	}
+
+	reactor->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (reactor->epfd < 0) {
+		log_error("%s: Unable to create epoll instance", __func__);
+		goto err_free;
+	}
+
+	reactor->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (reactor->wake_fd < 0) {
+		log_error("%s: Unable to create eventfd", __func__);
+		goto err_epfd_close;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u64 = CAN_REACTOR_WAKE_ID;
+	if (epoll_ctl(reactor->epfd, EPOLL_CTL_ADD, reactor->wake_fd, &ev)) {
+		log_error("%s: epoll_ctl add error (%d)", __func__, errno);
+		goto err_wakefd_close;
+	}
+
+	pthread_mutex_init(&reactor->mutex, NULL);
+	pthread_cond_init(&reactor->idle, NULL);
+
+	for (i = 0; i < reactor->nthreads; i++) {
+		pthread_attr_t attr;
+
+		ret = thread_attr_init(&attr, cfg ? cfg->priority : 0, 0);
+		if (ret) {
+			log_error("%s: Unable to set worker attributes (%d)",
+				  __func__, ret);
+			goto err_stop;
+		}
+		if (cfg && cfg->cpus && cfg->cpus[i] >= 0) {
+			cpu_set_t cpuset;
+
+			if (cfg->cpus[i] >= CPU_SETSIZE) {
+				log_error("%s: Invalid CPU %d for worker %u",
+					  __func__, cfg->cpus[i], i);
+				ret = EINVAL;
+			} else {
+				CPU_ZERO(&cpuset);
+				CPU_SET(cfg->cpus[i], &cpuset);
+				ret = pthread_attr_setaffinity_np(&attr,
+								  sizeof(cpuset),
+								  &cpuset);
+				if (ret)
+					log_error("%s: Unable to set worker %u affinity (%d)",
+						  __func__, i, ret);
+			}
+			if (ret) {
+				pthread_attr_destroy(&attr);
+				goto err_stop;
+			}
+		}
+
+		ret = pthread_create(&reactor->threads[i], &attr,
+				     ldx_can_reactor_thr, reactor);
+		pthread_attr_destroy(&attr);
+		if (ret) {
+			log_error("%s: Unable to create worker thread %u (%d)",
+				  __func__, i, ret);
+			goto err_stop;
+		}
+	}
+
+	return reactor;
+
+err_stop:
+	ldx_can_reactor_stop(reactor, i);
+	pthread_cond_destroy(&reactor->idle);
+	pthread_mutex_destroy(&reactor->mutex);
+
+err_wakefd_close:
+	close(reactor->wake_fd);
+
+err_epfd_close:
+	close(reactor->epfd);
+
+err_free:
+	free(reactor->threads);
+	free(reactor);
+
+	return NULL;
+}
+
+int ldx_can_reactor_attach(ldx_can_reactor_t *reactor, can_if_t *cif)
+{
+	can_reactor_if_t *rif;
+	can_priv_t *pdata;
+	int ret = CAN_ERROR_NONE;
+
+	if (!cif || !reactor)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	pdata = cif->_data;
+	if (pdata->can_thr || pdata->reactor) {
+		log_error("%s: %s is already serviced by a thread",
+			  __func__, cif->name);
+		return -CAN_ERROR_REACTOR_BUSY;
+	}
+
+	/* Handlers may now be registered while a worker dispatches events */
+	if (!pdata->has_mutex) {
+		if (pthread_mutex_init(&pdata->mutex, NULL)) {
+			log_error("%s: Unable init thread mutex %s",
+				  __func__, cif->name);
+			return -CAN_ERROR_THREAD_MUTEX_INIT;
+		}
+		pdata->has_mutex = true;
+	}
+
+	rif = calloc(1, sizeof(can_reactor_if_t));
+	if (!rif) {
+		log_error("%s: Unable to alloc memory for %s", __func__,
+			  cif->name);
+		return -CAN_ERROR_NO_MEM;
+	}
+	rif->cif = cif;
+
+	pthread_mutex_lock(&reactor->mutex);
+	rif->id = reactor->next_id++;
+	if (ldx_can_reactor_arm(reactor, rif, EPOLL_CTL_ADD)) {
+		log_error("%s|%s: epoll_ctl add error (%d)",
+			  cif->name, __func__, errno);
+		free(rif);
+		ret = -CAN_ERROR_EPOLL_CTL;
+	} else {
+		list_add_tail(&rif->list, &reactor->if_list_head);
+		pdata->reactor = reactor;
+	}
+	pthread_mutex_unlock(&reactor->mutex);
+
+	return ret;
+}
+
+int ldx_can_reactor_detach(ldx_can_reactor_t *reactor, can_if_t *cif)
+{
+	can_reactor_if_t *rif;
+	can_priv_t *pdata;
+
+	if (!cif || !reactor)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	pdata = cif->_data;
+
+	pthread_mutex_lock(&reactor->mutex);
+	rif = find_rif_by_cif(reactor, cif);
+	if (!rif) {
+		pthread_mutex_unlock(&reactor->mutex);
+		return -CAN_ERROR_NULL_INTERFACE;
+	}
+
+	/* A handler run by the worker would wait for itself forever */
+	if (rif->busy && pthread_equal(rif->worker, pthread_self())) {
+		pthread_mutex_unlock(&reactor->mutex);
+		log_error("%s: %s can not be detached from its own handlers",
+			  __func__, cif->name);
+		return -CAN_ERROR_REACTOR_BUSY;
+	}
+
+	list_del(&rif->list);
+	epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, pdata->epfd, NULL);
+
+	/* Wait for any worker still processing the interface */
+	while (rif->busy)
+		pthread_cond_wait(&reactor->idle, &reactor->mutex);
+	pthread_mutex_unlock(&reactor->mutex);
+
+	free(rif);
+	pdata->reactor = NULL;
+
+	return CAN_ERROR_NONE;
+}
+
+int ldx_can_reactor_free(ldx_can_reactor_t *reactor)
+{
+	can_reactor_if_t *rif, *tmp;
+
+	if (!reactor)
+		return EXIT_SUCCESS;
+
+	ldx_can_reactor_stop(reactor, reactor->nthreads);
+
+	list_for_each_entry_safe(rif, tmp, &reactor->if_list_head, list) {
+		can_priv_t *pdata = rif->cif->_data;
+
+		list_del(&rif->list);
+		pdata->reactor = NULL;
+		free(rif);
+	}
+
+	close(reactor->wake_fd);
+	close(reactor->epfd);
+	pthread_cond_destroy(&reactor->idle);
+	pthread_mutex_destroy(&reactor->mutex);
+	free(reactor->threads);
+	free(reactor);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,611 @@
+/*
+ * Copyright 2018, Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "can.h"
+#include "_can.h"
+#include "_log.h"
+
+/* Initial number of entries of the block index */
+#define CAN_LOG_INDEX_INIT	64
+
+/* Time to wait before retrying a replay batch the tx queue did not take */
+#define CAN_REPLAY_BACKOFF_US	1000
+
+static int can_log_write(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+
+	while (len) {
+		ssize_t ret = write(fd, p, len);
+
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			log_error("%s: write error (%d)", __func__, errno);
+			return -CAN_ERROR_LOG_FILE;
+		}
+		p += ret;
+		len -= ret;
+	}
+
+	return CAN_ERROR_NONE;
+}
+
+static uint64_t can_ts2ns(const struct timespec *ts)
+{
+	return (uint64_t)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+/* Best timestamp available for an event, the current time if none */
+static uint64_t can_rec_evt_ns(const ldx_can_event_t *evt)
+{
+	struct timespec now;
+
+	if (evt->ts_hw.tv_sec)
+		return can_ts2ns(&evt->ts_hw);
+	if (evt->ts_sw.tv_sec)
+		return can_ts2ns(&evt->ts_sw);
+	if (evt->tstamp.tv_sec)
+		return (uint64_t)evt->tstamp.tv_sec * 1000000000ULL +
+		       evt->tstamp.tv_usec * 1000ULL;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	return can_ts2ns(&now);
+}
+
+/* Write a block and add it to the index, only called from the writer */
+static int can_rec_write_block(ldx_can_recorder_t *rec, const uint8_t *buf,
+			       size_t len)
+{
+	const can_log_block_hdr_t *hdr = (const can_log_block_hdr_t *)buf;
+	int ret;
+
+	if (rec->nblocks == rec->index_size) {
+		unsigned int size = rec->index_size * 2;
+		can_log_index_ent_t *index;
+
+		index = realloc(rec->index, size * sizeof(*index));
+		if (!index)
+			return -CAN_ERROR_NO_MEM;
+		rec->index = index;
+		rec->index_size = size;
+	}
+
+	ret = can_log_write(rec->fd, buf, len);
+	if (ret)
+		return ret;
+
+	rec->index[rec->nblocks].offset = rec->offset;
+	rec->index[rec->nblocks].first_ns = hdr->first_ns;
+	rec->nblocks++;
+	rec->offset += len;
+
+	return CAN_ERROR_NONE;
+}
+
+static void *can_rec_writer(void *arg)
+{
+	ldx_can_recorder_t *rec = arg;
+
+	pthread_mutex_lock(&rec->mutex);
+	for (;;) {
+		unsigned int slot;
+		int ret;
+
+		while (!rec->nfull && !rec->stop)
+			pthread_cond_wait(&rec->cond, &rec->mutex);
+		if (!rec->nfull)
+			break;
+		slot = rec->rd;
+		pthread_mutex_unlock(&rec->mutex);
+
+		/* After an error the blocks are only released */
+		if (!__atomic_load_n(&rec->error, __ATOMIC_RELAXED)) {
+			ret = can_rec_write_block(rec, rec->blocks[slot],
+						  rec->lens[slot]);
+			if (ret)
+				__atomic_store_n(&rec->error, ret,
+						 __ATOMIC_RELAXED);
+		}
+
+		pthread_mutex_lock(&rec->mutex);
+		rec->rd = (slot + 1) % CAN_LOG_NBLOCKS;
+		rec->nfull--;
+	}
+	pthread_mutex_unlock(&rec->mutex);
+
+	return NULL;
+}
+
+/* Queue the block being filled for the writer, with 'mutex' held */
+static void can_rec_queue_block(ldx_can_recorder_t *rec)
+{
+	can_log_block_hdr_t *hdr = (can_log_block_hdr_t *)rec->blocks[rec->wr];
+
+	hdr->magic = CAN_LOG_BLOCK_MAGIC;
+	hdr->len = rec->used - sizeof(*hdr);
+	rec->lens[rec->wr] = rec->used;
+	rec->wr = (rec->wr + 1) % CAN_LOG_NBLOCKS;
+	rec->nfull++;
+	pthread_cond_signal(&rec->cond);
+}
+
+/*
+ * Hand the block being filled over to the writer and start the next one.
+ * Returns false, keeping the current block, if every other block is still
+ * waiting to be written.
+ */
+static bool can_rec_next_block(ldx_can_recorder_t *rec)
+{
+	bool ok = false;
+
+	pthread_mutex_lock(&rec->mutex);
+	if (rec->nfull < CAN_LOG_NBLOCKS - 1) {
+		can_rec_queue_block(rec);
+		ok = true;
+	}
+	pthread_mutex_unlock(&rec->mutex);
+
+	if (ok) {
+		memset(rec->blocks[rec->wr], 0, sizeof(can_log_block_hdr_t));
+		rec->used = sizeof(can_log_block_hdr_t);
+	}
+
+	return ok;
+}
+
+/*
+ * Batch handler, called from the reception path of the interface. Frames
+ * are only copied here, the file is written by the writer thread so a slow
+ * disk does not hold up the reception.
+ */
+static void can_rec_batch(void *ctx, const ldx_can_event_t *evts, size_t n)
+{
+	ldx_can_recorder_t *rec = ctx;
+	can_log_block_hdr_t *hdr;
+	size_t i;
+
+	if (__atomic_load_n(&rec->error, __ATOMIC_RELAXED))
+		return;
+
+	for (i = 0; i < n; i++) {
+		const struct canfd_frame *frame = &evts[i].frame;
+		unsigned int len = frame->len;
+		can_log_rec_t r;
+
+		if (len > CANFD_MAX_DLEN)
+			len = CANFD_MAX_DLEN;
+		if (rec->used + sizeof(r) + len > CAN_LOG_BLOCK_SIZE &&
+		    !can_rec_next_block(rec)) {
+			rec->dropped += n - i;
+			break;
+		}
+
+		r.ts_ns = can_rec_evt_ns(&evts[i]);
+		r.can_id = frame->can_id;
+		r.flags = frame->flags & (CANFD_BRS | CANFD_ESI);
+		if (r.flags || len > CAN_MAX_DLEN)
+			r.flags |= CAN_LOG_REC_FD;
+		r.len = len;
+
+		hdr = (can_log_block_hdr_t *)rec->blocks[rec->wr];
+		memcpy(rec->blocks[rec->wr] + rec->used, &r, sizeof(r));
+		memcpy(rec->blocks[rec->wr] + rec->used + sizeof(r),
+		       frame->data, len);
+		rec->used += sizeof(r) + len;
+
+		if (!hdr->nrecs++)
+			hdr->first_ns = r.ts_ns;
+		hdr->last_ns = r.ts_ns;
+		rec->frames++;
+	}
+}
+
+static void can_rec_free(ldx_can_recorder_t *rec)
+{
+	unsigned int i;
+
+	for (i = 0; i < CAN_LOG_NBLOCKS; i++)
+		free(rec->blocks[i]);
+	free(rec->index);
+	free(rec);
+}
+
+ldx_can_recorder_t *ldx_can_recorder_start(can_if_t *cif, const char *path,
+					   struct can_filter *filters,
+					   int nfilters)
+{
+	ldx_can_recorder_t *rec;
+	can_log_file_hdr_t fhdr;
+	struct timespec now;
+	unsigned int i;
+
+	if (!cif || !path)
+		return NULL;
+
+	rec = calloc(1, sizeof(ldx_can_recorder_t));
+	if (!rec) {
+		log_error("%s: Unable to allocate memory for recorder on %s",
+			  __func__, cif->name);
+		return NULL;
+	}
+
+	rec->cif = cif;
+	for (i = 0; i < CAN_LOG_NBLOCKS; i++) {
+		rec->blocks[i] = calloc(1, CAN_LOG_BLOCK_SIZE);
+		if (!rec->blocks[i])
+			break;
+	}
+	rec->index = calloc(CAN_LOG_INDEX_INIT, sizeof(*rec->index));
+	if (i < CAN_LOG_NBLOCKS || !rec->index) {
+		log_error("%s: Unable to allocate memory for recorder on %s",
+			  __func__, cif->name);
+		goto err_free;
+	}
+	rec->index_size = CAN_LOG_INDEX_INIT;
+	rec->used = sizeof(can_log_block_hdr_t);
+
+	rec->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (rec->fd < 0) {
+		log_error("%s: Unable to create %s (%d)", __func__, path, errno);
+		goto err_free;
+	}
+
+	memset(&fhdr, 0, sizeof(fhdr));
+	memcpy(fhdr.magic, CAN_LOG_MAGIC, sizeof(fhdr.magic));
+	fhdr.version = CAN_LOG_VERSION;
+	fhdr.hdr_len = sizeof(fhdr);
+	clock_gettime(CLOCK_REALTIME, &now);
+	fhdr.start_ns = can_ts2ns(&now);
+	if (can_log_write(rec->fd, &fhdr, sizeof(fhdr)))
+		goto err_close;
+	rec->offset = sizeof(fhdr);
+
+	pthread_mutex_init(&rec->mutex, NULL);
+	pthread_cond_init(&rec->cond, NULL);
+	if (pthread_create(&rec->writer, NULL, can_rec_writer, rec)) {
+		log_error("%s: Unable to create writer thread on %s", __func__,
+			  cif->name);
+		goto err_destroy;
+	}
+
+	rec->handle = ldx_can_register_rx_batch_handler(cif, can_rec_batch, rec,
+							filters, nfilters);
+	if (rec->handle < 0) {
+		log_error("%s: Unable to register recorder on %s", __func__,
+			  cif->name);
+		goto err_join;
+	}
+
+	return rec;
+
+err_join:
+	pthread_mutex_lock(&rec->mutex);
+	rec->stop = true;
+	pthread_cond_signal(&rec->cond);
+	pthread_mutex_unlock(&rec->mutex);
+	pthread_join(rec->writer, NULL);
+err_destroy:
+	pthread_cond_destroy(&rec->cond);
+	pthread_mutex_destroy(&rec->mutex);
+err_close:
+	close(rec->fd);
+	unlink(path);
+err_free:
+	can_rec_free(rec);
+
+	return NULL;
+}
+
+int ldx_can_recorder_stop(ldx_can_recorder_t *rec, uint64_t *frames)
+{
+	can_log_block_hdr_t *hdr;
+	can_log_trailer_t trailer;
+	int ret;
+
+	if (!rec)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	/* Once unregistered, the batch handler is no longer called */
+	ldx_can_unregister_rx_batch_handler(rec->cif, rec->handle);
+
+	/* The last block does not need a next one to be free */
+	hdr = (can_log_block_hdr_t *)rec->blocks[rec->wr];
+	pthread_mutex_lock(&rec->mutex);
+	if (hdr->nrecs)
+		can_rec_queue_block(rec);
+	rec->stop = true;
+	pthread_cond_signal(&rec->cond);
+	pthread_mutex_unlock(&rec->mutex);
+	pthread_join(rec->writer, NULL);
+	pthread_cond_destroy(&rec->cond);
+	pthread_mutex_destroy(&rec->mutex);
+
+	if (rec->dropped)
+		log_error("%s: %llu frames not recorded on %s, the log file could not keep up",
+			  __func__, (unsigned long long)rec->dropped,
+			  rec->cif->name);
+
+	ret = rec->error;
+	if (!ret)
+		ret = can_log_write(rec->fd, rec->index,
+				    rec->nblocks * sizeof(*rec->index));
+	if (!ret) {
+		memset(&trailer, 0, sizeof(trailer));
+		trailer.index_off = rec->offset;
+		trailer.nblocks = rec->nblocks;
+		memcpy(trailer.magic, CAN_LOG_INDEX_MAGIC, sizeof(trailer.magic));
+		ret = can_log_write(rec->fd, &trailer, sizeof(trailer));
+	}
+	if (close(rec->fd) && !ret)
+		ret = -CAN_ERROR_LOG_FILE;
+
+	if (frames)
+		*frames = rec->frames;
+
+	can_rec_free(rec);
+
+	return ret;
+}
+
+/* Block header at the given offset, NULL if it is not a complete block */
+static const can_log_block_hdr_t *can_log_block_at(const uint8_t *map,
+						   size_t size, uint64_t off)
+{
+	const can_log_block_hdr_t *blk;
+
+	if (off + sizeof(*blk) > size)
+		return NULL;
+
+	blk = (const can_log_block_hdr_t *)(map + off);
+	if (blk->magic != CAN_LOG_BLOCK_MAGIC ||
+	    off + sizeof(*blk) + blk->len > size)
+		return NULL;
+
+	return blk;
+}
+
+/* Index of a completed log, NULL if the recording was interrupted */
+static const can_log_index_ent_t *can_log_index(const uint8_t *map,
+						size_t size,
+						unsigned int *nblocks)
+{
+	const can_log_trailer_t *trailer;
+
+	if (size < sizeof(can_log_file_hdr_t) + sizeof(*trailer))
+		return NULL;
+
+	trailer = (const can_log_trailer_t *)(map + size - sizeof(*trailer));
+	if (memcmp(trailer->magic, CAN_LOG_INDEX_MAGIC, sizeof(trailer->magic)) ||
+	    trailer->index_off + (uint64_t)trailer->nblocks *
+	    sizeof(can_log_index_ent_t) != size - sizeof(*trailer))
+		return NULL;
+
+	*nblocks = trailer->nblocks;
+	return (const can_log_index_ent_t *)(map + trailer->index_off);
+}
+
+static uint64_t can_mono_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return can_ts2ns(&ts);
+}
+
+static void can_sleep_until_ns(uint64_t ns)
+{
+	struct timespec ts = {
+		.tv_sec = ns / 1000000000ULL,
+		.tv_nsec = ns % 1000000000ULL,
+	};
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	       EINTR)
+		;
+}
+
+/* Send 'n' frames of the same kind, 'mtu' tells classic from CAN FD ones */
+static int can_replay_send(const can_if_t *cif, struct canfd_frame *frames,
+			   unsigned int n, int mtu, uint64_t *sent)
+{
+	unsigned int done = 0;
+	int ret;
+
+	while (done < n) {
+		unsigned int cnt;
+
+		ret = ldx_can_tx_frames_i(cif, frames + done, n - done, mtu,
+					  &cnt);
+		done += cnt;
+		*sent += cnt;
+		if (ret == -CAN_ERROR_TX_RETRY_LATER)
+			usleep(CAN_REPLAY_BACKOFF_US);
+		else if (ret)
+			return ret;
+	}
+
+	return CAN_ERROR_NONE;
+}
+
+int ldx_can_replay(const can_if_t *cif, const char *path, double speed,
+		   uint64_t *sent)
+{
+	struct canfd_frame frames[LDX_CAN_TX_BATCH_MAX];
+	const can_log_index_ent_t *index;
+	const can_log_file_hdr_t *fhdr;
+	uint64_t off, t0 = 0, t0_log = 0, nsent = 0;
+	unsigned int b, nblocks = 0, n = 0;
+	bool first = true;
+	int mtu = CAN_MTU;
+	const uint8_t *map;
+	struct stat st;
+	size_t size;
+	int fd, ret = CAN_ERROR_NONE;
+
+	if (sent)
+		*sent = 0;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		log_error("%s: Unable to open %s (%d)", __func__, path, errno);
+		return -CAN_ERROR_LOG_FILE;
+	}
+	if (fstat(fd, &st) || st.st_size < (off_t)sizeof(*fhdr)) {
+		close(fd);
+		return -CAN_ERROR_LOG_FORMAT;
+	}
+	size = st.st_size;
+
+	map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		log_error("%s: Unable to map %s (%d)", __func__, path, errno);
+		return -CAN_ERROR_LOG_FILE;
+	}
+	madvise((void *)map, size, MADV_SEQUENTIAL);
+
+	fhdr = (const can_log_file_hdr_t *)map;
+	if (memcmp(fhdr->magic, CAN_LOG_MAGIC, sizeof(fhdr->magic)) ||
+	    fhdr->version != CAN_LOG_VERSION || fhdr->hdr_len < sizeof(*fhdr)) {
+		log_error("%s: %s is not a frame log", __func__, path);
+		ret = -CAN_ERROR_LOG_FORMAT;
+		goto out;
+	}
+
+	/* Without an index, walk the blocks up to the last complete one */
+	index = can_log_index(map, size, &nblocks);
+	off = fhdr->hdr_len;
+
+	for (b = 0; !index || b < nblocks; b++) {
+		const can_log_block_hdr_t *blk;
+		const uint8_t *p, *end;
+		uint32_t r;
+
+		if (index)
+			off = index[b].offset;
+		blk = can_log_block_at(map, size, off);
+		if (!blk) {
+			if (index)
+				ret = -CAN_ERROR_LOG_FORMAT;
+			break;
+		}
+		p = (const uint8_t *)(blk + 1);
+		end = p + blk->len;
+		off += sizeof(*blk) + blk->len;
+
+		for (r = 0; r < blk->nrecs; r++) {
+			const can_log_rec_t *rec = (const can_log_rec_t *)p;
+			struct canfd_frame *frame;
+			int rec_mtu;
+
+			if (p + sizeof(*rec) > end ||
+			    p + sizeof(*rec) + rec->len > end ||
+			    rec->len > CANFD_MAX_DLEN) {
+				ret = -CAN_ERROR_LOG_FORMAT;
+				goto flush;
+			}
+			p += sizeof(*rec) + rec->len;
+
+			if ((rec->can_id & CAN_ERR_FLAG) ||
+			    ((rec->flags & CAN_LOG_REC_FD) &&
+			     !cif->cfg.canfd_enabled))
+				continue;
+
+			if (speed > 0) {
+				uint64_t due;
+
+				if (first) {
+					t0 = can_mono_ns();
+					t0_log = rec->ts_ns;
+					first = false;
+				}
+				due = rec->ts_ns > t0_log ?
+				      t0 + (uint64_t)((rec->ts_ns - t0_log) / speed) :
+				      t0;
+				/* Frames due at the same time go out together */
+				if (due > can_mono_ns()) {
+					if (n) {
+						ret = can_replay_send(cif, frames,
+								      n, mtu,
+								      &nsent);
+						n = 0;
+						if (ret)
+							goto out;
+					}
+					can_sleep_until_ns(due);
+				}
+			}
+
+			/* Classic and CAN FD records go out as they were captured */
+			rec_mtu = (rec->flags & CAN_LOG_REC_FD) ? CANFD_MTU :
+								 CAN_MTU;
+			if (n && rec_mtu != mtu) {
+				ret = can_replay_send(cif, frames, n, mtu, &nsent);
+				n = 0;
+				if (ret)
+					goto out;
+			}
+			mtu = rec_mtu;
+
+			frame = &frames[n++];
+			memset(frame, 0, sizeof(*frame));
+			frame->can_id = rec->can_id;
+			frame->len = rec->len;
+			frame->flags = rec->flags & (CANFD_BRS | CANFD_ESI);
+			memcpy(frame->data, rec + 1, rec->len);
+
+			if (n == LDX_CAN_TX_BATCH_MAX) {
+				ret = can_replay_send(cif, frames, n, mtu, &nsent);
+				n = 0;
+				if (ret)
+					goto out;
+			}
+		}
+	}
+
+flush:
+	if (n) {
+		int err = can_replay_send(cif, frames, n, mtu, &nsent);
+
+		if (!ret)
+			ret = err;
+	}
+
+out:
+	munmap((void *)map, size);
+	if (sent)
+		*sent = nsent;
+
+	return ret;
+}
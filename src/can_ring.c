@@ -0,0 +1,163 @@
+/*
+ * Copyright 2018, Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "can.h"
+#include "_can.h"
+#include "_log.h"
+
+#define CAN_RING_MIN_SIZE	16
+
+ldx_can_ring_t *ldx_can_ring_alloc(unsigned int size, bool notify)
+{
+	ldx_can_ring_t *ring;
+	uint32_t slots = CAN_RING_MIN_SIZE;
+
+	while (slots < size && slots < (1U << 31))
+		slots <<= 1;
+
+	if (posix_memalign((void **)&ring, CAN_CACHELINE_SIZE, sizeof(*ring)))
+		return NULL;
+	memset(ring, 0, sizeof(*ring));
+
+	ring->slots = calloc(slots, sizeof(ldx_can_event_t));
+	if (!ring->slots) {
+		free(ring);
+		return NULL;
+	}
+	ring->mask = slots - 1;
+	ring->rx_skt = -1;
+	ring->notify_fd = -1;
+
+	if (notify) {
+		ring->notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (ring->notify_fd < 0) {
+			log_error("%s: Unable to create eventfd (%d)", __func__, errno);
+			ldx_can_ring_release(ring);
+			return NULL;
+		}
+	}
+
+	return ring;
+}
+
+void ldx_can_ring_release(ldx_can_ring_t *ring)
+{
+	if (!ring)
+		return;
+
+	if (ring->notify_fd >= 0)
+		close(ring->notify_fd);
+	free(ring->slots);
+	free(ring);
+}
+
+unsigned int ldx_can_ring_push_bulk(ldx_can_ring_t *ring,
+				    const ldx_can_event_t *evts, unsigned int n)
+{
+	uint32_t head = ring->head;
+	uint32_t size = ring->mask + 1;
+	uint32_t room, cnt, i;
+
+	/* Only look at the consumer index when the cached one says full */
+	room = size - (head - ring->tail_cache);
+	if (room < n) {
+		ring->tail_cache = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+		room = size - (head - ring->tail_cache);
+	}
+
+	cnt = n < room ? n : room;
+	for (i = 0; i < cnt; i++)
+		ring->slots[(head + i) & ring->mask] = evts[i];
+
+	__atomic_store_n(&ring->head, head + cnt, __ATOMIC_RELEASE);
+
+	/* Single writer, the atomics are only there for the stats reader */
+	__atomic_store_n(&ring->enqueued, ring->enqueued + cnt, __ATOMIC_RELAXED);
+	if (cnt < n)
+		__atomic_store_n(&ring->overflows, ring->overflows + (n - cnt),
+				 __ATOMIC_RELAXED);
+
+	if (cnt && ring->notify_fd >= 0) {
+		uint64_t one = 1;
+
+		if (write(ring->notify_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+			log_debug("%s: eventfd write error (%d)", __func__, errno);
+	}
+
+	return cnt;
+}
+
+unsigned int ldx_can_ring_pop_bulk(ldx_can_ring_t *ring, ldx_can_event_t *evts,
+				   unsigned int max)
+{
+	uint32_t tail, avail, cnt, i;
+
+	if (!ring || !evts)
+		return 0;
+
+	tail = ring->tail;
+	avail = ring->head_cache - tail;
+	if (avail < max) {
+		ring->head_cache = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		avail = ring->head_cache - tail;
+	}
+
+	cnt = max < avail ? max : avail;
+	for (i = 0; i < cnt; i++)
+		evts[i] = ring->slots[(tail + i) & ring->mask];
+
+	__atomic_store_n(&ring->tail, tail + cnt, __ATOMIC_RELEASE);
+
+	return cnt;
+}
+
+int ldx_can_ring_pop(ldx_can_ring_t *ring, ldx_can_event_t *evt)
+{
+	return ldx_can_ring_pop_bulk(ring, evt, 1);
+}
+
+int ldx_can_ring_get_fd(const ldx_can_ring_t *ring)
+{
+	return ring ? ring->notify_fd : -1;
+}
+
+void ldx_can_ring_get_stats(const ldx_can_ring_t *ring,
+			    ldx_can_ring_stats_t *stats)
+{
+	uint32_t head, tail;
+
+	if (!ring || !stats)
+		return;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+	stats->size = ring->mask + 1;
+	stats->depth = head - tail;
+	stats->enqueued = __atomic_load_n(&ring->enqueued, __ATOMIC_RELAXED);
+	stats->overflows = __atomic_load_n(&ring->overflows, __ATOMIC_RELAXED);
+}
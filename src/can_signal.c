@@ -0,0 +1,516 @@
+/*
+ * Copyright 2018, Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <ctype.h>
+#include <endian.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "can.h"
+#include "_can.h"
+#include "_log.h"
+
+#define CAN_SIGDB_EMPTY		0xFFFFFFFFU
+#define CAN_SIGDB_LINE_LEN	1024
+#define CAN_SIGDB_NAME_LEN	128
+
+/* Last byte an 8-byte window can start at within a CAN FD payload */
+#define CAN_SIGDB_MAX_BYTE	(CANFD_MAX_DLEN - 8)
+
+/**
+ * can_sig_def_t - Signal as described in the DBC file
+ *
+ * @start:	Start bit (LSB for little endian, MSB for big endian).
+ * @len:	Length in bits.
+ * @be:		Big endian (Motorola) byte order.
+ * @is_signed:	Two's complement value.
+ * @is_mux:	The signal is the multiplexor of its message.
+ * @mux_val:	Multiplexor value selecting the signal, -1 if always present.
+ * @valtype:	SIG_VALTYPE_ of the signal (0 integer, 1 float, 2 double).
+ * @factor:	Scale of the physical value.
+ * @offset:	Offset of the physical value.
+ */
+typedef struct {
+	unsigned int		start;
+	unsigned int		len;
+	bool			be;
+	bool			is_signed;
+	bool			is_mux;
+	int			mux_val;
+	int			valtype;
+	double			factor;
+	double			offset;
+} can_sig_def_t;
+
+/* Parser state */
+typedef struct {
+	ldx_can_sigdb_t		*db;
+	can_sig_def_t		*defs;
+	uint32_t		msgs_size;
+	uint32_t		sigs_size;
+	int			cur;
+} can_sigdb_parser_t;
+
+static uint32_t can_sigdb_hash(uint32_t id, uint32_t mask)
+{
+	return (id * 0x9E3779B1U) >> 7 & mask;
+}
+
+/* Key of a frame ID in the message hash */
+static uint32_t can_sigdb_key(canid_t id)
+{
+	if (id & CAN_EFF_FLAG)
+		return id & (CAN_EFF_FLAG | CAN_EFF_MASK);
+
+	return id & CAN_SFF_MASK;
+}
+
+static const can_sig_msg_t *can_sigdb_find(const ldx_can_sigdb_t *db,
+					   canid_t id)
+{
+	uint32_t key = can_sigdb_key(id);
+	uint32_t slot = can_sigdb_hash(key, db->hash_mask);
+
+	while (db->hash_keys[slot] != CAN_SIGDB_EMPTY) {
+		if (db->hash_keys[slot] == key)
+			return &db->msgs[db->hash_msgs[slot]];
+		slot = (slot + 1) & db->hash_mask;
+	}
+
+	return NULL;
+}
+
+static int can_sigdb_add_msg(can_sigdb_parser_t *ps, canid_t id)
+{
+	ldx_can_sigdb_t *db = ps->db;
+	can_sig_msg_t *msg;
+
+	if (db->nmsgs == ps->msgs_size) {
+		uint32_t size = ps->msgs_size ? ps->msgs_size * 2 : 64;
+		can_sig_msg_t *msgs = realloc(db->msgs, size * sizeof(*msgs));
+
+		if (!msgs)
+			return -CAN_ERROR_NO_MEM;
+		db->msgs = msgs;
+		ps->msgs_size = size;
+	}
+
+	msg = &db->msgs[db->nmsgs];
+	msg->id = can_sigdb_key(id);
+	msg->first = db->nsigs;
+	msg->nsigs = 0;
+	msg->mux = -1;
+	ps->cur = db->nmsgs++;
+
+	return CAN_ERROR_NONE;
+}
+
+static int can_sigdb_add_sig(can_sigdb_parser_t *ps, const char *name,
+			     const can_sig_def_t *def)
+{
+	ldx_can_sigdb_t *db = ps->db;
+	can_sig_msg_t *msg = &db->msgs[ps->cur];
+
+	if (db->nsigs == ps->sigs_size) {
+		uint32_t size = ps->sigs_size ? ps->sigs_size * 2 : 256;
+		can_sig_def_t *defs = realloc(ps->defs, size * sizeof(*defs));
+		char **names;
+
+		if (!defs)
+			return -CAN_ERROR_NO_MEM;
+		ps->defs = defs;
+		names = realloc(db->names, size * sizeof(*names));
+		if (!names)
+			return -CAN_ERROR_NO_MEM;
+		db->names = names;
+		ps->sigs_size = size;
+	}
+
+	/* Signals of a message are listed right after it */
+	if (msg->first + msg->nsigs != db->nsigs)
+		return -CAN_ERROR_SIGDB_FORMAT;
+
+	db->names[db->nsigs] = strdup(name);
+	if (!db->names[db->nsigs])
+		return -CAN_ERROR_NO_MEM;
+	if (def->is_mux)
+		msg->mux = msg->nsigs;
+	ps->defs[db->nsigs++] = *def;
+	msg->nsigs++;
+
+	return CAN_ERROR_NONE;
+}
+
+/* BO_ <id> <name>: <dlc> <sender> */
+static int can_sigdb_parse_msg(can_sigdb_parser_t *ps, const char *p)
+{
+	unsigned long id;
+
+	if (sscanf(p, "%lu", &id) != 1)
+		return -CAN_ERROR_SIGDB_FORMAT;
+
+	/* Extended IDs have bit 31 set, which is also CAN_EFF_FLAG */
+	return can_sigdb_add_msg(ps, (canid_t)id);
+}
+
+/*
+ * SG_ <name> [M|m<n>] : <start>|<len>@<order><sign> (<factor>,<offset>)
+ *     [<min>|<max>] "<unit>" <receivers>
+ */
+static int can_sigdb_parse_sig(can_sigdb_parser_t *ps, const char *p)
+{
+	char name[CAN_SIGDB_NAME_LEN], mux[16];
+	can_sig_def_t def;
+	char order, sign;
+	int n;
+
+	if (ps->cur < 0)
+		return -CAN_ERROR_SIGDB_FORMAT;
+
+	memset(&def, 0, sizeof(def));
+	def.mux_val = -1;
+
+	if (sscanf(p, "%127s %n", name, &n) != 1)
+		return -CAN_ERROR_SIGDB_FORMAT;
+	p += n;
+
+	if (*p != ':') {
+		if (sscanf(p, "%15s %n", mux, &n) != 1)
+			return -CAN_ERROR_SIGDB_FORMAT;
+		p += n;
+		if (!strcmp(mux, "M"))
+			def.is_mux = true;
+		else if (mux[0] == 'm')
+			def.mux_val = atoi(mux + 1);
+	}
+
+	if (sscanf(p, ": %u|%u@%c%c (%lf,%lf)", &def.start, &def.len, &order,
+		   &sign, &def.factor, &def.offset) != 6)
+		return -CAN_ERROR_SIGDB_FORMAT;
+	def.be = order == '0';
+	def.is_signed = sign == '-';
+
+	return can_sigdb_add_sig(ps, name, &def);
+}
+
+/* SIG_VALTYPE_ <id> <name> : <type>; */
+static int can_sigdb_parse_valtype(can_sigdb_parser_t *ps, const char *p)
+{
+	ldx_can_sigdb_t *db = ps->db;
+	char name[CAN_SIGDB_NAME_LEN];
+	unsigned long id;
+	uint32_t i;
+	int type;
+
+	if (sscanf(p, "%lu %127s : %d", &id, name, &type) != 3)
+		return -CAN_ERROR_SIGDB_FORMAT;
+
+	for (i = 0; i < db->nmsgs; i++) {
+		const can_sig_msg_t *msg = &db->msgs[i];
+		uint32_t s;
+
+		if (msg->id != can_sigdb_key(id))
+			continue;
+		for (s = msg->first; s < msg->first + msg->nsigs; s++) {
+			if (!strcmp(db->names[s], name)) {
+				ps->defs[s].valtype = type;
+				return CAN_ERROR_NONE;
+			}
+		}
+	}
+
+	return -CAN_ERROR_SIGDB_SIG_NOT_FOUND;
+}
+
+/* Turn a DBC signal description into its extraction plan */
+static int can_sigdb_compile_sig(const can_sig_def_t *def, can_sig_t *sig)
+{
+	unsigned int lsb, byte, last;
+
+	if (!def->len || def->len > 64)
+		return -CAN_ERROR_SIGDB_FORMAT;
+
+	memset(sig, 0, sizeof(*sig));
+	if (def->be) {
+		/* Position of the bits counting from the MSB of byte 0 */
+		unsigned int msb = (def->start / 8) * 8 + 7 - def->start % 8;
+
+		lsb = msb + def->len - 1;
+		byte = msb / 8;
+		if (byte > CAN_SIGDB_MAX_BYTE)
+			byte = CAN_SIGDB_MAX_BYTE;
+		if (lsb < byte * 8 || lsb - byte * 8 > 63)
+			return -CAN_ERROR_SIGDB_FORMAT;
+		sig->shift = 63 - (lsb - byte * 8);
+		sig->flags |= CAN_SIG_BE;
+		last = lsb / 8;
+	} else {
+		lsb = def->start;
+		byte = lsb / 8;
+		if (byte > CAN_SIGDB_MAX_BYTE)
+			byte = CAN_SIGDB_MAX_BYTE;
+		if (lsb - byte * 8 + def->len > 64)
+			return -CAN_ERROR_SIGDB_FORMAT;
+		sig->shift = lsb - byte * 8;
+		last = (lsb + def->len - 1) / 8;
+	}
+	if (last >= CANFD_MAX_DLEN)
+		return -CAN_ERROR_SIGDB_FORMAT;
+
+	sig->byte = byte;
+	sig->end = last + 1;
+	sig->sext = 64 - def->len;
+	sig->mask = def->len == 64 ? ~0ULL : (1ULL << def->len) - 1;
+	sig->mux_val = def->mux_val;
+	sig->factor = def->factor;
+	sig->offset = def->offset;
+	if (def->is_signed)
+		sig->flags |= CAN_SIG_SIGNED;
+	if (def->valtype == 1 && def->len == 32)
+		sig->flags |= CAN_SIG_FLOAT32;
+	else if (def->valtype == 2 && def->len == 64)
+		sig->flags |= CAN_SIG_FLOAT64;
+
+	return CAN_ERROR_NONE;
+}
+
+static int can_sigdb_compile(ldx_can_sigdb_t *db, const can_sig_def_t *defs)
+{
+	uint32_t i, hsize = 16;
+
+	db->sigs = calloc(db->nsigs ? db->nsigs : 1, sizeof(*db->sigs));
+	if (!db->sigs)
+		return -CAN_ERROR_NO_MEM;
+
+	for (i = 0; i < db->nsigs; i++) {
+		if (can_sigdb_compile_sig(&defs[i], &db->sigs[i])) {
+			log_error("%s: unsupported layout for signal %s",
+				  __func__, db->names[i]);
+			return -CAN_ERROR_SIGDB_FORMAT;
+		}
+	}
+
+	/* Keep the load factor of the message hash under 50% */
+	while (hsize < db->nmsgs * 2)
+		hsize *= 2;
+	db->hash_keys = malloc(hsize * sizeof(*db->hash_keys));
+	db->hash_msgs = malloc(hsize * sizeof(*db->hash_msgs));
+	if (!db->hash_keys || !db->hash_msgs)
+		return -CAN_ERROR_NO_MEM;
+	memset(db->hash_keys, 0xFF, hsize * sizeof(*db->hash_keys));
+	db->hash_mask = hsize - 1;
+
+	for (i = 0; i < db->nmsgs; i++) {
+		uint32_t key = db->msgs[i].id;
+		uint32_t slot = can_sigdb_hash(key, db->hash_mask);
+
+		while (db->hash_keys[slot] != CAN_SIGDB_EMPTY &&
+		       db->hash_keys[slot] != key)
+			slot = (slot + 1) & db->hash_mask;
+		/* A duplicated message keeps its first definition */
+		if (db->hash_keys[slot] == key)
+			continue;
+		db->hash_keys[slot] = key;
+		db->hash_msgs[slot] = i;
+	}
+
+	return CAN_ERROR_NONE;
+}
+
+ldx_can_sigdb_t *ldx_can_sigdb_load(const char *path)
+{
+	char line[CAN_SIGDB_LINE_LEN];
+	can_sigdb_parser_t ps;
+	unsigned int lineno = 0;
+	int ret = CAN_ERROR_NONE;
+	FILE *f;
+
+	if (!path)
+		return NULL;
+
+	f = fopen(path, "r");
+	if (!f) {
+		log_error("%s: Unable to open %s", __func__, path);
+		return NULL;
+	}
+
+	memset(&ps, 0, sizeof(ps));
+	ps.cur = -1;
+	ps.db = calloc(1, sizeof(ldx_can_sigdb_t));
+	if (!ps.db) {
+		log_error("%s: Unable to allocate memory for signal database",
+			  __func__);
+		fclose(f);
+		return NULL;
+	}
+
+	while (!ret && fgets(line, sizeof(line), f)) {
+		const char *p = line;
+
+		lineno++;
+		while (isspace((unsigned char)*p))
+			p++;
+
+		if (!strncmp(p, "BO_ ", 4))
+			ret = can_sigdb_parse_msg(&ps, p + 4);
+		else if (!strncmp(p, "SG_ ", 4))
+			ret = can_sigdb_parse_sig(&ps, p + 4);
+		else if (!strncmp(p, "SIG_VALTYPE_ ", 13))
+			ret = can_sigdb_parse_valtype(&ps, p + 13);
+		else if (*p && p == line)
+			/* Any other section ends the current message */
+			ps.cur = -1;
+	}
+	fclose(f);
+
+	if (ret) {
+		log_error("%s: %s:%u: %s", __func__, path, lineno,
+			  ldx_can_strerror(-ret));
+	} else {
+		ret = can_sigdb_compile(ps.db, ps.defs);
+	}
+	free(ps.defs);
+
+	if (ret) {
+		ldx_can_sigdb_free(ps.db);
+		return NULL;
+	}
+
+	return ps.db;
+}
+
+void ldx_can_sigdb_free(ldx_can_sigdb_t *db)
+{
+	uint32_t i;
+
+	if (!db)
+		return;
+
+	for (i = 0; i < db->nsigs; i++)
+		free(db->names[i]);
+	free(db->names);
+	free(db->hash_msgs);
+	free(db->hash_keys);
+	free(db->sigs);
+	free(db->msgs);
+	free(db);
+}
+
+int ldx_can_sigdb_msg_signals(const ldx_can_sigdb_t *db, canid_t id)
+{
+	const can_sig_msg_t *msg;
+
+	if (!db)
+		return -CAN_ERROR_SIGDB_MSG_NOT_FOUND;
+
+	msg = can_sigdb_find(db, id);
+	if (!msg)
+		return -CAN_ERROR_SIGDB_MSG_NOT_FOUND;
+
+	return msg->nsigs;
+}
+
+int ldx_can_sigdb_signal_index(const ldx_can_sigdb_t *db, canid_t id,
+			       const char *name)
+{
+	const can_sig_msg_t *msg;
+	uint32_t i;
+
+	if (!db || !name)
+		return -CAN_ERROR_SIGDB_SIG_NOT_FOUND;
+
+	msg = can_sigdb_find(db, id);
+	if (!msg)
+		return -CAN_ERROR_SIGDB_MSG_NOT_FOUND;
+
+	for (i = 0; i < msg->nsigs; i++) {
+		if (!strcmp(db->names[msg->first + i], name))
+			return i;
+	}
+
+	return -CAN_ERROR_SIGDB_SIG_NOT_FOUND;
+}
+
+/* Raw bits of a signal, right aligned */
+static inline uint64_t can_sig_raw(const can_sig_t *sig, const uint8_t *data)
+{
+	uint64_t w;
+
+	memcpy(&w, data + sig->byte, sizeof(w));
+	w = (sig->flags & CAN_SIG_BE) ? be64toh(w) : le64toh(w);
+
+	return (w >> sig->shift) & sig->mask;
+}
+
+static inline double can_sig_value(const can_sig_t *sig, uint64_t raw)
+{
+	double val;
+
+	if (sig->flags & CAN_SIG_FLOAT32) {
+		uint32_t bits = raw;
+		float f;
+
+		memcpy(&f, &bits, sizeof(f));
+		val = f;
+	} else if (sig->flags & CAN_SIG_FLOAT64) {
+		memcpy(&val, &raw, sizeof(val));
+	} else if (sig->flags & CAN_SIG_SIGNED) {
+		val = (double)((int64_t)(raw << sig->sext) >> sig->sext);
+	} else {
+		val = (double)raw;
+	}
+
+	return val * sig->factor + sig->offset;
+}
+
+int ldx_can_sigdb_decode(const ldx_can_sigdb_t *db,
+			 const struct canfd_frame *frame, double *values,
+			 size_t nvalues)
+{
+	const can_sig_msg_t *msg;
+	const can_sig_t *sig;
+	int64_t mux_val = -1;
+	uint32_t i, n;
+
+	if (!db || !frame)
+		return -CAN_ERROR_SIGDB_MSG_NOT_FOUND;
+
+	msg = can_sigdb_find(db, frame->can_id);
+	if (!msg)
+		return -CAN_ERROR_SIGDB_MSG_NOT_FOUND;
+
+	sig = &db->sigs[msg->first];
+	if (msg->mux >= 0 && sig[msg->mux].end <= frame->len)
+		mux_val = can_sig_raw(&sig[msg->mux], frame->data);
+
+	n = msg->nsigs < nvalues ? msg->nsigs : nvalues;
+	for (i = 0; i < n; i++, sig++) {
+		if (sig->end > frame->len ||
+		    (sig->mux_val >= 0 && sig->mux_val != mux_val))
+			values[i] = NAN;
+		else
+			values[i] = can_sig_value(sig,
+						  can_sig_raw(sig, frame->data));
+	}
+
+	return n;
+}
@@ -0,0 +1,348 @@
+/*
+ * Copyright 2018, Digi International Inc.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, you can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE 1
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "can.h"
+#include "_can.h"
+#include "_log.h"
+
+#define CAN_TXQ_MIN_SIZE	16
+
+/*
+ * Arbitration priority of a CAN ID, following the order of the bits on the
+ * bus: base ID, RTR/SRR, IDE, extended ID and RTR. A data frame wins over a
+ * remote frame with the same ID, and a standard frame over an extended one
+ * with the same base ID.
+ */
+static uint32_t can_txq_prio(canid_t id)
+{
+	uint32_t rtr = !!(id & CAN_RTR_FLAG);
+
+	if (id & CAN_EFF_FLAG)
+		return ((id & CAN_EFF_MASK) >> 18) << 21 | 3U << 19 |
+		       (id & 0x3FFFF) << 1 | rtr;
+
+	return (id & CAN_SFF_MASK) << 21 | rtr << 20;
+}
+
+static bool can_txq_before(const can_txq_ent_t *a, const can_txq_ent_t *b)
+{
+	return a->prio < b->prio || (a->prio == b->prio && a->seq < b->seq);
+}
+
+static void can_txq_heap_push(can_txq_t *txq, const can_txq_ent_t *ent)
+{
+	unsigned int i = txq->heap_len++;
+
+	while (i) {
+		unsigned int parent = (i - 1) / 2;
+
+		if (!can_txq_before(ent, &txq->heap[parent]))
+			break;
+		txq->heap[i] = txq->heap[parent];
+		i = parent;
+	}
+	txq->heap[i] = *ent;
+}
+
+static void can_txq_heap_pop(can_txq_t *txq, can_txq_ent_t *ent)
+{
+	can_txq_ent_t *last = &txq->heap[--txq->heap_len];
+	unsigned int i = 0, child;
+
+	*ent = txq->heap[0];
+	while ((child = 2 * i + 1) < txq->heap_len) {
+		if (child + 1 < txq->heap_len &&
+		    can_txq_before(&txq->heap[child + 1], &txq->heap[child]))
+			child++;
+		if (!can_txq_before(&txq->heap[child], last))
+			break;
+		txq->heap[i] = txq->heap[child];
+		i = child;
+	}
+	txq->heap[i] = *last;
+}
+
+/* Move the enqueued frames into the heap, as many as fit */
+static void can_txq_refill(can_txq_t *txq)
+{
+	while (txq->heap_len < txq->size) {
+		can_txq_cell_t *cell = &txq->cells[txq->tail & (txq->size - 1)];
+		uint32_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+		can_txq_ent_t ent;
+
+		if ((int32_t)(seq - (txq->tail + 1)) < 0)
+			break;
+
+		ent.prio = can_txq_prio(cell->frame.can_id);
+		ent.seq = txq->seq++;
+		ent.frame = cell->frame;
+		can_txq_heap_push(txq, &ent);
+
+		/* Hand the slot back to the producers for the next lap */
+		__atomic_store_n(&cell->seq, txq->tail + txq->size,
+				 __ATOMIC_RELEASE);
+		txq->tail++;
+	}
+}
+
+static void can_txq_set_timer(can_txq_t *txq, long ns)
+{
+	struct itimerspec its;
+
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_nsec = ns;
+	timerfd_settime(txq->timer_fd, 0, &its, NULL);
+}
+
+static void can_txq_arm_out(const can_if_t *cif, bool arm)
+{
+	can_priv_t *pdata = cif->_data;
+	struct epoll_event ev;
+
+	if (pdata->txq->out_armed == arm)
+		return;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = arm ? EPOLLIN | EPOLLOUT : EPOLLIN;
+	ev.data.ptr = &pdata->tx_cb;
+	if (epoll_ctl(pdata->epfd, EPOLL_CTL_MOD, pdata->tx_skt, &ev)) {
+		log_error("%s|%s: epoll_ctl mod error (%d)",
+			  cif->name, __func__, errno);
+		return;
+	}
+	pdata->txq->out_armed = arm;
+}
+
+int ldx_can_txq_init(const can_if_t *cif, unsigned int size)
+{
+	can_priv_t *pdata = cif->_data;
+	can_txq_t *txq;
+	uint32_t slots = CAN_TXQ_MIN_SIZE, i;
+	int ret;
+
+	while (slots < size && slots < (1U << 31))
+		slots <<= 1;
+
+	if (posix_memalign((void **)&txq, CAN_CACHELINE_SIZE, sizeof(*txq)))
+		goto err_nomem;
+	memset(txq, 0, sizeof(*txq));
+	txq->timer_fd = -1;
+	pdata->txq = txq;
+
+	txq->size = slots;
+	txq->cells = calloc(slots, sizeof(*txq->cells));
+	txq->heap = calloc(slots, sizeof(*txq->heap));
+	if (!txq->cells || !txq->heap)
+		goto err_nomem;
+	for (i = 0; i < slots; i++)
+		txq->cells[i].seq = i;
+
+	txq->timer_fd = timerfd_create(CLOCK_MONOTONIC,
+				       TFD_NONBLOCK | TFD_CLOEXEC);
+	if (txq->timer_fd < 0) {
+		log_error("%s: Unable to create timerfd on %s", __func__,
+			  cif->name);
+		ret = -CAN_ERROR_EVENTFD;
+		goto err_free;
+	}
+
+	pdata->txq_cb.rx_skt = txq->timer_fd;
+	pdata->txq_cb.handler = NULL;
+	ret = ldx_can_epoll_add(cif, &pdata->txq_cb);
+	if (ret)
+		goto err_free;
+
+	return CAN_ERROR_NONE;
+
+err_nomem:
+	log_error("%s: Unable to allocate transmission queue on %s", __func__,
+		  cif->name);
+	ret = -CAN_ERROR_NO_MEM;
+err_free:
+	ldx_can_txq_free(pdata);
+
+	return ret;
+}
+
+void ldx_can_txq_free(can_priv_t *pdata)
+{
+	can_txq_t *txq = pdata->txq;
+
+	if (!txq)
+		return;
+
+	if (txq->timer_fd >= 0)
+		close(txq->timer_fd);
+	free(txq->heap);
+	free(txq->cells);
+	free(txq);
+	pdata->txq = NULL;
+}
+
+void ldx_can_txq_drain(const can_if_t *cif, bool timer)
+{
+	can_priv_t *pdata = cif->_data;
+	can_txq_t *txq = pdata->txq;
+	can_txq_ent_t ents[LDX_CAN_TX_BATCH_MAX];
+	struct canfd_frame frames[LDX_CAN_TX_BATCH_MAX];
+	unsigned int i, n, sent;
+	bool skt_full;
+	int ret;
+
+	if (!txq)
+		return;
+
+	if (timer) {
+		uint64_t exp;
+
+		if (read(txq->timer_fd, &exp, sizeof(exp)) < 0 &&
+		    errno != EAGAIN)
+			log_debug("%s: timerfd read error (%d)", __func__, errno);
+	}
+
+	/* Frames enqueued from now on request a new drain */
+	(void)__atomic_exchange_n(&txq->kicked, false, __ATOMIC_ACQ_REL);
+
+	for (;;) {
+		can_txq_refill(txq);
+		if (!txq->heap_len)
+			break;
+
+		for (n = 0; n < LDX_CAN_TX_BATCH_MAX && txq->heap_len; n++) {
+			can_txq_heap_pop(txq, &ents[n]);
+			frames[n] = ents[n].frame;
+		}
+
+		ret = ldx_can_tx_batch_i(cif, frames, n, 0, &sent, &skt_full);
+		__atomic_fetch_add(&txq->sent, sent, __ATOMIC_RELAXED);
+		i = sent;
+		if (ret && ret != -CAN_ERROR_TX_RETRY_LATER) {
+			/* Drop the rejected frame so it does not block the rest */
+			ldx_can_call_err_cb(cif, -ret, &ents[i].frame);
+			sent++;
+			i++;
+		}
+		__atomic_sub_fetch(&txq->pending, sent, __ATOMIC_RELAXED);
+		for (; i < n; i++)
+			can_txq_heap_push(txq, &ents[i]);
+
+		if (ret == -CAN_ERROR_TX_RETRY_LATER && skt_full) {
+			/* The socket buffer is full, wait until it is writable */
+			can_txq_arm_out(cif, true);
+			return;
+		}
+		if (ret) {
+			/*
+			 * The device queue is full (ENOBUFS), or failed: the
+			 * socket may still be writable, so back off instead.
+			 */
+			can_txq_set_timer(txq, LDX_CAN_TX_BACKOFF_US * 1000);
+			return;
+		}
+	}
+
+	can_txq_arm_out(cif, false);
+}
+
+int ldx_can_tx_enqueue(const can_if_t *cif, const struct canfd_frame *frame)
+{
+	can_priv_t *pdata;
+	can_txq_t *txq;
+	can_txq_cell_t *cell;
+	uint32_t pos, depth, max;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+	if (!frame)
+		return -CAN_ERROR_INCOMP_FRAME;
+
+	pdata = cif->_data;
+	txq = pdata->txq;
+	if (!txq)
+		return -CAN_ERROR_TXQ_DISABLED;
+
+	/* Claim a slot: free slots have a sequence equal to their position */
+	pos = __atomic_load_n(&txq->head, __ATOMIC_RELAXED);
+	for (;;) {
+		int32_t diff;
+
+		cell = &txq->cells[pos & (txq->size - 1)];
+		diff = (int32_t)(__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) -
+				 pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&txq->head, &pos, pos + 1,
+							true, __ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			__atomic_fetch_add(&txq->overflows, 1, __ATOMIC_RELAXED);
+			return -CAN_ERROR_TXQ_FULL;
+		} else {
+			pos = __atomic_load_n(&txq->head, __ATOMIC_RELAXED);
+		}
+	}
+
+	cell->frame = *frame;
+	__atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+	__atomic_fetch_add(&txq->enqueued, 1, __ATOMIC_RELAXED);
+	depth = __atomic_add_fetch(&txq->pending, 1, __ATOMIC_RELAXED);
+	max = __atomic_load_n(&txq->max_depth, __ATOMIC_RELAXED);
+	while (depth > max &&
+	       !__atomic_compare_exchange_n(&txq->max_depth, &max, depth, true,
+					    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+
+	/* Only the first frame after a drain started wakes the event loop */
+	if (!__atomic_exchange_n(&txq->kicked, true, __ATOMIC_ACQ_REL))
+		can_txq_set_timer(txq, 1);
+
+	return EXIT_SUCCESS;
+}
+
+int ldx_can_txq_get_stats(const can_if_t *cif, ldx_can_txq_stats_t *stats)
+{
+	can_priv_t *pdata;
+	can_txq_t *txq;
+
+	if (!cif)
+		return -CAN_ERROR_NULL_INTERFACE;
+
+	pdata = cif->_data;
+	txq = pdata->txq;
+	if (!txq)
+		return -CAN_ERROR_TXQ_DISABLED;
+
+	stats->size = txq->size;
+	stats->depth = __atomic_load_n(&txq->pending, __ATOMIC_RELAXED);
+	stats->max_depth = __atomic_load_n(&txq->max_depth, __ATOMIC_RELAXED);
+	stats->enqueued = __atomic_load_n(&txq->enqueued, __ATOMIC_RELAXED);
+	stats->sent = __atomic_load_n(&txq->sent, __ATOMIC_RELAXED);
+	stats->overflows = __atomic_load_n(&txq->overflows, __ATOMIC_RELAXED);
+
+	return EXIT_SUCCESS;
+}
@@ -16,6 +16,7 @@
 
 #define _GNU_SOURCE
 
+#include <sched.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -357,3 +358,53 @@ digi_platform_t get_digi_platform()
 
 	return platform;
 }
+
+int thread_attr_init(pthread_attr_t *attr, int priority, uint64_t cpu_mask)
+{
+	int ret;
+
+	ret = pthread_attr_init(attr);
+	if (ret)
+		return ret;
+
+	if (priority > 0) {
+		struct sched_param param;
+		int min = sched_get_priority_min(SCHED_FIFO);
+		int max = sched_get_priority_max(SCHED_FIFO);
+
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = priority < min ? min :
+				       priority > max ? max : priority;
+
+		/* Without this the policy below is silently ignored */
+		ret = pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+		if (!ret)
+			ret = pthread_attr_setschedpolicy(attr, SCHED_FIFO);
+		if (!ret)
+			ret = pthread_attr_setschedparam(attr, &param);
+		if (ret)
+			goto err_destroy;
+	}
+
+	if (cpu_mask) {
+		cpu_set_t cpuset;
+		unsigned int cpu;
+
+		CPU_ZERO(&cpuset);
+		for (cpu = 0; cpu < 64; cpu++) {
+			if (cpu_mask & (1ULL << cpu))
+				CPU_SET(cpu, &cpuset);
+		}
+
+		ret = pthread_attr_setaffinity_np(attr, sizeof(cpuset), &cpuset);
+		if (ret)
+			goto err_destroy;
+	}
+
+	return 0;
+
+err_destroy:
+	pthread_attr_destroy(attr);
+
+	return ret;
+}
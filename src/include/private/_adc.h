@@ -21,6 +21,8 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+
 /**
  * adc_driver_t - Defined values for different type of ADC driver
  */
@@ -54,12 +56,16 @@ typedef struct {
  * @input_fd:		ADC file descriptor.
  * @scale:		ADC scale.
  * @callback:		ADC callback data for asynchronous sampling.
+ * @sched_priority:	SCHED_FIFO priority of the sampling thread.
+ * @cpu_mask:		Bitmask of the CPUs the sampling thread may run on.
  */
 typedef struct {
 	adc_driver_t driver_type;
 	int input_fd;
 	float scale;
 	adc_callback_t *callback;
+	int sched_priority;
+	uint64_t cpu_mask;
 } adc_internal_t;
 
 #ifdef __cplusplus
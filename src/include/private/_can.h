@@ -21,29 +21,70 @@
 extern "C" {
 #endif
 
-#include <sys/select.h>
+#include <linux/netlink.h>
+#include <sys/epoll.h>
+#include <time.h>
 
-/*
- * Define _UAPI_CAN_NETLINK_H to avoid 'libsocketcan.h' including
- * the libsocketcan specific 'can_netlink.h' and use the standard
- * 'linux/can/netlink.h' header
- */
-#define _UAPI_CAN_NETLINK_H
-#include <libsocketcan.h>
 #include "_list.h"
 
+/* Maximum number of readiness events retrieved per epoll_wait() */
+#define CAN_MAX_EPOLL_EVENTS	16
+
+/* Back-off used when the socket is writable but the device queue is full */
+#define LDX_CAN_TX_BACKOFF_US	100
+
+/* Maximum number of event waits serviced by one ldx_can_drain() call */
+#define LDX_CAN_DRAIN_ROUNDS	64
+
+/* Size of the control buffer used to receive timestamps and drop counters */
+#define CAN_CTRLMSG_LEN	(CMSG_SPACE(3 * sizeof(struct timespec)) + \
+			 CMSG_SPACE(sizeof(__u32)))
+
+/**
+ * can_cmsg_layout_t - Layout of the control messages of received frames
+ *
+ * @len:		Total length of the control messages, 0 if not learned.
+ * @ts_off:		Offset of the timestamp message, -1 if there is none.
+ * @ts_type:		Type of the timestamp message.
+ * @ovfl_off:		Offset of the SO_RXQ_OVFL message, -1 if there is none.
+ */
+typedef struct {
+	size_t			len;
+	int			ts_off;
+	int			ts_type;
+	int			ovfl_off;
+} can_cmsg_layout_t;
+
+typedef struct can_id_table can_id_table_t;
+
 /**
  * can_cb - Data required in the CAN rx callback
  *
  * @list:			A list that contains CAN interfaces.
  * @function:		Function to be executed in the callback.
  * @rx_skt:			Reception socket for incoming frames.
- * @droped_frames:	Dropped frames.
+ * @ring:			If not NULL, frames are queued here instead of
+ *				calling the handler.
+ * @id_table:		If not NULL, frames are dispatched through this
+ *				compiled CAN ID table instead of 'handler'.
+ * @batch_handler:	If not NULL, called once per drained batch instead of
+ *				'handler'.
+ * @ctx:			User context passed to 'batch_handler'.
+ * @bcm:			'rx_skt' is a broadcast manager socket delivering
+ *				changes to 'handler'.
+ *
+ * A pointer to this structure is stored in the 'data.ptr' of the epoll
+ * registration of 'rx_skt', so ready sockets map directly to their handler.
  */
 typedef struct can_cb {
 	struct list_head	list;
 	ldx_can_rx_cb_t		handler;
 	int			rx_skt;
+	ldx_can_ring_t		*ring;
+	can_id_table_t		*id_table;
+	ldx_can_rx_batch_cb_t	batch_handler;
+	void			*ctx;
+	bool			bcm;
 } can_cb_t;
 
 /**
@@ -57,16 +98,103 @@ typedef struct can_err_cb {
 	ldx_can_error_cb_t	handler;
 } can_err_cb_t;
 
+/* Keeps the producer and consumer indexes of a queue on separate lines */
+#define CAN_CACHELINE_SIZE	64
+
+/**
+ * can_txq_cell_t - Slot of the transmission queue
+ *
+ * @seq:		Position the slot is ready for: equal to the enqueue position
+ *		when free, one more once written.
+ * @frame:		Queued frame.
+ */
+typedef struct {
+	uint32_t		seq;
+	struct canfd_frame	frame;
+} can_txq_cell_t;
+
+/**
+ * can_txq_ent_t - Frame waiting in the transmission heap
+ *
+ * @prio:		Arbitration priority, lower values are sent first.
+ * @seq:		Arrival order, to keep frames of the same priority in order.
+ * @frame:		The frame.
+ */
+typedef struct {
+	uint32_t		prio;
+	uint64_t		seq;
+	struct canfd_frame	frame;
+} can_txq_ent_t;
+
+/**
+ * can_txq_t - Priority transmission queue of an interface
+ *
+ * @head:		Next enqueue position, shared by the producers.
+ * @pending:		Frames enqueued and not sent yet.
+ * @max_depth:		Maximum value reached by 'pending'.
+ * @enqueued:		Frames accepted since the queue was created.
+ * @overflows:		Frames rejected because the queue was full.
+ * @kicked:		A drain has been requested and not started yet.
+ * @size:		Number of slots (power of two).
+ * @cells:		Slots of the multi-producer queue.
+ * @timer_fd:		Timer expiring when the queue has to be drained: at once
+ *		when frames are enqueued, after a back-off when the device
+ *		queue is full.
+ * @tail:		Next dequeue position, only used by the event loop.
+ * @heap:		Frames taken from 'cells', ordered by priority.
+ * @heap_len:		Number of frames in 'heap'.
+ * @seq:		Arrival counter of the heap entries.
+ * @sent:		Frames sent.
+ * @out_armed:		EPOLLOUT is enabled on the transmission socket.
+ */
+typedef struct {
+	uint32_t		head __attribute__((aligned(CAN_CACHELINE_SIZE)));
+	uint32_t		pending;
+	uint32_t		max_depth;
+	uint64_t		enqueued;
+	uint64_t		overflows;
+	bool			kicked;
+
+	uint32_t		size __attribute__((aligned(CAN_CACHELINE_SIZE)));
+	can_txq_cell_t		*cells;
+	int			timer_fd;
+
+	uint32_t		tail __attribute__((aligned(CAN_CACHELINE_SIZE)));
+	can_txq_ent_t		*heap;
+	unsigned int		heap_len;
+	uint64_t		seq;
+	uint64_t		sent;
+	bool			out_armed;
+} can_txq_t;
+
 /**
  * can_priv_t - Internal data type used by the library
  *
  * @ifr:		Ifreq structure used by the socket layer.
  * @addr:		Sockaddr_can structure used by the socket layer.
  * @tx_skt:		Transmission socket.
+ * @bcm_skt:		Broadcast manager socket of the cyclic transmissions, -1
+ *		until the first one is started.
+ * @nl_skt:		Netlink socket of the link queries, -1 until the first one.
+ * @nl_seq:		Sequence number of the last link query.
+ * @nl_mutex:		Serializes the link queries, independent from 'mutex' so
+ *		they can be done from the handlers.
  * @mtu:		Maximun transmit unit for the CAN interface.
  * @maxdlen:	Maximun length of the data to transmit.
- * @maxfd:		Maximun flexible data rate.
- * @can_fds:	CAN Flexible data rate.
+ * @epfd:		Epoll instance watching the tx socket and the rx sockets with
+ *		a registered handler.
+ * @tx_cb:		Epoll registration data of the tx socket.
+ * @wake_fd:		Eventfd used to wake up (and stop) a blocked wait.
+ * @wake_cb:		Epoll registration data of the wakeup eventfd.
+ * @link_cb:		Epoll registration data of the link events netlink socket,
+ *		whose 'rx_skt' is -1 unless subscribed.
+ * @link_evt:		Last link status reported to the error handlers.
+ * @txq:		Priority transmission queue, NULL unless 'cfg.tx_queue_len'.
+ * @txq_cb:		Epoll registration data of the transmission queue timer.
+ * @reactor:		Reactor servicing the interface, if attached to one.
+ * @id_table:		Handlers registered by CAN ID, see can_dispatch.c.
+ * @cb_gen:		Incremented each time an rx handler is released, to detect
+ *		stale epoll events.
  * @can_tout:	CAN timeval.
  * @can_thr:		Working thread used by the library.
  * @can_thr_attr:	Working thread attribute structure.
@@ -74,16 +202,40 @@ typedef struct can_err_cb {
  * @run_thr:		Variable to check if the thread is running.
  * @rx_cb_list_head:	Linked list head for rx callbacks.
  * @err_cb_list_head:	Linked list head for error callbacks.
+ * @msg:		Message header for single frame reads.
+ * @iov:		I/O vector for single frame reads.
+ * @ctrlmsg:		Control buffer for single frame reads.
+ * @rx_batch:		Number of slots in the batched reception ring.
+ * @rx_evts:		Batched reception ring of events.
+ * @rx_mmsg:		Message headers for recvmmsg(), one per ring slot.
+ * @rx_iov:		I/O vectors, one per ring slot.
+ * @rx_ctrl:		Control buffers, one per ring slot.
+ * @cmsg_layout:	Learned layout of the reception control messages.
+ * @perf:		Performance statistics, NULL unless 'cfg.perf_stats'.
+ * @perf_lock_ns:	Time the mutex was last taken, to measure the hold time.
  */
 typedef struct {
 	struct ifreq		ifr;
 	struct sockaddr_can	addr;
 	int			tx_skt;
+	int			bcm_skt;
+	int			nl_skt;
+	uint32_t		nl_seq;
+	pthread_mutex_t		nl_mutex;
 	uint32_t		mtu;
 	uint32_t		maxdlen;
 
-	int			maxfd;
-	fd_set			can_fds;
+	int			epfd;
+	can_cb_t		tx_cb;
+	int			wake_fd;
+	can_cb_t		wake_cb;
+	can_cb_t		link_cb;
+	ldx_can_link_event_t	link_evt;
+	can_txq_t		*txq;
+	can_cb_t		txq_cb;
+	ldx_can_reactor_t	*reactor;
+	can_id_table_t		*id_table;
+	unsigned int		cb_gen;
 	struct timeval		can_tout;
 
 	pthread_t		*can_thr;
@@ -98,9 +250,651 @@ typedef struct {
 
 	struct msghdr msg;
 	struct iovec iov;
-	char ctrlmsg[CMSG_SPACE(sizeof(struct timeval) + 3 * sizeof(struct timespec) + sizeof(__u32))];
+	char ctrlmsg[CAN_CTRLMSG_LEN];
+
+	unsigned int		rx_batch;
+	ldx_can_event_t		*rx_evts;
+	struct mmsghdr		*rx_mmsg;
+	struct iovec		*rx_iov;
+	char			(*rx_ctrl)[CAN_CTRLMSG_LEN];
+	can_cmsg_layout_t	cmsg_layout;
+
+	ldx_can_perf_stats_t	*perf;
+	uint64_t		perf_lock_ns;
 } can_priv_t;
 
+/**
+ * can_id_handler_t - Handler registered for a CAN ID/mask
+ *
+ * @list:	List of handlers registered in the table.
+ * @id:		CAN ID, with CAN_EFF_FLAG for 29-bit IDs.
+ * @mask:	Bits of the ID that must match.
+ * @handler:	Function to be executed for matching frames.
+ */
+typedef struct can_id_handler {
+	struct list_head	list;
+	canid_t			id;
+	canid_t			mask;
+	ldx_can_rx_cb_t		handler;
+} can_id_handler_t;
+
+/**
+ * struct can_id_table - Compiled CAN ID dispatch table
+ *
+ * @handlers_head:	Registered handlers, the source the table is compiled
+ *			from.
+ * @rxcb:		Shared rx socket feeding the table.
+ * @runs:		NULL terminated runs of handlers. Index 0 is an empty
+ *			run.
+ * @runs_len:		Entries used in 'runs', including the runs left unused
+ *			by updates.
+ * @runs_size:		Allocated entries in 'runs'.
+ * @runs_compiled:	Entries used in 'runs' after the last compilation.
+ * @sff:		Run index for each 11-bit ID.
+ * @eff_keys:		Open addressing hash of the 29-bit IDs registered with
+ *			an exact mask (CAN_ID_TABLE_EMPTY for a free slot).
+ * @eff_runs:		Run index for each entry of 'eff_keys'.
+ * @eff_mask:		Size of the hash minus one.
+ * @eff_wild:		Run of the 29-bit handlers with a partial mask, tested
+ *			one by one when the ID is not in the hash.
+ */
+struct can_id_table {
+	struct list_head	handlers_head;
+	can_cb_t		*rxcb;
+
+	can_id_handler_t	**runs;
+	uint32_t		runs_len;
+	uint32_t		runs_size;
+	uint32_t		runs_compiled;
+	uint32_t		sff[CAN_SFF_MASK + 1];
+	uint32_t		*eff_keys;
+	uint32_t		*eff_runs;
+	uint32_t		eff_mask;
+	uint32_t		eff_wild;
+};
+
+void ldx_can_id_table_dispatch(can_id_table_t *table, ldx_can_event_t *evt);
+void ldx_can_id_table_free(can_id_table_t *table);
+
+/**
+ * ldx_can_add_rx_cb() - Open an rx socket serviced by the library
+ *
+ * @cif:	The CAN interface.
+ * @filters:	A set of kernel filters for the socket.
+ * @nfilters:	The number of filters.
+ * @cb:		Pointer where the new rx handler entry is stored.
+ *
+ * The socket is added to the epoll set and to the list of rx handlers. Must
+ * be called with the mutex held; the caller fills in how the frames are
+ * delivered before releasing it.
+ *
+ * Return: CAN_ERROR_NONE on success, error code otherwise.
+ */
+int ldx_can_add_rx_cb(can_if_t *cif, struct can_filter *filters,
+		      int nfilters, can_cb_t **cb);
+
+/**
+ * ldx_can_epoll_add() - Add a handler entry to the interface epoll set
+ *
+ * @cif:	The CAN interface.
+ * @cb:		Handler entry, watched through its 'rx_skt'.
+ *
+ * Return: CAN_ERROR_NONE on success, error code otherwise.
+ */
+int ldx_can_epoll_add(const can_if_t *cif, can_cb_t *cb);
+
+/**
+ * ldx_can_call_err_cb() - Report an error to the registered error handlers
+ *
+ * @cif:	The CAN interface.
+ * @error:	Error code.
+ * @data:	Data passed to the handlers.
+ */
+void ldx_can_call_err_cb(const can_if_t *cif, int error, void *data);
+
+/**
+ * ldx_can_read_bcm_socket_i() - Read a message from a change handler socket
+ *
+ * @cif:	The CAN interface.
+ * @bcm_cb:	Change handler entry.
+ * @evt:	Event filled with the changed frame.
+ *
+ * Reception timeouts are reported to the error handlers.
+ *
+ * Return: the number of bytes read if 'evt' holds a frame, 0 if there is no
+ *	   frame, error code otherwise.
+ */
+int ldx_can_read_bcm_socket_i(const can_if_t *cif, can_cb_t *bcm_cb,
+			      ldx_can_event_t *evt);
+
+/**
+ * ldx_can_process_link_socket() - Handle the pending link notifications
+ *
+ * @cif:	The CAN interface.
+ *
+ * Changes of the link status are reported to the error handlers. Must be
+ * called with the mutex held.
+ *
+ * Return: 0 on success, error code otherwise.
+ */
+int ldx_can_process_link_socket(const can_if_t *cif);
+
+/**
+ * ldx_can_nl_request() - Send a netlink request and wait for its ack
+ *
+ * @cif:	The CAN interface whose cached netlink socket is used.
+ * @msg:	Request, with its attributes. The sequence number and flags
+ *		are set by the function.
+ * @err_code:	Error code to return if the kernel rejects the request.
+ *
+ * Return: CAN_ERROR_NONE on success, error code otherwise.
+ */
+int ldx_can_nl_request(const can_if_t *cif, struct nlmsghdr *msg, int err_code);
+
+/**
+ * ldx_can_tx_batch_i() - Send frames with a single system call
+ *
+ * @cif:	The CAN interface.
+ * @frames:	Frames to send.
+ * @nframes:	Number of frames, up to LDX_CAN_TX_BATCH_MAX are sent.
+ * @mtu:	CAN_MTU or CANFD_MTU, 0 for the one of the interface.
+ * @sent:	Number of frames sent.
+ * @skt_full:	If not NULL, set when the frames were not taken because the
+ *		socket buffer is full, rather than the device queue.
+ *
+ * Does not wait: -CAN_ERROR_TX_RETRY_LATER is returned if the socket
+ * buffer (EAGAIN) or the device queue (ENOBUFS) is full.
+ *
+ * Return: EXIT_SUCCESS on success, error code otherwise.
+ */
+int ldx_can_tx_batch_i(const can_if_t *cif, struct canfd_frame *frames,
+		       unsigned int nframes, int mtu, unsigned int *sent,
+		       bool *skt_full);
+
+/**
+ * ldx_can_tx_frames_i() - 'ldx_can_tx_frames()' with a given frame size
+ *
+ * @mtu:	CAN_MTU or CANFD_MTU, 0 for the one of the interface.
+ *
+ * Sending with CAN_MTU keeps the frames classic on a CAN FD interface.
+ */
+int ldx_can_tx_frames_i(const can_if_t *cif, struct canfd_frame *frames,
+			unsigned int nframes, int mtu, unsigned int *sent);
+
+/**
+ * ldx_can_txq_init() - Create the priority transmission queue
+ *
+ * @cif:	The CAN interface, with its epoll instance created.
+ * @size:	Minimum number of frames of the queue.
+ *
+ * Return: CAN_ERROR_NONE on success, error code otherwise.
+ */
+int ldx_can_txq_init(const can_if_t *cif, unsigned int size);
+
+/**
+ * ldx_can_txq_free() - Release the priority transmission queue
+ *
+ * @pdata:	Internal data of the interface. Queued frames are dropped.
+ */
+void ldx_can_txq_free(can_priv_t *pdata);
+
+/**
+ * ldx_can_txq_drain() - Send the queued frames in priority order
+ *
+ * @cif:	The CAN interface.
+ * @timer:	Called because the queue timer expired.
+ *
+ * Sends until the queue is empty or the socket is full, then waits for
+ * EPOLLOUT or the back-off timer. Must be called with the mutex held.
+ */
+void ldx_can_txq_drain(const can_if_t *cif, bool timer);
+
+/**
+ * ldx_can_close_rx_socket_impl() - Close an rx socket and its handler entry
+ *
+ * @cif:	The CAN interface.
+ * @rx_skt:	The socket to close.
+ *
+ * Must be called with the mutex held.
+ */
+void ldx_can_close_rx_socket_impl(const can_if_t *cif, int rx_skt);
+
+/**
+ * struct ldx_can_ring - Single producer/single consumer queue of events
+ *
+ * @head:		Next slot to write, only written by the producer.
+ * @tail_cache:		Producer copy of 'tail', refreshed when full.
+ * @enqueued:		Number of events queued.
+ * @overflows:		Number of events dropped because the ring was full.
+ * @tail:		Next slot to read, only written by the consumer.
+ * @head_cache:		Consumer copy of 'head', refreshed when empty.
+ * @mask:		Number of slots minus one (power of two).
+ * @notify_fd:		Eventfd signalled after each batch, -1 if disabled.
+ * @rx_skt:		Reception socket feeding the ring.
+ * @slots:		Ring storage.
+ */
+struct ldx_can_ring {
+	uint32_t		head __attribute__((aligned(CAN_CACHELINE_SIZE)));
+	uint32_t		tail_cache;
+	uint64_t		enqueued;
+	uint64_t		overflows;
+
+	uint32_t		tail __attribute__((aligned(CAN_CACHELINE_SIZE)));
+	uint32_t		head_cache;
+
+	uint32_t		mask __attribute__((aligned(CAN_CACHELINE_SIZE)));
+	int			notify_fd;
+	int			rx_skt;
+	ldx_can_event_t		*slots;
+};
+
+ldx_can_ring_t *ldx_can_ring_alloc(unsigned int size, bool notify);
+void ldx_can_ring_release(ldx_can_ring_t *ring);
+
+/**
+ * ldx_can_ring_push_bulk() - Queue events into a ring (producer side)
+ *
+ * @ring:	The ring.
+ * @evts:	Events to queue.
+ * @n:		Number of events.
+ *
+ * Events that do not fit are dropped and accounted as overflows.
+ *
+ * Return: the number of events queued.
+ */
+unsigned int ldx_can_ring_push_bulk(ldx_can_ring_t *ring,
+				    const ldx_can_event_t *evts, unsigned int n);
+
+/**
+ * struct ldx_can_capture - Internal data of a TPACKET_V3 capture
+ *
+ * @fd:			AF_PACKET socket bound to the CAN interface.
+ * @map:		Memory mapped ring of blocks shared with the kernel.
+ * @map_len:		Length of the mapping.
+ * @block_size:		Size of each block.
+ * @block_nr:		Number of blocks.
+ * @cur:		Next block to hand out.
+ */
+struct ldx_can_capture {
+	int			fd;
+	uint8_t			*map;
+	size_t			map_len;
+	unsigned int		block_size;
+	unsigned int		block_nr;
+	unsigned int		cur;
+};
+
+/**
+ * struct ldx_can_isotp - Internal data of an ISO-TP session
+ *
+ * @cif:		The CAN interface.
+ * @fd:			CAN_ISOTP socket, or CAN_RAW socket of the user space
+ *			engine.
+ * @offloaded:		The kernel implements the protocol.
+ * @cfg:		Session configuration.
+ * @tx_dl:		Maximum data length of the frames (8 or 64).
+ * @mtu:		Size of the frames written to the CAN_RAW socket.
+ */
+struct ldx_can_isotp {
+	can_if_t		*cif;
+	int			fd;
+	bool			offloaded;
+	ldx_can_isotp_cfg_t	cfg;
+	unsigned int		tx_dl;
+	unsigned int		mtu;
+};
+
+/*
+ * Binary frame log, in host byte order:
+ *
+ *   file header | block header | records ... | block header | records ...
+ *   | index entries | trailer
+ *
+ * The index and the trailer are only written when the recorder stops.
+ */
+#define CAN_LOG_MAGIC		"LDXCANLG"
+#define CAN_LOG_INDEX_MAGIC	"LDXCANIX"
+#define CAN_LOG_VERSION		1
+#define CAN_LOG_BLOCK_MAGIC	0x4B4C4243	/* "CBLK" */
+#define CAN_LOG_BLOCK_SIZE	(256 * 1024)
+
+/* Blocks a recorder can fill while the previous ones are being written */
+#define CAN_LOG_NBLOCKS		4
+
+/* Record flag for CAN FD frames, next to CANFD_BRS and CANFD_ESI */
+#define CAN_LOG_REC_FD		0x80
+
+/**
+ * can_log_file_hdr_t - Header at the beginning of a frame log
+ *
+ * @magic:	CAN_LOG_MAGIC.
+ * @version:	CAN_LOG_VERSION.
+ * @hdr_len:	Size of this header, the first block follows it.
+ * @reserved:	Set to 0.
+ * @start_ns:	CLOCK_REALTIME time the recording started, in ns.
+ */
+typedef struct __attribute__((packed)) {
+	char			magic[8];
+	uint16_t		version;
+	uint16_t		hdr_len;
+	uint32_t		reserved;
+	uint64_t		start_ns;
+} can_log_file_hdr_t;
+
+/**
+ * can_log_block_hdr_t - Header of a block of records
+ *
+ * @magic:	CAN_LOG_BLOCK_MAGIC.
+ * @len:	Length of the records following the header.
+ * @nrecs:	Number of records in the block.
+ * @reserved:	Set to 0.
+ * @first_ns:	Timestamp of the first record.
+ * @last_ns:	Timestamp of the last record.
+ */
+typedef struct __attribute__((packed)) {
+	uint32_t		magic;
+	uint32_t		len;
+	uint32_t		nrecs;
+	uint32_t		reserved;
+	uint64_t		first_ns;
+	uint64_t		last_ns;
+} can_log_block_hdr_t;
+
+/**
+ * can_log_rec_t - Recorded frame, followed by 'len' bytes of payload
+ *
+ * @ts_ns:	Reception time in ns (hardware timestamp if available).
+ * @can_id:	CAN ID with the EFF/RTR/ERR flags.
+ * @flags:	CANFD_BRS, CANFD_ESI and CAN_LOG_REC_FD.
+ * @len:	Payload length.
+ */
+typedef struct __attribute__((packed)) {
+	uint64_t		ts_ns;
+	uint32_t		can_id;
+	uint8_t			flags;
+	uint8_t			len;
+} can_log_rec_t;
+
+/**
+ * can_log_index_ent_t - Block index entry
+ *
+ * @offset:	File offset of the block header.
+ * @first_ns:	Timestamp of the first record of the block.
+ */
+typedef struct __attribute__((packed)) {
+	uint64_t		offset;
+	uint64_t		first_ns;
+} can_log_index_ent_t;
+
+/**
+ * can_log_trailer_t - Last bytes of a completed frame log
+ *
+ * @index_off:	File offset of the first index entry.
+ * @nblocks:	Number of index entries.
+ * @reserved:	Set to 0.
+ * @magic:	CAN_LOG_INDEX_MAGIC.
+ */
+typedef struct __attribute__((packed)) {
+	uint64_t		index_off;
+	uint32_t		nblocks;
+	uint32_t		reserved;
+	char			magic[8];
+} can_log_trailer_t;
+
+/**
+ * struct ldx_can_recorder - Internal data of a frame recorder
+ *
+ * @cif:		The CAN interface.
+ * @fd:			Log file.
+ * @handle:		Batch handler feeding the recorder.
+ * @blocks:		Block buffers, each starting with its header.
+ * @lens:		Bytes used in each of the blocks handed to the writer.
+ * @wr:			Block being filled by the reception path.
+ * @rd:			Next block to write.
+ * @nfull:		Blocks handed to the writer and not written yet.
+ * @used:		Bytes used in the block being filled.
+ * @writer:		Thread writing the blocks to the file.
+ * @mutex:		Protects 'rd', 'nfull' and 'stop'.
+ * @cond:		Signalled when a block is handed over or on stop.
+ * @stop:		Set to make the writer exit once every block is written.
+ * @offset:		File offset of the next block.
+ * @index:		Index of the blocks written.
+ * @nblocks:		Number of entries in 'index'.
+ * @index_size:		Allocated entries in 'index'.
+ * @frames:		Number of frames recorded.
+ * @dropped:		Frames lost because every block was waiting for the
+ *			writer.
+ * @error:		First write error, the recording stops after it.
+ */
+struct ldx_can_recorder {
+	can_if_t		*cif;
+	int			fd;
+	int			handle;
+	uint8_t			*blocks[CAN_LOG_NBLOCKS];
+	size_t			lens[CAN_LOG_NBLOCKS];
+	unsigned int		wr;
+	unsigned int		rd;
+	unsigned int		nfull;
+	size_t			used;
+	pthread_t		writer;
+	pthread_mutex_t		mutex;
+	pthread_cond_t		cond;
+	bool			stop;
+	uint64_t		offset;
+	can_log_index_ent_t	*index;
+	unsigned int		nblocks;
+	unsigned int		index_size;
+	uint64_t		frames;
+	uint64_t		dropped;
+	int			error;
+};
+
+/* Flags of a compiled signal */
+#define CAN_SIG_BE		0x01
+#define CAN_SIG_SIGNED		0x02
+#define CAN_SIG_FLOAT32		0x04
+#define CAN_SIG_FLOAT64		0x08
+
+/**
+ * can_sig_t - Extraction plan of a signal
+ *
+ * @byte:	First byte of the 8-byte window holding the signal.
+ * @shift:	Right shift of the window, once in host order, to the LSB.
+ * @sext:	Left shift that moves the MSB of the signal to bit 63, used to
+ *		extend the sign.
+ * @flags:	CAN_SIG_* flags.
+ * @end:	Frame length needed for the signal to be present.
+ * @mux_val:	Multiplexor value selecting the signal, -1 if always present.
+ * @mask:	Mask of the signal length.
+ * @factor:	Scale of the physical value.
+ * @offset:	Offset of the physical value.
+ */
+typedef struct {
+	uint8_t			byte;
+	uint8_t			shift;
+	uint8_t			sext;
+	uint8_t			flags;
+	uint8_t			end;
+	int32_t			mux_val;
+	uint64_t		mask;
+	double			factor;
+	double			offset;
+} can_sig_t;
+
+/**
+ * can_sig_msg_t - Message of a signal database
+ *
+ * @id:		CAN ID, with CAN_EFF_FLAG for 29-bit IDs.
+ * @first:	Index of the first signal in the signal arrays.
+ * @nsigs:	Number of signals.
+ * @mux:	Index of the multiplexor signal within the message, -1 if
+ *		there is none.
+ */
+typedef struct {
+	canid_t			id;
+	uint32_t		first;
+	uint32_t		nsigs;
+	int32_t			mux;
+} can_sig_msg_t;
+
+/**
+ * struct ldx_can_sigdb - Internal data of a signal database
+ *
+ * @msgs:	Messages.
+ * @nmsgs:	Number of messages.
+ * @sigs:	Extraction plans, grouped by message.
+ * @names:	Signal names, in the same order as 'sigs'.
+ * @nsigs:	Number of signals.
+ * @hash_keys:	Open addressing hash of the message IDs.
+ * @hash_msgs:	Message index for each entry of 'hash_keys'.
+ * @hash_mask:	Size of the hash minus one.
+ */
+struct ldx_can_sigdb {
+	can_sig_msg_t		*msgs;
+	uint32_t		nmsgs;
+	can_sig_t		*sigs;
+	char			**names;
+	uint32_t		nsigs;
+	uint32_t		*hash_keys;
+	uint32_t		*hash_msgs;
+	uint32_t		hash_mask;
+};
+
+/**
+ * struct ldx_can_filter_set - Internal data of a set of reception filters
+ *
+ * @join:	The filters are joined (CAN_RAW_JOIN_FILTERS).
+ * @n:		Number of filters.
+ * @filters:	Normalized filters.
+ */
+struct ldx_can_filter_set {
+	bool			join;
+	unsigned int		n;
+	struct can_filter	filters[];
+};
+
+/**
+ * struct ldx_can_link_req - Internal data of a link configuration request
+ *
+ * @fd:		NETLINK_ROUTE socket the requests were sent on.
+ * @n:		Number of interfaces.
+ * @cifs:	The interfaces, request 'i' uses sequence number 'i + 1'.
+ * @cfgs:	Copy of the configuration of each interface.
+ * @start:	The interfaces are brought up.
+ */
+struct ldx_can_link_req {
+	int			fd;
+	unsigned int		n;
+	can_if_t		**cifs;
+	can_if_cfg_t		*cfgs;
+	bool			start;
+};
+
+/* Kernel gateway jobs of a route */
+#define CAN_GW_JOB_CAN		0x01
+#define CAN_GW_JOB_CANFD	0x02
+
+/**
+ * struct ldx_can_route - Internal data of a route
+ *
+ * @src:		Source interface.
+ * @dst:		Destination interface.
+ * @cfg:		Routing rule.
+ * @kjobs:		Kernel gateway jobs programmed (CAN_GW_JOB_*), 0 if the
+ *		route is forwarded in user space.
+ * @handle:		Batch handler of the user space forwarder, -1 if none.
+ * @frames:		Frames of the batch being forwarded.
+ * @nframes:		Number of entries of 'frames'.
+ */
+struct ldx_can_route {
+	can_if_t		*src;
+	const can_if_t		*dst;
+	ldx_can_route_cfg_t	cfg;
+	unsigned int		kjobs;
+	int			handle;
+	struct canfd_frame	*frames;
+	unsigned int		nframes;
+};
+
+/**
+ * can_reactor_if_t - Interface attached to a reactor
+ *
+ * @list:	List of interfaces attached to the reactor.
+ * @cif:	The attached CAN interface.
+ * @id:		Unique identifier stored in the epoll registration.
+ * @busy:	A worker is currently processing the interface.
+ * @worker:	The worker processing the interface, valid while 'busy'.
+ */
+typedef struct can_reactor_if {
+	struct list_head	list;
+	can_if_t		*cif;
+	uint64_t		id;
+	bool			busy;
+	pthread_t		worker;
+} can_reactor_if_t;
+
+/**
+ * struct ldx_can_reactor - Internal data of a CAN reactor
+ *
+ * @epfd:		Epoll instance watching the epoll instance of each
+ *			attached interface (one shot) and the wakeup eventfd.
+ * @wake_fd:		Eventfd used to stop the workers.
+ * @run:		Variable to check if the workers must keep running.
+ * @nthreads:		Number of worker threads.
+ * @threads:		Worker threads.
+ * @mutex:		Protects the list of attached interfaces.
+ * @idle:		Signalled when a worker finishes with an interface.
+ * @next_id:		Identifier for the next attached interface.
+ * @if_list_head:	Linked list head for attached interfaces.
+ */
+struct ldx_can_reactor {
+	int			epfd;
+	int			wake_fd;
+	bool			run;
+	unsigned int		nthreads;
+	pthread_t		*threads;
+	pthread_mutex_t		mutex;
+	pthread_cond_t		idle;
+	uint64_t		next_id;
+	struct list_head	if_list_head;
+};
+
+/* Current CLOCK_MONOTONIC time in ns, the time base of the statistics */
+static inline uint64_t ldx_can_perf_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Counters are updated from several threads without taking any lock */
+static inline void ldx_can_perf_add(uint64_t *counter, uint64_t val)
+{
+	__atomic_fetch_add(counter, val, __ATOMIC_RELAXED);
+}
+
+/**
+ * ldx_can_perf_hist_record() - Record a value into a histogram
+ *
+ * @hist:	The histogram.
+ * @val:	Value to record.
+ */
+void ldx_can_perf_hist_record(ldx_can_perf_hist_t *hist, uint64_t val);
+
+/**
+ * ldx_can_process_events() - Wait for and process the interface events
+ *
+ * @cif:	The CAN interface.
+ * @tout_ms:	Maximum time to wait in ms, -1 to wait indefinitely.
+ *
+ * Waits on the interface epoll instance and dispatches every ready source.
+ * The interface mutex is only taken once there is something to dispatch.
+ *
+ * Return: the number of ready sources handled, negative error code otherwise.
+ */
+int ldx_can_process_events(const can_if_t *cif, int tout_ms);
+
 #ifdef __cplusplus
 }
 #endif
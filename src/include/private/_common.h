@@ -22,6 +22,8 @@ extern "C" {
 #endif
 
 #include <libsoc_board.h>
+#include <pthread.h>
+#include <stdint.h>
 
 #include "common.h"
 
@@ -163,6 +165,21 @@ digi_platform_t get_digi_platform();
  */
 char *concat_path(const char *dir, const char *file);
 
+/**
+ * thread_attr_init() - Initialize thread attributes with scheduling settings
+ *
+ * @attr:	The thread attributes to initialize.
+ * @priority:	SCHED_FIFO priority. 0 keeps the inherited scheduling policy.
+ * @cpu_mask:	Bitmask of the CPUs the thread may run on. 0 keeps the
+ *		inherited affinity.
+ *
+ * The priority is clamped to the range allowed for SCHED_FIFO. The attributes
+ * must be released with 'pthread_attr_destroy()'.
+ *
+ * Return: 0 on success, an error number otherwise.
+ */
+int thread_attr_init(pthread_attr_t *attr, int priority, uint64_t cpu_mask);
+
 #ifdef __cplusplus
 }
 #endif
@@ -161,6 +161,23 @@ int ldx_adc_start_sampling(adc_t *adc, const ldx_adc_read_cb_t read_cb,
  */
 int ldx_adc_stop_sampling(adc_t *adc);
 
+/**
+ * ldx_adc_set_sampling_sched() - Set the scheduling of the sampling thread
+ *
+ * @adc:	A pointer to a requested ADC.
+ * @priority:	SCHED_FIFO priority of the sampling thread. 0 keeps the default
+ *		scheduling policy.
+ * @cpu_mask:	Bitmask of the CPUs the sampling thread may run on. 0 keeps the
+ *		default affinity.
+ *
+ * The settings apply to the next 'ldx_adc_start_sampling()'. A real-time
+ * priority requires the CAP_SYS_NICE capability; without it the sampling
+ * fails to start.
+ *
+ * Return: EXIT_SUCCESS on success, EXIT_FAILURE otherwise.
+ */
+int ldx_adc_set_sampling_sched(adc_t *adc, int priority, uint64_t cpu_mask);
+
 /**
  * ldx_adc_set_scale() - Set the scaling factor for the ADC sampling
  *
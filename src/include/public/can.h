@@ -25,8 +25,10 @@ extern "C" {
 #include <linux/can/netlink.h>
 #include <net/if.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/time.h>
+#include <time.h>
 
 #define NLMSG_TAIL(nmsg) \
         ((struct rtattr *)(((void *) (nmsg)) + NLMSG_ALIGN((nmsg)->nlmsg_len)))
@@ -34,6 +36,19 @@ extern "C" {
 #define LDX_CAN_DEF_TOUT_SEC	0
 #define LDX_CAN_DEF_TOUT_USEC	0
 
+#define LDX_CAN_DEF_RX_BATCH	16
+#define LDX_CAN_TX_BATCH_MAX	64
+
+#define LDX_CAN_CAPTURE_DEF_BLOCK_SIZE	(1 << 20)
+#define LDX_CAN_CAPTURE_DEF_BLOCK_NR	8
+#define LDX_CAN_CAPTURE_DEF_TOUT_MS	10
+
+#define LDX_CAN_PERF_HIST_SUB_BITS	4
+#define LDX_CAN_PERF_HIST_BUCKETS	512
+
+#define LDX_CAN_ISOTP_DEF_TOUT_MS	1000
+#define LDX_CAN_ISOTP_DEF_PAD_BYTE	0xCC
+
 #define LDX_CAN_INVALID_BITRATE		0
 #define LDX_CAN_INVALID_RESTART_MS	0
 #define LDX_CAN_UNCONFIGURED_MASK 0
@@ -42,6 +57,13 @@ extern "C" {
  * Callback functions
  */
 typedef void (*ldx_can_rx_cb_t)(struct canfd_frame *frame, struct timeval *tv);
+/*
+ * 'data' is NULL unless the error says otherwise:
+ *  - CAN_ERROR_LINK_EVENT: the 'ldx_can_link_event_t' of the change.
+ *  - CAN_ERROR_TX_SKT_WR, CAN_ERROR_INCOMP_FRAME from the transmission
+ *    queue: the 'struct canfd_frame' that was dropped.
+ * It is only valid during the call.
+ */
 typedef void (*ldx_can_error_cb_t)(int error, void *data);
 
 /**
@@ -60,6 +82,26 @@ typedef void (*ldx_can_error_cb_t)(int error, void *data);
  * @error_mask:		 	Struct with the CAN error mask.
  * @bit_timing:			Struct with the CAN bittiming values.
  * @ctrl_mode:			Struct with the CAN control mode values.
+ * @polled_mode:		Do not create the library reception thread.
+ * @rx_batch_size:		Maximum number of frames drained per recvmmsg() call
+ *				(0 selects LDX_CAN_DEF_RX_BATCH).
+ * @tx_wait_ms:			Time ldx_can_tx_frames() waits for the transmission
+ *				socket to become writable when the queue is full
+ *				(0 returns at once, negative waits forever).
+ * @rx_spin_us:			Time the reception thread keeps busy-polling after
+ *				the last frame before blocking (0 disables it).
+ * @thread_priority:		SCHED_FIFO priority of the reception thread
+ *				(0 keeps the default scheduling policy).
+ * @thread_cpu_mask:		Bitmask of the CPUs the reception thread may run
+ *				on (0 keeps the default affinity).
+ * @busy_poll_us:		SO_BUSY_POLL time in microseconds applied to the
+ *				reception sockets (0 disables it).
+ * @skt_priority:		SO_PRIORITY applied to the CAN sockets (negative
+ *				keeps the default priority).
+ * @perf_stats:			Collect the performance statistics returned by
+ *				ldx_can_get_perf_stats().
+ * @tx_queue_len:		Number of frames of the priority transmission queue
+ *				used by ldx_can_tx_enqueue() (0 disables it).
  */
 typedef struct can_if_cfg {
 	bool			nl_cmd_verify;
@@ -78,6 +120,15 @@ typedef struct can_if_cfg {
 	struct can_bittiming	dbit_timing;
 	struct can_ctrlmode	ctrl_mode;
 	bool			polled_mode; /* Do not spin up a thread */
+	unsigned int		rx_batch_size;
+	int			tx_wait_ms;
+	unsigned int		rx_spin_us;
+	int			thread_priority;
+	uint64_t		thread_cpu_mask;
+	int			busy_poll_us;
+	int			skt_priority;
+	bool			perf_stats;
+	unsigned int		tx_queue_len;
 } can_if_cfg_t;
 
 typedef struct can_if {
@@ -87,6 +138,242 @@ typedef struct can_if {
 	void			*_data;
 } can_if_t;
 
+/**
+ * ldx_can_capture_t - Zero-copy capture of all the frames of an interface
+ *
+ * See 'ldx_can_capture_open()'.
+ */
+typedef struct ldx_can_capture ldx_can_capture_t;
+
+/**
+ * ldx_can_capture_cfg_t - CAN capture configuration type.
+ *
+ * @block_size:		Size of each ring block in bytes, a multiple of the page
+ *			size (0 selects LDX_CAN_CAPTURE_DEF_BLOCK_SIZE).
+ * @block_nr:		Number of blocks in the ring (0 selects
+ *			LDX_CAN_CAPTURE_DEF_BLOCK_NR).
+ * @block_tout_ms:	Time after which the kernel hands out a block that is
+ *			not full (0 selects LDX_CAN_CAPTURE_DEF_TOUT_MS).
+ */
+typedef struct ldx_can_capture_cfg {
+	unsigned int		block_size;
+	unsigned int		block_nr;
+	unsigned int		block_tout_ms;
+} ldx_can_capture_cfg_t;
+
+/**
+ * ldx_can_capture_block_t - Block of captured frames owned by the user.
+ *
+ * @nframes:		Number of frames in the block.
+ *
+ * The remaining fields are for internal usage.
+ */
+typedef struct ldx_can_capture_block {
+	uint32_t		nframes;
+	uint32_t		_left;
+	void			*_desc;
+	void			*_next;
+} ldx_can_capture_block_t;
+
+/**
+ * ldx_can_perf_hist_t - HDR histogram of a measured value.
+ *
+ * @count:		Number of recorded values.
+ * @sum:		Sum of the recorded values.
+ * @max:		Largest recorded value.
+ * @buckets:		Values below 2^LDX_CAN_PERF_HIST_SUB_BITS have a
+ *			bucket each. Every larger power of two range is split
+ *			in 2^LDX_CAN_PERF_HIST_SUB_BITS linear buckets, so a
+ *			bucket is at most 1/16 of its values wide. The last
+ *			bucket also holds every value from 2^35.
+ */
+typedef struct ldx_can_perf_hist {
+	uint64_t		count;
+	uint64_t		sum;
+	uint64_t		max;
+	uint64_t		buckets[LDX_CAN_PERF_HIST_BUCKETS];
+} ldx_can_perf_hist_t;
+
+/**
+ * ldx_can_perf_stats_t - CAN interface performance statistics.
+ *
+ * @rx_frames:		Frames read from the reception sockets.
+ * @rx_bytes:		Bytes read from the reception sockets.
+ * @rx_syscalls:	Read system calls on the reception sockets.
+ * @rx_dropped:		Frames dropped by the kernel (SO_RXQ_OVFL).
+ * @tx_frames:		Frames written to the transmission socket.
+ * @tx_bytes:		Bytes written to the transmission socket.
+ * @tx_syscalls:	Write system calls on the transmission socket.
+ * @tx_retry_later:	Transmissions that returned -CAN_ERROR_TX_RETRY_LATER.
+ * @rx_batch:		Frames drained per read system call.
+ * @rx_latency_ns:	Time from the kernel software reception timestamp to the
+ *			handler invocation. Needs 'process_header'.
+ * @lock_wait_ns:	Time spent waiting for the interface mutex.
+ * @lock_hold_ns:	Time the interface mutex was held.
+ */
+typedef struct ldx_can_perf_stats {
+	uint64_t		rx_frames;
+	uint64_t		rx_bytes;
+	uint64_t		rx_syscalls;
+	uint64_t		rx_dropped;
+	uint64_t		tx_frames;
+	uint64_t		tx_bytes;
+	uint64_t		tx_syscalls;
+	uint64_t		tx_retry_later;
+	ldx_can_perf_hist_t	rx_batch;
+	ldx_can_perf_hist_t	rx_latency_ns;
+	ldx_can_perf_hist_t	lock_wait_ns;
+	ldx_can_perf_hist_t	lock_hold_ns;
+} ldx_can_perf_stats_t;
+
+/**
+ * ldx_can_isotp_t - ISO-TP (ISO 15765-2) session
+ *
+ * See 'ldx_can_isotp_open()'.
+ */
+typedef struct ldx_can_isotp ldx_can_isotp_t;
+
+/**
+ * ldx_can_isotp_cfg_t - ISO-TP session configuration type.
+ *
+ * @tx_id:		CAN ID of the transmitted frames (CAN_EFF_FLAG for
+ *			29-bit IDs).
+ * @rx_id:		CAN ID of the received frames (CAN_EFF_FLAG for 29-bit
+ *			IDs).
+ * @block_size:		Block size announced in the flow control frames sent
+ *			while receiving (0 means no limit).
+ * @st_min:		Separation time announced in the flow control frames
+ *			sent while receiving, in ISO 15765-2 encoding.
+ * @tx_padding:		Pad the transmitted frames to the full frame length.
+ * @pad_byte:		Padding value (see LDX_CAN_ISOTP_DEF_PAD_BYTE).
+ * @timeout_ms:		Time to wait for the flow control and consecutive
+ *			frames (N_Bs/N_Cr), 0 selects LDX_CAN_ISOTP_DEF_TOUT_MS.
+ * @no_offload:		Do not use the kernel CAN_ISOTP protocol even if it is
+ *			available.
+ */
+typedef struct ldx_can_isotp_cfg {
+	canid_t			tx_id;
+	canid_t			rx_id;
+	uint8_t			block_size;
+	uint8_t			st_min;
+	bool			tx_padding;
+	uint8_t			pad_byte;
+	int			timeout_ms;
+	bool			no_offload;
+} ldx_can_isotp_cfg_t;
+
+/**
+ * ldx_can_recorder_t - Binary frame recorder
+ *
+ * See 'ldx_can_recorder_start()'.
+ */
+typedef struct ldx_can_recorder ldx_can_recorder_t;
+
+/**
+ * ldx_can_sigdb_t - Signal database compiled from a DBC description
+ *
+ * See 'ldx_can_sigdb_load()'.
+ */
+typedef struct ldx_can_sigdb ldx_can_sigdb_t;
+
+/**
+ * ldx_can_link_req_t - Link configuration request in flight
+ *
+ * See 'ldx_can_link_config_send()'.
+ */
+typedef struct ldx_can_link_req ldx_can_link_req_t;
+
+/**
+ * ldx_can_filter_set_t - Precomputed set of kernel reception filters
+ *
+ * See 'ldx_can_filter_set_create()'.
+ */
+typedef struct ldx_can_filter_set ldx_can_filter_set_t;
+
+/**
+ * ldx_can_route_cb_t - User logic of a routing rule
+ *
+ * @ctx:	User context of the rule.
+ * @frame:	Frame about to be forwarded, it can be modified.
+ *
+ * Return: true to forward the frame, false to drop it.
+ */
+typedef bool (*ldx_can_route_cb_t)(void *ctx, struct canfd_frame *frame);
+
+/**
+ * ldx_can_route_cfg_t - Routing rule between two CAN interfaces
+ *
+ * @filter:	Frames of the source interface to forward. A zero mask
+ *		forwards all of them.
+ * @set_id:	Replace the CAN ID of the forwarded frames with 'new_id'.
+ * @new_id:	New CAN ID, including CAN_EFF_FLAG for 29-bit IDs.
+ * @max_hops:	If not 0, maximum number of gateways a frame can cross.
+ *		Only used by the kernel gateway.
+ * @cb:		If not NULL, called for each frame before forwarding it.
+ *		Rules with a callback are forwarded in user space.
+ * @ctx:	User context passed to 'cb'.
+ * @no_offload:	Forward in user space even if the kernel could do it.
+ * @canfd:	Also forward CAN FD frames, both interfaces must have CAN FD
+ *		enabled. Without it, only classic frames are forwarded and
+ *		they are sent as classic frames.
+ */
+typedef struct {
+	struct can_filter	filter;
+	bool			set_id;
+	canid_t			new_id;
+	uint8_t			max_hops;
+	ldx_can_route_cb_t	cb;
+	void			*ctx;
+	bool			no_offload;
+	bool			canfd;
+} ldx_can_route_cfg_t;
+
+/**
+ * ldx_can_route_t - Frame forwarding between CAN interfaces
+ *
+ * See 'ldx_can_route_add()'.
+ */
+typedef struct ldx_can_route ldx_can_route_t;
+
+/**
+ * ldx_can_reactor_t - Event loop shared by several CAN interfaces
+ *
+ * See 'ldx_can_reactor_create()'.
+ */
+typedef struct ldx_can_reactor ldx_can_reactor_t;
+
+/**
+ * ldx_can_reactor_cfg_t - CAN reactor configuration type.
+ *
+ * @nthreads:		Number of worker threads (0 means 1).
+ * @cpus:		Optional array of 'nthreads' CPU numbers to pin each
+ *			worker to. A negative entry leaves that worker unpinned.
+ * @priority:		SCHED_FIFO priority of the workers (0 keeps the default
+ *			scheduling policy).
+ */
+typedef struct ldx_can_reactor_cfg {
+	unsigned int		nthreads;
+	const int		*cpus;
+	int			priority;
+} ldx_can_reactor_cfg_t;
+
+/**
+ * ldx_can_event_t - Event read from a CAN socket
+ *
+ * @is_rx:		The event carries a received frame.
+ * @is_error:		The frame is an error frame.
+ * @rx_skt:		Socket the frame was read from.
+ * @frame:		The frame.
+ * @tstamp:		Reception timestamp, the raw hardware one if
+ *			'hw_timestamp' is enabled (microseconds resolution).
+ * @dropped_frames:	Frames dropped by the socket since the last report.
+ * @ts_sw:		Software reception timestamp (CLOCK_REALTIME).
+ * @ts_hw:		Raw hardware reception timestamp, only with
+ *			'hw_timestamp'.
+ *
+ * Timestamps are only filled if 'process_header' is enabled, and are zero
+ * when not available.
+ */
 typedef struct ldx_can_event_t {
 	int is_rx : 1;
 	int is_error : 1;
@@ -94,8 +381,59 @@ typedef struct ldx_can_event_t {
 	struct canfd_frame frame;
 	struct timeval tstamp;
 	uint32_t dropped_frames;
+	struct timespec ts_sw;
+	struct timespec ts_hw;
 } ldx_can_event_t;
 
+/**
+ * Callback receiving every event drained from an rx socket in one pass
+ *
+ * See 'ldx_can_register_rx_batch_handler()'.
+ */
+typedef void (*ldx_can_rx_batch_cb_t)(void *ctx, const ldx_can_event_t *evts,
+				      size_t n);
+
+/**
+ * ldx_can_ring_t - Lock-free queue of received events
+ *
+ * See 'ldx_can_open_rx_ring()'.
+ */
+typedef struct ldx_can_ring ldx_can_ring_t;
+
+/**
+ * ldx_can_ring_stats_t - CAN ring statistics.
+ *
+ * @size:		Number of slots in the ring.
+ * @depth:		Events currently queued.
+ * @enqueued:		Events queued since the ring was opened.
+ * @overflows:		Events dropped because the ring was full.
+ */
+typedef struct ldx_can_ring_stats {
+	uint32_t		size;
+	uint32_t		depth;
+	uint64_t		enqueued;
+	uint64_t		overflows;
+} ldx_can_ring_stats_t;
+
+/**
+ * ldx_can_txq_stats_t - Priority transmission queue statistics.
+ *
+ * @size:		Number of frames the queue can hold.
+ * @depth:		Frames currently waiting to be sent.
+ * @max_depth:		Maximum depth reached.
+ * @enqueued:		Frames accepted since the interface was initialized.
+ * @sent:		Frames sent from the queue.
+ * @overflows:		Frames rejected because the queue was full.
+ */
+typedef struct ldx_can_txq_stats {
+	uint32_t		size;
+	uint32_t		depth;
+	uint32_t		max_depth;
+	uint64_t		enqueued;
+	uint64_t		sent;
+	uint64_t		overflows;
+} ldx_can_txq_stats_t;
+
 /* Error values for the CAN interface */
 enum {
 	CAN_ERROR_NONE = 0,
@@ -162,6 +500,52 @@ enum {
 	CAN_ERROR_ERR_CB_NOT_FOUND,
 	CAN_ERROR_ERR_CB_ALR_REG,
 
+	/* Event handling */
+	CAN_ERROR_EPOLL_CREATE,
+	CAN_ERROR_EPOLL_CTL,
+	CAN_ERROR_EVENTFD,
+	CAN_ERROR_REACTOR_BUSY,
+	CAN_ERROR_CAPTURE,
+
+	/* Instrumentation */
+	CAN_ERROR_PERF_DISABLED,
+
+	/* ISO-TP */
+	CAN_ERROR_ISOTP_SKT,
+	CAN_ERROR_ISOTP_TIMEOUT,
+	CAN_ERROR_ISOTP_OVERFLOW,
+	CAN_ERROR_ISOTP_PROTOCOL,
+
+	/* Broadcast manager */
+	CAN_ERROR_BCM_SKT,
+	CAN_ERROR_BCM_WR,
+	CAN_ERROR_BCM_RX_TIMEOUT,
+
+	/* Frame log */
+	CAN_ERROR_LOG_FILE,
+	CAN_ERROR_LOG_FORMAT,
+
+	/* Signal database */
+	CAN_ERROR_SIGDB_FORMAT,
+	CAN_ERROR_SIGDB_MSG_NOT_FOUND,
+	CAN_ERROR_SIGDB_SIG_NOT_FOUND,
+
+	/* Netlink transactions */
+	CAN_ERROR_NL_SKT,
+	CAN_ERROR_NL_SET_LINK,
+	CAN_ERROR_NL_TIMEOUT,
+
+	/* Link events */
+	CAN_ERROR_LINK_EVENT,
+
+	/* Routing */
+	CAN_ERROR_GW_ROUTE,
+	CAN_ERROR_NOT_SUPPORTED,
+
+	/* Transmission queue */
+	CAN_ERROR_TXQ_DISABLED,
+	CAN_ERROR_TXQ_FULL,
+
 	__CAN_ERR_LAST
 };
 
@@ -204,6 +588,50 @@ int ldx_can_get_dev_stats(const can_if_t *cif, struct can_device_stats *cds);
  */
 int ldx_can_get_bit_error_counter(const can_if_t *cif, struct can_berr_counter *bc);
 
+/**
+ * ldx_can_link_snapshot_t - Status of the link of a CAN interface
+ *
+ * @state:		Controller state, see 'enum can_state'.
+ * @running:		The interface is up and has carrier (not in bus-off).
+ * @has_bt:		'bt' holds the bit timing.
+ * @has_dbt:		'dbt' holds the data bit timing (CAN FD controllers).
+ * @has_berr:		'berr' holds the error counters of the controller.
+ * @has_stats:		'stats' holds the device statistics.
+ * @bt:			Bit timing.
+ * @dbt:		Data bit timing.
+ * @berr:		Bit error counters.
+ * @stats:		Device statistics.
+ */
+typedef struct {
+	enum can_state		state;
+	bool			running;
+	bool			has_bt;
+	bool			has_dbt;
+	bool			has_berr;
+	bool			has_stats;
+	struct can_bittiming	bt;
+	struct can_bittiming	dbt;
+	struct can_berr_counter	berr;
+	struct can_device_stats	stats;
+} ldx_can_link_snapshot_t;
+
+/**
+ * ldx_can_get_link_snapshot() - Retrieve the whole status of the link
+ *
+ * @cif:	The CAN interface.
+ * @snap:	Pointer where the status will be stored.
+ *
+ * The state, bit timing, error counters and statistics are taken from a
+ * single RTM_GETLINK answer, sent through a netlink socket that is kept
+ * open by the interface. 'ldx_can_get_state()', 'ldx_can_get_dev_stats()'
+ * and 'ldx_can_get_bit_error_counter()' use the same socket. Can be called
+ * from any thread, including from the handlers.
+ *
+ * Return: CAN_ERROR_NONE on success, error code otherwise.
+ */
+int ldx_can_get_link_snapshot(const can_if_t *cif,
+			      ldx_can_link_snapshot_t *snap);
+
 /**
  * ldx_can_stop() - stop the specified CAN interface
  *
@@ -228,6 +656,137 @@ int ldx_can_stop(const can_if_t *cif);
  */
 int ldx_can_restart(const can_if_t *cif);
 
+/**
+ * ldx_can_link_config_send() - Send the link configuration of interfaces
+ *
+ * @cifs:	Array of CAN interfaces to configure.
+ * @cfgs:	Array with the configuration of each interface. Only the link
+ *		settings are used: bitrate (or bit_timing), dbitrate (or
+ *		dbit_timing), restart_ms, ctrl_mode and nl_cmd_verify.
+ * @n:		Number of interfaces.
+ * @start:	Also bring the interfaces up.
+ *
+ * Each interface gets a single RTM_NEWLINK message carrying all its
+ * settings, and the messages of all the interfaces are sent with one
+ * syscall. The call does not wait for the kernel: the request completes
+ * with 'ldx_can_link_config_wait()', and its file descriptor can be polled
+ * meanwhile. The settings can only be changed while an interface is down.
+ *
+ * Return: A pointer to the request on success, NULL on error.
+ */
+ldx_can_link_req_t *ldx_can_link_config_send(can_if_t *const *cifs,
+					     const can_if_cfg_t *cfgs,
+					     unsigned int n, bool start);
+
+/**
+ * ldx_can_link_config_get_fd() - Get the file descriptor of a request
+ *
+ * @req:	The link configuration request.
+ *
+ * The descriptor becomes readable when the kernel answers.
+ *
+ * Return: The file descriptor, -1 on error.
+ */
+int ldx_can_link_config_get_fd(const ldx_can_link_req_t *req);
+
+/**
+ * ldx_can_link_config_wait() - Wait for a link configuration request
+ *
+ * @req:	The link configuration request.
+ * @timeout_ms:	Maximum time to wait in ms, -1 to wait indefinitely.
+ * @errors:	If not NULL, array of 'n' entries filled with the result of
+ *		each interface.
+ *
+ * For the interfaces with 'nl_cmd_verify', the settings and the state are
+ * then read back, again with a single message per interface. Memory of the
+ * request is freed, even on timeout.
+ *
+ * Return: CAN_ERROR_NONE if all the interfaces were configured, the first
+ *	   error code otherwise.
+ */
+int ldx_can_link_config_wait(ldx_can_link_req_t *req, int timeout_ms,
+			     int *errors);
+
+/**
+ * ldx_can_link_config() - Configure the link of interfaces
+ *
+ * @cifs:	Array of CAN interfaces to configure.
+ * @cfgs:	Array with the configuration of each interface.
+ * @n:		Number of interfaces.
+ * @start:	Also bring the interfaces up.
+ *
+ * Synchronous version of 'ldx_can_link_config_send()'. 'ldx_can_init()'
+ * uses it for its interface; to bring several interfaces up in parallel,
+ * configure them all with one call and then initialize them with their
+ * link settings unset.
+ *
+ * Return: CAN_ERROR_NONE if all the interfaces were configured, the first
+ *	   error code otherwise.
+ */
+int ldx_can_link_config(can_if_t *const *cifs, const can_if_cfg_t *cfgs,
+			unsigned int n, bool start);
+
+/**
+ * ldx_can_link_event_t - Link status reported by the link events
+ *
+ * @state:	Controller state, see 'enum can_state'.
+ * @running:	The interface is up and has carrier (not in bus-off).
+ * @has_berr:	'berr' holds the error counters of the controller.
+ * @has_stats:	'stats' holds the device statistics.
+ * @berr:	Bit error counters.
+ * @stats:	Device statistics.
+ */
+typedef struct {
+	enum can_state		state;
+	bool			running;
+	bool			has_berr;
+	bool			has_stats;
+	struct can_berr_counter	berr;
+	struct can_device_stats	stats;
+} ldx_can_link_event_t;
+
+/**
+ * ldx_can_subscribe_link_events() - Receive link changes in the event loop
+ *
+ * @cif:	The CAN interface.
+ *
+ * Subscribes to the link notifications of the kernel (RTMGRP_LINK) with a
+ * netlink socket that is serviced by the event loop of the interface, so
+ * there is no cost while the link does not change. Each time the link
+ * status of the interface changes, the error handlers are called with
+ * CAN_ERROR_LINK_EVENT and a pointer to a 'ldx_can_link_event_t', only
+ * valid during the call. The current status is reported right away.
+ *
+ * The kernel notifies the changes of the link itself (up, down, bus-off,
+ * restart). Use 'ldx_can_refresh_link_event()' to get the counters at
+ * other moments without blocking.
+ *
+ * Return: CAN_ERROR_NONE on success, error code otherwise.
+ */
+int ldx_can_subscribe_link_events(can_if_t *cif);
+
+/**
+ * ldx_can_refresh_link_event() - Request a link event with the current status
+ *
+ * @cif:	The CAN interface, subscribed to the link events.
+ *
+ * The request is sent without waiting; the answer is handled by the event
+ * loop like a notification, so the handlers are only called if the status
+ * changed since the last event.
+ *
+ * Return: CAN_ERROR_NONE on success, error code otherwise.
+ */
+int ldx_can_refresh_link_event(const can_if_t *cif);
+
+/**
+ * ldx_can_unsubscribe_link_events() - Stop receiving link changes
+ *
+ * @cif:	The CAN interface.
+ *
+ * Return: CAN_ERROR_NONE on success, error code otherwise.
+ */
+int ldx_can_unsubscribe_link_events(const can_if_t *cif);
+
 /**
  * ldx_can_set_bit_timing() - set the bit timing of the specified interface
  *
@@ -300,6 +859,14 @@ int ldx_can_free(can_if_t *cif);
  *    * canfd_enabled: Disabled
  *    * process_header: Enabled
  *    * hw_timestamp: Disabled
+ *    * rx_batch_size: LDX_CAN_DEF_RX_BATCH
+ *    * tx_wait_ms: 0
+ *    * rx_spin_us: 0
+ *    * thread_priority: 0
+ *    * thread_cpu_mask: 0
+ *    * busy_poll_us: 0
+ *    * skt_priority: -1
+ *    * perf_stats: Disabled
  *    * error_mask: CAN_ERR_TX_TIMEOUT | CAN_ERR_CRTL | CAN_ERR_BUSOFF |
  *    			    CAN_ERR_BUSERROR | CAN_ERR_RESTARTED;
  */
@@ -376,6 +943,56 @@ int ldx_can_start(const can_if_t *cif);
  */
 int ldx_can_tx_frame(const can_if_t *cif, struct canfd_frame *frame);
 
+/**
+ * ldx_can_tx_frames() - Send an array of frames through the CAN interface
+ *
+ * @cif:	A pointer to the requested CAN to send the frames.
+ * @frames:	Array of frames to send (struct canfd_frame).
+ * @nframes:	Number of frames in the array.
+ * @sent:	Pointer where the number of frames actually queued is stored.
+ *		It may be NULL.
+ *
+ * The frames are submitted in order with sendmmsg(), up to
+ * LDX_CAN_TX_BATCH_MAX frames per syscall. If the transmission queue fills
+ * up, the function waits for the socket to become writable for up to
+ * 'cfg.tx_wait_ms' before giving up with '-CAN_ERROR_TX_RETRY_LATER'. In that
+ * case, '*sent' tells where to resume.
+ *
+ * Return: EXIT_SUCCESS if all the frames were sent, error code otherwise.
+ */
+int ldx_can_tx_frames(const can_if_t *cif, struct canfd_frame *frames,
+		      unsigned int nframes, unsigned int *sent);
+
+/**
+ * ldx_can_tx_enqueue() - Queue a frame for transmission in priority order
+ *
+ * @cif:	A pointer to the CAN interface, with 'cfg.tx_queue_len' set.
+ * @frame:	Frame to send, copied into the queue.
+ *
+ * Any number of threads can enqueue at the same time without locks, and
+ * the call never waits. The frames are sent by the event loop of the
+ * interface (its thread, reactor or poll calls) in CAN arbitration order,
+ * lowest ID first and in arrival order for the same ID, whenever the
+ * transmission socket is writable. Frames already handed to the socket
+ * keep their order, so a small 'tx_buf_len' makes the ordering stricter.
+ * Frames rejected by the socket are dropped and reported to the error
+ * handlers, with the frame as data.
+ *
+ * Return: EXIT_SUCCESS on success, -CAN_ERROR_TXQ_FULL if the queue is
+ *	   full, error code otherwise.
+ */
+int ldx_can_tx_enqueue(const can_if_t *cif, const struct canfd_frame *frame);
+
+/**
+ * ldx_can_txq_get_stats() - Get the statistics of the transmission queue
+ *
+ * @cif:	A pointer to the CAN interface.
+ * @stats:	Pointer where the statistics will be stored.
+ *
+ * Return: EXIT_SUCCESS on success, error code otherwise.
+ */
+int ldx_can_txq_get_stats(const can_if_t *cif, ldx_can_txq_stats_t *stats);
+
 /**
  * ldx_can_register_rx_handler() - Start frame reception on the given CAN
  *
@@ -410,6 +1027,81 @@ int ldx_can_register_rx_handler(can_if_t *cif, const ldx_can_rx_cb_t cb,
  */
 int ldx_can_unregister_rx_handler(const can_if_t *cif, const ldx_can_rx_cb_t cb);
 
+/**
+ * ldx_can_register_rx_batch_handler() - Start batched frame reception
+ *
+ * @cif:	A pointer to the requested CAN to start the reception.
+ * @cb:		Callback to execute with each batch of received events.
+ * @ctx:	User context passed to the callback.
+ * @filters:	A set of filters to filter the reception of frames.
+ * @nfilters:	The number of filters contained in the filters variable.
+ *
+ * Like 'ldx_can_register_rx_handler()', but the callback is executed once
+ * per batch of up to 'cfg.rx_batch_size' events drained from the socket,
+ * with the given context. Error frames are part of the batch, with
+ * 'is_error' set, and are also reported to the error handlers.
+ *
+ * The events are only valid during the callback. The same callback can be
+ * registered several times, each registration gets its own socket.
+ *
+ * To stop the reception use 'ldx_can_unregister_rx_batch_handler()'.
+ *
+ * Return: A handle (>= 0) identifying the registration, error code otherwise.
+ */
+int ldx_can_register_rx_batch_handler(can_if_t *cif,
+				      const ldx_can_rx_batch_cb_t cb, void *ctx,
+				      struct can_filter *filters, int nfilters);
+
+/**
+ * ldx_can_unregister_rx_batch_handler() - Stop batched frame reception
+ *
+ * @cif:	A pointer to the CAN interface.
+ * @handle:	Handle returned by 'ldx_can_register_rx_batch_handler()'.
+ *
+ * Return: EXIT_SUCCESS on success, error code otherwise.
+ */
+int ldx_can_unregister_rx_batch_handler(const can_if_t *cif, int handle);
+
+/**
+ * ldx_can_register_id_handler() - Register a handler for a CAN ID/mask
+ *
+ * @cif:	A pointer to the CAN interface.
+ * @id:		CAN ID to match. Set CAN_EFF_FLAG for 29-bit IDs.
+ * @mask:	Bits of the ID that must match (CAN_SFF_MASK or CAN_EFF_MASK
+ *		for a single ID).
+ * @cb:		Callback to execute for each matching frame.
+ *
+ * All the handlers registered this way share a single rx socket, without
+ * kernel filters, and are compiled into a dispatch table each time one is
+ * added or removed: a direct indexed table for 11-bit IDs and a hash table
+ * for 29-bit IDs registered with a full mask. Each received frame then
+ * reaches its handlers in constant time, so one socket can fan out to
+ * hundreds of per-message handlers. 29-bit handlers with a partial mask are
+ * tested one by one for IDs that are not in the hash table.
+ *
+ * The same callback may be registered for several IDs, and several
+ * callbacks for the same ID.
+ *
+ * Return: CAN_ERROR_NONE on success, error code otherwise.
+ */
+int ldx_can_register_id_handler(can_if_t *cif, canid_t id, canid_t mask,
+				const ldx_can_rx_cb_t cb);
+
+/**
+ * ldx_can_unregister_id_handler() - Remove a handler registered by CAN ID
+ *
+ * @cif:	A pointer to the CAN interface.
+ * @id:		CAN ID used to register the handler.
+ * @mask:	Mask used to register the handler.
+ * @cb:		Callback to be removed.
+ *
+ * The shared rx socket is closed when the last handler is removed.
+ *
+ * Return: CAN_ERROR_NONE on success, error code otherwise.
+ */
+int ldx_can_unregister_id_handler(can_if_t *cif, canid_t id, canid_t mask,
+				  const ldx_can_rx_cb_t cb);
+
 /**
  * Internal implementation of ldx_can_register_rx_handler.
  * 
@@ -429,12 +1121,185 @@ int ldx_can_open_rx_socket(can_if_t* cif,
  */
 int ldx_can_close_rx_socket(const can_if_t* cif, int skt);
 
+/**
+ * ldx_can_filter_set_create() - Precompute a set of reception filters
+ *
+ * @filters:	Filters of the set. Set CAN_INV_FILTER in 'can_id' to receive
+ *		the frames that do not match.
+ * @nfilters:	Number of filters, 0 for a set that receives no frames.
+ * @join:	Receive only the frames matching all the filters
+ *		(CAN_RAW_JOIN_FILTERS) instead of any of them.
+ *
+ * The filters are normalized once: IDs are reduced to their mask, and
+ * duplicated filters, or filters already covered by a broader one, are
+ * removed. The set does not depend on an interface, so it can be applied
+ * to any number of sockets of any interface. Masks including CAN_EFF_FLAG
+ * and CAN_RTR_FLAG for single IDs use the fastest kernel lookup.
+ *
+ * Memory of the set must be freed with 'ldx_can_filter_set_free()'; the
+ * sockets keep their filters after that.
+ *
+ * Return: A pointer to the set on success, NULL on error.
+ */
+ldx_can_filter_set_t *ldx_can_filter_set_create(const struct can_filter *filters,
+						int nfilters, bool join);
+
+/**
+ * ldx_can_filter_set_free() - Free a set of reception filters
+ *
+ * @set:	The set to free.
+ */
+void ldx_can_filter_set_free(ldx_can_filter_set_t *set);
+
+/**
+ * ldx_can_set_rx_filters() - Replace the filters of an rx socket
+ *
+ * @cif:	A pointer to the CAN interface of the socket.
+ * @rx_skt:	Socket returned by 'ldx_can_open_rx_socket()' or the handle of
+ *		a batch handler.
+ * @set:	New filters.
+ *
+ * The filters are replaced in the kernel while the socket stays open and
+ * registered, so no frames matching both the old and the new filters are
+ * lost. When the join mode changes, frames matching any of the filters may
+ * pass for a moment.
+ *
+ * Return: CAN_ERROR_NONE on success, error code otherwise.
+ */
+int ldx_can_set_rx_filters(const can_if_t *cif, int rx_skt,
+			   const ldx_can_filter_set_t *set);
+
+/**
+ * ldx_can_set_rx_handler_filters() - Replace the filters of an rx handler
+ *
+ * @cif:	A pointer to the CAN interface.
+ * @cb:		Callback registered with 'ldx_can_register_rx_handler()'.
+ * @set:	New filters.
+ *
+ * See 'ldx_can_set_rx_filters()'.
+ *
+ * Return: CAN_ERROR_NONE on success, error code otherwise.
+ */
+int ldx_can_set_rx_handler_filters(const can_if_t *cif, const ldx_can_rx_cb_t cb,
+				   const ldx_can_filter_set_t *set);
+
+/**
+ * ldx_can_open_rx_ring() - Open an rx socket that queues into a ring
+ *
+ * @cif:	A pointer to the CAN interface.
+ * @filters:	A set of filters to filter the reception of frames.
+ * @nfilters:	The number of filters contained in the filters variable.
+ * @size:	Number of slots, rounded up to a power of two.
+ * @notify:	Create an eventfd, see 'ldx_can_ring_get_fd()'.
+ *
+ * Frames received on the socket are not passed to any callback. The library
+ * thread (or the poll functions) only copies them into a single-producer,
+ * single-consumer ring that one application thread drains without locks
+ * through 'ldx_can_ring_pop()' and 'ldx_can_ring_pop_bulk()'. A slow consumer
+ * therefore never stalls the reception of other sockets; when the ring is
+ * full, new frames are dropped and counted as overflows. Error frames and
+ * socket drops are reported to the error handlers as on any other socket;
+ * error frames are also queued, with 'is_error' set.
+ *
+ * Memory for the ring must be freed with 'ldx_can_close_rx_ring()'.
+ *
+ * Return: A pointer to the ring on success, NULL on error.
+ */
+ldx_can_ring_t *ldx_can_open_rx_ring(can_if_t *cif, struct can_filter *filters,
+				     int nfilters, unsigned int size, bool notify);
+
+/**
+ * ldx_can_close_rx_ring() - Close a ring opened with 'ldx_can_open_rx_ring()'
+ *
+ * @cif:	A pointer to the CAN interface.
+ * @ring:	The ring to close. It must not be in use by the consumer.
+ *
+ * Return: EXIT_SUCCESS on success, error code otherwise.
+ */
+int ldx_can_close_rx_ring(const can_if_t *cif, ldx_can_ring_t *ring);
+
+/**
+ * ldx_can_ring_pop() - Dequeue one event from a ring
+ *
+ * @ring:	The ring.
+ * @evt:	Pointer where the event is copied.
+ *
+ * Return: 1 if an event was dequeued, 0 if the ring is empty.
+ */
+int ldx_can_ring_pop(ldx_can_ring_t *ring, ldx_can_event_t *evt);
+
+/**
+ * ldx_can_ring_pop_bulk() - Dequeue up to 'max' events from a ring
+ *
+ * @ring:	The ring.
+ * @evts:	Array where the events are copied.
+ * @max:	Size of the array.
+ *
+ * Return: the number of events dequeued.
+ */
+unsigned int ldx_can_ring_pop_bulk(ldx_can_ring_t *ring, ldx_can_event_t *evts,
+				   unsigned int max);
+
+/**
+ * ldx_can_ring_get_fd() - Get the notification eventfd of a ring
+ *
+ * @ring:	The ring.
+ *
+ * If the ring was opened with 'notify', the eventfd is signalled once per
+ * received batch, so the consumer can block on it with poll()/epoll and then
+ * read it and drain the ring until empty.
+ *
+ * Return: The eventfd, or -1 if notifications are disabled.
+ */
+int ldx_can_ring_get_fd(const ldx_can_ring_t *ring);
+
+/**
+ * ldx_can_ring_get_stats() - Get the statistics of a ring
+ *
+ * @ring:	The ring.
+ * @stats:	Pointer where the statistics are stored.
+ */
+void ldx_can_ring_get_stats(const ldx_can_ring_t *ring,
+			    ldx_can_ring_stats_t *stats);
+
 /**
  * Return CAN socket associated with the CAN Transmit channel.
  * 
  * \return Negative value upon failure, otherwise the file descriptor.
  */
 int ldx_can_get_tx_skt(const can_if_t* cif);
+
+/**
+ * ldx_can_get_fd() - Get a pollable file descriptor of the CAN interface
+ *
+ * @cif:	A CAN interface initialized with 'polled_mode' set.
+ *
+ * The descriptor aggregates every socket of the interface and becomes
+ * readable whenever any of them has pending events, so it can be added to an
+ * external epoll, libuv or asio loop. It may be registered edge triggered,
+ * as long as 'ldx_can_drain()' is called until it returns zero after each
+ * notification. The descriptor belongs to the interface and must not be
+ * closed.
+ *
+ * Return: The file descriptor, negative error code otherwise.
+ */
+int ldx_can_get_fd(const can_if_t *cif);
+
+/**
+ * ldx_can_drain() - Process the pending events of the CAN interface
+ *
+ * @cif:	A CAN interface initialized with 'polled_mode' set.
+ *
+ * Dispatches to the registered callbacks everything that is ready, without
+ * blocking. Under a continuous flow of frames it gives up after a bounded
+ * amount of work, so the caller's loop keeps running.
+ *
+ * Return: Zero if no events are left, a positive value if some are still
+ *	   pending and the function must be called again, negative error code
+ *	   otherwise.
+ */
+int ldx_can_drain(const can_if_t *cif);
+
 /**
  * ldx_can_register_error_handler() - Start an error handler on the given CAN
  *
@@ -465,8 +1330,33 @@ int ldx_can_register_error_handler(const can_if_t *cif, const ldx_can_error_cb_t
  */
 int ldx_can_unregister_error_handler(const can_if_t *cif, const ldx_can_error_cb_t cb);
 
+/**
+ * ldx_can_set_thread_poll_rate() - Set the maximum wait of the library thread
+ *
+ * @cif:	A pointer to the CAN interface.
+ * @timeout:	Maximum time the thread blocks waiting for events. A zero
+ *		timeout (the default) blocks until a socket is ready.
+ *
+ * The thread is woken up by the sockets themselves, so this is only needed
+ * to bound the wait.
+ *
+ * Return: EXIT_SUCCESS on success, error code otherwise.
+ */
 int ldx_can_set_thread_poll_rate(const can_if_t* cif, struct timeval* timeout);
 int ldx_can_set_thread_poll_rate_msec(const can_if_t* cif, int milliseconds);
+
+/**
+ * ldx_can_wakeup() - Wake up a thread blocked polling the CAN interface
+ *
+ * @cif:	A pointer to the CAN interface.
+ *
+ * Makes a blocked 'ldx_can_poll()' or 'ldx_can_poll_one()' return early
+ * without any event.
+ *
+ * Return: EXIT_SUCCESS on success, error code otherwise.
+ */
+int ldx_can_wakeup(const can_if_t *cif);
+
 /**
  * ldx_can_poll() - Poll CAN interface for data.  The function will block for 
  * the specified time unless data is received.
@@ -508,6 +1398,30 @@ int ldx_can_poll_msec(const can_if_t* cif, int milliseconds);
  * \return: Positive value if a socket was read from.  zero if nothing happened, (negative) error code otherwise.
  */
 int ldx_can_poll_one(const can_if_t* cif, struct timeval* timeout, ldx_can_event_t* evt);
+
+/**
+ * ldx_can_poll_many() - Poll CAN interface for all the pending events.
+ *
+ * Like \ref ldx_can_poll_one, but a single wait collects the events of every
+ * ready rx socket and of the tx socket, so an external event loop is woken
+ * up once per batch instead of once per frame. No callback is called; events
+ * can still be handed to them with \ref ldx_can_dispatch_evt. Frames of
+ * handlers with a reception ring keep going to their ring.
+ *
+ * Frames not fitting in @evts remain queued in their socket and are returned
+ * by the next call.
+ *
+ * @cif:	A pointer to the CAN interface to poll.
+ * @timeout:	Timeout value, NULL to wait indefinitely.
+ * @evts:	Array of events (out).
+ * @max:	Number of entries of @evts.
+ *
+ * Return: Number of events stored in @evts, zero if nothing happened,
+ *	   negative error code otherwise.
+ */
+int ldx_can_poll_many(const can_if_t *cif, struct timeval *timeout,
+		      ldx_can_event_t *evts, unsigned int max);
+
 /**
  * ldx_can_dispatch_evt() - Dispatch CAN  to callback(s) registered with the CAN interface.
  *
@@ -542,6 +1456,513 @@ int ldx_can_read_rx_socket_i(const can_if_t* cif, int rx_skt, ldx_can_event_t* e
 */
 int ldx_can_read_and_dispatch_i(const can_if_t* cif, fd_set* fds);
 
+/**
+ * ldx_can_capture_open() - Capture all the frames of an interface
+ *
+ * @cif:	A pointer to the CAN interface.
+ * @cfg:	A pointer to the capture configuration, NULL for the defaults.
+ *
+ * Opens an AF_PACKET socket bound to the CAN interface with a TPACKET_V3 ring
+ * mapped in memory. The kernel fills whole blocks of frames with their
+ * timestamps (hardware ones if 'cfg.hw_timestamp' is set and supported), and
+ * the blocks are handed out without copying or one syscall per frame. Every
+ * frame on the bus is seen, independently of the CAN_RAW sockets and filters
+ * of the library.
+ *
+ * Memory for the capture must be freed with 'ldx_can_capture_close()'.
+ *
+ * Return: A pointer to the capture on success, NULL on error.
+ */
+ldx_can_capture_t *ldx_can_capture_open(const can_if_t *cif,
+					const ldx_can_capture_cfg_t *cfg);
+
+/**
+ * ldx_can_capture_get_fd() - Get the file descriptor of a capture
+ *
+ * @cap:	The capture.
+ *
+ * The descriptor becomes readable when a block is ready, so it can be added
+ * to an external poll()/epoll loop.
+ *
+ * Return: The file descriptor.
+ */
+int ldx_can_capture_get_fd(const ldx_can_capture_t *cap);
+
+/**
+ * ldx_can_capture_next_block() - Get the next block of captured frames
+ *
+ * @cap:	The capture.
+ * @blk:	Pointer where the block is stored.
+ * @timeout_ms:	Maximum time to wait for a block, -1 waits indefinitely.
+ *
+ * The block remains owned by the user, and the kernel cannot reuse it, until
+ * it is returned with 'ldx_can_capture_release_block()'.
+ *
+ * Return: 1 if a block was retrieved, 0 on timeout, error code otherwise.
+ */
+int ldx_can_capture_next_block(ldx_can_capture_t *cap,
+			       ldx_can_capture_block_t *blk, int timeout_ms);
+
+/**
+ * ldx_can_capture_next_frame() - Iterate over the frames of a block
+ *
+ * @blk:	The block.
+ * @ts:		Pointer where the kernel timestamp is stored. It may be NULL.
+ *
+ * The returned frame points into the shared ring. For classic CAN frames only
+ * the first 8 data bytes are valid.
+ *
+ * Return: A pointer to the next frame, NULL at the end of the block.
+ */
+const struct canfd_frame *ldx_can_capture_next_frame(ldx_can_capture_block_t *blk,
+						     struct timespec *ts);
+
+/**
+ * ldx_can_capture_next_event() - Copy the next frame of a block into an event
+ *
+ * @blk:	The block.
+ * @evt:	Pointer where the event is stored.
+ *
+ * Return: 1 if an event was stored, 0 at the end of the block.
+ */
+int ldx_can_capture_next_event(ldx_can_capture_block_t *blk,
+			       ldx_can_event_t *evt);
+
+/**
+ * ldx_can_capture_release_block() - Return a block to the kernel
+ *
+ * @cap:	The capture.
+ * @blk:	The block to release.
+ */
+void ldx_can_capture_release_block(ldx_can_capture_t *cap,
+				   ldx_can_capture_block_t *blk);
+
+/**
+ * ldx_can_capture_close() - Stop a capture and free its resources
+ *
+ * @cap:	The capture to close.
+ */
+void ldx_can_capture_close(ldx_can_capture_t *cap);
+
+/**
+ * ldx_can_isotp_open() - Open an ISO-TP session on a CAN interface
+ *
+ * @cif:	A pointer to the CAN interface.
+ * @cfg:	A pointer to the session configuration.
+ *
+ * The segmentation, reassembly and flow control are offloaded to the kernel
+ * CAN_ISOTP protocol when it is available, so a whole PDU moves with a single
+ * system call. Otherwise, or with 'no_offload', the session falls back to a
+ * user space engine on its own CAN_RAW socket, run within
+ * 'ldx_can_isotp_send()' and 'ldx_can_isotp_recv()'. In that case a peer
+ * only gets the flow control of a segmented PDU while a receive call is in
+ * progress.
+ *
+ * Frames follow the interface configuration: CAN FD sessions use up to
+ * 64-byte frames.
+ *
+ * Return: The session on success, NULL otherwise.
+ */
+ldx_can_isotp_t *ldx_can_isotp_open(can_if_t *cif,
+				    const ldx_can_isotp_cfg_t *cfg);
+
+/**
+ * ldx_can_isotp_is_offloaded() - Check if a session uses the kernel CAN_ISOTP
+ *
+ * @tp:		The ISO-TP session.
+ *
+ * Return: true if the kernel implements the protocol, false otherwise.
+ */
+bool ldx_can_isotp_is_offloaded(const ldx_can_isotp_t *tp);
+
+/**
+ * ldx_can_isotp_get_fd() - Get a file descriptor to wait for incoming PDUs
+ *
+ * @tp:		The ISO-TP session.
+ *
+ * The descriptor becomes readable when a PDU (kernel offload) or its first
+ * frame (user space engine) is received. Use 'ldx_can_isotp_recv()' to read
+ * it.
+ *
+ * Return: The file descriptor.
+ */
+int ldx_can_isotp_get_fd(const ldx_can_isotp_t *tp);
+
+/**
+ * ldx_can_isotp_send() - Send a PDU
+ *
+ * @tp:		The ISO-TP session.
+ * @buf:	PDU to send.
+ * @len:	Length of the PDU.
+ *
+ * Blocks until the whole PDU has been transmitted, honouring the flow
+ * control of the receiver.
+ *
+ * Return: CAN_ERROR_NONE on success, error code otherwise.
+ */
+int ldx_can_isotp_send(ldx_can_isotp_t *tp, const void *buf, size_t len);
+
+/**
+ * ldx_can_isotp_recv() - Receive a PDU
+ *
+ * @tp:		The ISO-TP session.
+ * @buf:	Buffer to store the PDU.
+ * @len:	Size of the buffer.
+ * @timeout_ms:	Time to wait for the start of a PDU, -1 to wait indefinitely.
+ *
+ * Return: The length of the PDU on success, 0 on timeout, error code
+ *	   otherwise.
+ */
+int ldx_can_isotp_recv(ldx_can_isotp_t *tp, void *buf, size_t len,
+		       int timeout_ms);
+
+/**
+ * ldx_can_isotp_close() - Close an ISO-TP session
+ *
+ * @tp:		The ISO-TP session to close.
+ */
+void ldx_can_isotp_close(ldx_can_isotp_t *tp);
+
+/**
+ * ldx_can_cyclic_tx_start() - Start the cyclic transmission of a frame
+ *
+ * @cif:	A pointer to the CAN interface.
+ * @frame:	Frame to transmit. Its CAN ID identifies the transmission.
+ * @period_us:	Transmission period in microseconds, must not be 0.
+ *
+ * The frame is sent by the kernel broadcast manager (CAN_BCM), which owns
+ * the timing, so periodic frames such as heartbeats cost no wakeup nor
+ * syscall in the application. Starting an already running CAN ID replaces
+ * its content and period.
+ *
+ * Return: CAN_ERROR_NONE on success, error code otherwise.
+ */
+int ldx_can_cyclic_tx_start(const can_if_t *cif,
+			    const struct canfd_frame *frame, uint32_t period_us);
+
+/**
+ * ldx_can_cyclic_tx_update() - Update the content of a cyclic transmission
+ *
+ * @cif:	A pointer to the CAN interface.
+ * @frame:	New content. Its CAN ID identifies the transmission, which
+ *		must have been started with 'ldx_can_cyclic_tx_start()'.
+ *
+ * The new content is sent from the next period on, without restarting the
+ * timer.
+ *
+ * Return: CAN_ERROR_NONE on success, error code otherwise.
+ */
+int ldx_can_cyclic_tx_update(const can_if_t *cif,
+			     const struct canfd_frame *frame);
+
+/**
+ * ldx_can_cyclic_tx_stop() - Stop a cyclic transmission
+ *
+ * @cif:	A pointer to the CAN interface.
+ * @can_id:	CAN ID of the transmission to stop.
+ *
+ * Return: CAN_ERROR_NONE on success, error code otherwise.
+ */
+int ldx_can_cyclic_tx_stop(const can_if_t *cif, canid_t can_id);
+
+/**
+ * ldx_can_register_change_handler() - Receive a CAN ID only when it changes
+ *
+ * @cif:	A pointer to the CAN interface.
+ * @cb:		Callback to execute when the content changes.
+ * @can_id:	CAN ID to watch. Set CAN_EFF_FLAG for 29-bit IDs.
+ * @mask:	Data bits compared to detect a change, NULL to compare the
+ *		whole payload.
+ * @mask_len:	Length of 'mask' in bytes.
+ * @timeout_us:	If not 0, the error handlers get CAN_ERROR_BCM_RX_TIMEOUT
+ *		when the frame is not received for this time.
+ *
+ * The comparison is done by the kernel broadcast manager (CAN_BCM), so
+ * cyclic frames that repeat the same content never reach user space. A
+ * change of the data length is also reported.
+ *
+ * To stop the reception use 'ldx_can_unregister_change_handler()'.
+ *
+ * Return: A handle (>= 0) identifying the registration, error code otherwise.
+ */
+int ldx_can_register_change_handler(can_if_t *cif, const ldx_can_rx_cb_t cb,
+				    canid_t can_id, const uint8_t *mask,
+				    uint8_t mask_len, uint32_t timeout_us);
+
+/**
+ * ldx_can_unregister_change_handler() - Stop a content change reception
+ *
+ * @cif:	A pointer to the CAN interface.
+ * @handle:	Handle returned by 'ldx_can_register_change_handler()'.
+ *
+ * Return: EXIT_SUCCESS on success, error code otherwise.
+ */
+int ldx_can_unregister_change_handler(const can_if_t *cif, int handle);
+
+/**
+ * ldx_can_recorder_start() - Record the received frames into a binary log
+ *
+ * @cif:	A pointer to the CAN interface.
+ * @path:	Log file to create (an existing file is truncated).
+ * @filters:	A set of filters to select the recorded frames.
+ * @nfilters:	The number of filters contained in the filters variable.
+ *
+ * Frames, including the error frames, are appended from the reception path
+ * of the interface to a compact binary log: a file header followed by
+ * blocks of records with their nanosecond timestamp, CAN ID, flags, length
+ * and payload. Blocks are written with a single large write each by a
+ * writer thread, so the reception path only copies the frames. If the file
+ * falls behind by more blocks than are buffered, frames are dropped and
+ * reported when the recorder is stopped. A block index is appended when the
+ * recorder is stopped. A log that was not
+ * stopped cleanly can still be replayed up to its last complete block.
+ *
+ * Return: A pointer to the recorder on success, NULL on error.
+ */
+ldx_can_recorder_t *ldx_can_recorder_start(can_if_t *cif, const char *path,
+					   struct can_filter *filters,
+					   int nfilters);
+
+/**
+ * ldx_can_recorder_stop() - Stop a recorder and complete its log
+ *
+ * @rec:	The recorder to stop.
+ * @frames:	If not NULL, the number of frames recorded is stored here.
+ *
+ * Memory of the recorder is freed.
+ *
+ * Return: CAN_ERROR_NONE on success, error code if the log could not be
+ *	   completely written.
+ */
+int ldx_can_recorder_stop(ldx_can_recorder_t *rec, uint64_t *frames);
+
+/**
+ * ldx_can_replay() - Transmit the frames of a binary log
+ *
+ * @cif:	A pointer to the CAN interface.
+ * @path:	Log file written by a recorder.
+ * @speed:	Time scale: 1.0 keeps the original timing, 2.0 replays twice
+ *		as fast, and 0 sends the frames as fast as possible.
+ * @sent:	If not NULL, the number of frames sent is stored here.
+ *
+ * The log is mapped in memory and its frames are sent through
+ * 'ldx_can_tx_frames()', batching the frames that are due at the same
+ * time. Classic frames are sent as classic frames even on a CAN FD
+ * interface. Error frames, and CAN FD frames on a classic interface, are
+ * skipped. The call returns when the whole log has been sent.
+ *
+ * Return: CAN_ERROR_NONE on success, error code otherwise.
+ */
+int ldx_can_replay(const can_if_t *cif, const char *path, double speed,
+		   uint64_t *sent);
+
+/**
+ * ldx_can_sigdb_load() - Load a signal database from a DBC file
+ *
+ * @path:	DBC file to load.
+ *
+ * The messages (BO_) and signals (SG_) of the file are compiled into flat
+ * extraction plans with precomputed byte offsets, shifts, masks, scale and
+ * offset, so decoding a frame is a single pass over its signals without
+ * any bit walking. Little and big endian, signed, IEEE float
+ * (SIG_VALTYPE_) and multiplexed signals are supported, as long as each
+ * signal fits in an 8-byte window of the payload. The rest of the DBC
+ * sections are ignored.
+ *
+ * Memory of the database must be freed with 'ldx_can_sigdb_free()'.
+ *
+ * Return: A pointer to the database on success, NULL on error.
+ */
+ldx_can_sigdb_t *ldx_can_sigdb_load(const char *path);
+
+/**
+ * ldx_can_sigdb_free() - Free a signal database
+ *
+ * @db:		The database to free.
+ */
+void ldx_can_sigdb_free(ldx_can_sigdb_t *db);
+
+/**
+ * ldx_can_sigdb_msg_signals() - Get the number of signals of a message
+ *
+ * @db:		The signal database.
+ * @id:		CAN ID of the message, with CAN_EFF_FLAG for 29-bit IDs.
+ *
+ * Return: The number of signals, error code otherwise.
+ */
+int ldx_can_sigdb_msg_signals(const ldx_can_sigdb_t *db, canid_t id);
+
+/**
+ * ldx_can_sigdb_signal_index() - Get the position of a signal in a message
+ *
+ * @db:		The signal database.
+ * @id:		CAN ID of the message, with CAN_EFF_FLAG for 29-bit IDs.
+ * @name:	Name of the signal.
+ *
+ * Signals keep the order of the DBC file. The position is the index of the
+ * signal value filled by 'ldx_can_sigdb_decode()', and is meant to be
+ * looked up once, not per frame.
+ *
+ * Return: The position of the signal, error code otherwise.
+ */
+int ldx_can_sigdb_signal_index(const ldx_can_sigdb_t *db, canid_t id,
+			       const char *name);
+
+/**
+ * ldx_can_sigdb_decode() - Decode the signals of a frame
+ *
+ * @db:		The signal database.
+ * @frame:	Received frame.
+ * @values:	Array filled with the physical value of each signal.
+ * @nvalues:	Number of entries of 'values'.
+ *
+ * Signals not present in the frame, because it is too short or because
+ * their multiplexor value does not match, are set to NAN.
+ *
+ * Return: The number of values filled, error code otherwise.
+ */
+int ldx_can_sigdb_decode(const ldx_can_sigdb_t *db,
+			 const struct canfd_frame *frame, double *values,
+			 size_t nvalues);
+
+/**
+ * ldx_can_route_add() - Forward frames from one CAN interface to another
+ *
+ * @src:	Interface the frames are received from.
+ * @dst:	Interface the frames are sent through.
+ * @cfg:	Routing rule.
+ *
+ * Rules that only filter and rewrite the CAN ID are programmed into the
+ * kernel CAN gateway (CAN_GW, module 'can-gw'), so frames are forwarded
+ * without reaching user space. This needs CAP_NET_ADMIN. When the kernel
+ * gateway is not available, or the rule has a callback, frames are
+ * forwarded by the event loop of 'src': each batch received is sent with a
+ * single 'ldx_can_tx_frames()'. CAN FD frames are only forwarded by rules
+ * with 'canfd' set, which needs CAN FD enabled on both interfaces.
+ *
+ * Routes must be deleted before freeing any of their interfaces.
+ *
+ * Return: A pointer to the route on success, NULL on error.
+ */
+ldx_can_route_t *ldx_can_route_add(can_if_t *src, const can_if_t *dst,
+				   const ldx_can_route_cfg_t *cfg);
+
+/**
+ * ldx_can_route_is_offloaded() - Check where a route is forwarded
+ *
+ * @route:	The route.
+ *
+ * Return: true if the kernel gateway forwards the frames, false if the
+ *	   library does.
+ */
+bool ldx_can_route_is_offloaded(const ldx_can_route_t *route);
+
+/**
+ * ldx_can_route_del() - Stop forwarding the frames of a route
+ *
+ * @route:	The route to delete.
+ *
+ * Memory of the route is freed.
+ *
+ * Return: CAN_ERROR_NONE on success, error code otherwise.
+ */
+int ldx_can_route_del(ldx_can_route_t *route);
+
+/**
+ * ldx_can_reactor_create() - Create a reactor to service several interfaces
+ *
+ * @cfg:	A pointer to the reactor configuration. NULL creates a single
+ *		unpinned worker thread.
+ *
+ * The reactor runs one epoll loop over the event sources of all the attached
+ * interfaces, so the number of threads depends on the configuration and not
+ * on the number of interfaces. An interface is serviced by at most one worker
+ * at a time.
+ *
+ * Memory for the reactor is obtained with 'malloc' and must be freed with
+ * 'ldx_can_reactor_free()'.
+ *
+ * Return: A pointer to the reactor on success, NULL on error.
+ */
+ldx_can_reactor_t *ldx_can_reactor_create(const ldx_can_reactor_cfg_t *cfg);
+
+/**
+ * ldx_can_reactor_attach() - Service a CAN interface from a reactor
+ *
+ * @reactor:	The reactor.
+ * @cif:	A CAN interface initialized with 'polled_mode' set.
+ *
+ * Return: CAN_ERROR_NONE on success, error code otherwise.
+ */
+int ldx_can_reactor_attach(ldx_can_reactor_t *reactor, can_if_t *cif);
+
+/**
+ * ldx_can_reactor_detach() - Stop servicing a CAN interface from a reactor
+ *
+ * @reactor:	The reactor.
+ * @cif:	A CAN interface previously attached to the reactor.
+ *
+ * When this function returns, no worker is processing the interface.
+ * 'ldx_can_free()' detaches the interface automatically. It can not be
+ * called from a handler of the interface run by the reactor, as that worker
+ * is the one processing it; -CAN_ERROR_REACTOR_BUSY is returned then.
+ *
+ * Return: CAN_ERROR_NONE on success, error code otherwise.
+ */
+int ldx_can_reactor_detach(ldx_can_reactor_t *reactor, can_if_t *cif);
+
+/**
+ * ldx_can_reactor_free() - Stop the reactor workers and free the reactor
+ *
+ * @reactor:	The reactor to free.
+ *
+ * Any interface still attached is detached first.
+ *
+ * Return: EXIT_SUCCESS on success, error code otherwise.
+ */
+int ldx_can_reactor_free(ldx_can_reactor_t *reactor);
+
+/**
+ * ldx_can_get_perf_stats() - Take a snapshot of the performance statistics
+ *
+ * @cif:	A pointer to the CAN interface.
+ * @stats:	Where to store the snapshot.
+ *
+ * The statistics are only collected if 'perf_stats' was set in the interface
+ * configuration. Each counter is read atomically, but the snapshot as a
+ * whole is not, so counters updated concurrently may be slightly apart.
+ *
+ * Return: 0 on success, error code otherwise.
+ */
+int ldx_can_get_perf_stats(const can_if_t *cif, ldx_can_perf_stats_t *stats);
+
+/**
+ * ldx_can_reset_perf_stats() - Clear the performance statistics
+ *
+ * @cif:	A pointer to the CAN interface.
+ * @stats:	If not NULL, the statistics before clearing them are stored
+ *		here.
+ *
+ * Each counter is atomically exchanged with zero, so no update is lost
+ * between the snapshot and the reset.
+ *
+ * Return: 0 on success, error code otherwise.
+ */
+int ldx_can_reset_perf_stats(const can_if_t *cif, ldx_can_perf_stats_t *stats);
+
+/**
+ * ldx_can_perf_hist_percentile() - Estimate a percentile of a histogram
+ *
+ * @hist:	The histogram.
+ * @pct:	Percentile, between 0 and 100.
+ *
+ * Return: the upper bound of the bucket holding the percentile (capped to
+ *	   the maximum recorded value), which is within 1/16 of the real
+ *	   value, 0 if the histogram is empty.
+ */
+uint64_t ldx_can_perf_hist_percentile(const ldx_can_perf_hist_t *hist,
+				      double pct);
+
 /**
  * ldx_can_strerror() - return the string describing the error
  *